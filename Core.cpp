@@ -1,8 +1,23 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
 #include <iostream>
 #include <chrono>
+#include <thread>
 
+#include "Memory.h"
 #include "Renderer.h"
 #include "Input.h"
+#include "Replay.h"
+#include "Spatial.h"
+#include "Stats.h"
+#include "Text.h"
+#include "Trace.h"
 
 
 #ifdef _WIN32
@@ -14,9 +29,20 @@
 
 namespace Engine
 {
+	Config config;
+
 	int errors = 0;
 
 	float delta_time;
+	// Kept in double, a float stops resolving milliseconds after a few hours.
+	double time_elapsed = 0;
+	uint64_t frame_count = 0;
+	uint64_t seed = 0;
+	bool quit_requested = false;
+
+	// Starts set so the first frame is always drawn.
+	bool redraw_requested = true;
+	bool idle = false;
 
 	void(*PreInitialization)();
 	void(*PostInitialization)();
@@ -25,10 +51,33 @@ namespace Engine
 	void(*PreShutdown)();
 	void(*PostShutdown)();
 
+	// Sleeping can overshoot by a scheduler tick, so the last stretch is spun instead.
+	template<typename Clock>
+	void SleepUntil(typename Clock::time_point target)
+	{
+		const auto SPIN_TIME = std::chrono::milliseconds(2);
+
+		while (Clock::now() + SPIN_TIME < target)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		while (Clock::now() < target)
+			std::this_thread::yield();
+	}
+
 	void Initialize()
 	{
 		try
 		{
+#ifdef _WIN32
+			// Windows sleeps in 15.6ms ticks by default, far too coarse for SleepUntil's 1ms naps.
+			timeBeginPeriod(1);
+#endif
+			Memory::Initialize();
+
+			seed = config.seed;
+			if (seed == 0)
+				seed = uint64_t(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+
 			if (PreInitialization)
 				PreInitialization();
 
@@ -48,20 +97,76 @@ namespace Engine
 
 	bool Update()
 	{
-		static auto previous_time = std::chrono::high_resolution_clock::now();
+		using Clock = std::chrono::high_resolution_clock;
+		static auto previous_time = Clock::now();
+		static auto next_tick = Clock::now();
+
+		// Nothing changed last frame, so block until there's input rather than spinning through empty frames.
+		if (idle)
+			Input::WaitForEvents(config.idle_timeout);
+
+		if (config.fixed_timestep > 0)
+		{
+			delta_time = config.fixed_timestep;
+			// Counted rather than summed, so fixed steps never drift.
+			time_elapsed = double(frame_count + 1) * config.fixed_timestep;
+
+			if (config.realtime)
+			{
+				SleepUntil<Clock>(next_tick);
+				next_tick += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(config.fixed_timestep));
+
+				// Don't try to catch up after a stall.
+				if (next_tick < Clock::now())
+					next_tick = Clock::now();
+			}
+		}
+		else
+		{
+			if (config.max_frame_rate > 0)
+				SleepUntil<Clock>(previous_time + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.f / config.max_frame_rate)));
 
-		auto current_time = std::chrono::high_resolution_clock::now();
-		delta_time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - previous_time).count();
-		previous_time = current_time;
+			auto current_time = Clock::now();
+			delta_time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - previous_time).count();
+			time_elapsed += std::chrono::duration<double, std::chrono::seconds::period>(current_time - previous_time).count();
+			previous_time = current_time;
+		}
 
 		try
 		{
-			if (PreUpdate) PreUpdate();
+			Trace::BeginFrame();
+			Memory::Update();
+			Stats::BeginFrame();
 
-			Input::Update();
-			Graphics::Update();
+			if (PreUpdate)
+			{
+				Trace::Scope scope("PreUpdate");
+				PreUpdate();
+			}
+
+			if (config.late_input_sampling)
+				Graphics::WaitForFrame();
 
-			if (PostUpdate) PostUpdate();
+			Input::Update();
+			Replay::Update();
+			Spatial::Update();
+			Text::Update();
+
+			idle = config.on_demand_rendering && !redraw_requested;
+			if (!idle)
+			{
+				redraw_requested = false;
+				Graphics::Update();
+			}
+
+			if (PostUpdate)
+			{
+				Trace::Scope scope("PostUpdate");
+				PostUpdate();
+			}
+
+			Stats::EndFrame();
+			Trace::EndFrame();
 		}
 		catch (const std::exception & e)
 		{
@@ -70,7 +175,11 @@ namespace Engine
 			exit(EXIT_FAILURE);
 		}
 
-		return !glfwWindowShouldClose(Graphics::GetWindow());
+		++frame_count;
+		if (quit_requested || (config.max_frames > 0 && frame_count >= config.max_frames))
+			return false;
+
+		return config.headless || !glfwWindowShouldClose(Graphics::GetWindow());
 	}
 
 	void Shutdown()
@@ -79,8 +188,15 @@ namespace Engine
 		{
 			if (PreShutdown) PreShutdown();
 
+			Replay::Shutdown();
+			Stats::Shutdown();
+			Trace::Shutdown();
 			Input::Shutdown();
 			Graphics::Shutdown();
+			Memory::Shutdown();
+#ifdef _WIN32
+			timeEndPeriod(1);
+#endif
 
 			if (PostShutdown) PostShutdown();
 		}
@@ -95,11 +211,20 @@ namespace Engine
 			PAUSE;
 	}
 
-	float GetTimeElapsed()
+	void Quit()
+	{
+		quit_requested = true;
+	}
+
+	void RequestRedraw()
 	{
-		static auto start_time = std::chrono::high_resolution_clock::now();
-		auto current_time = std::chrono::high_resolution_clock::now();
-		return std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
+		redraw_requested = true;
+	}
+
+	// Sum of every delta time so far, so it follows simulated rather than wall clock time.
+	double GetTimeElapsed()
+	{
+		return time_elapsed;
 	}
 
 	void WriteError(std::string message)
@@ -111,4 +236,14 @@ namespace Engine
 	{
 		return delta_time;
 	}
+
+	uint64_t GetFrameCount()
+	{
+		return frame_count;
+	}
+
+	uint64_t GetSeed()
+	{
+		return seed;
+	}
 }
\ No newline at end of file
@@ -16,6 +16,14 @@ namespace Engine
 	const int MAX_SPRITES = 100;
 	const int MAX_TEXTURES = 100;
 	const int MAX_OBJECTS = 500;
+	const int MAX_GLYPHS = 1024;
+	const int MAX_STATIC_LAYERS = 4;
+	const int MAX_LAYER_TILES = 1024;
+	// A mesh per sub sprite of every texture, the benchmark's textures alone take 4200.
+	const int MAX_MESHES = 8192;
+	const int MAX_CLIPS = 1024;
+	const int MAX_EMITTERS = 16;
+	const int MAX_PARTICLES = 32768;
 
 	class Texture;
 	class Sprite;
@@ -23,6 +31,60 @@ namespace Engine
 
 	using Radians = float;
 
+	enum class PresentMode
+	{
+		// Waits for vertical blank, the only mode every surface supports.
+		Fifo,
+		// Waits for vertical blank but replaces a queued image instead of blocking, so no tearing and less latency.
+		Mailbox,
+		// Presents straight away and may tear.
+		Immediate
+	};
+
+	struct Config
+	{
+		// No window or Vulkan, input only comes from an injected source.
+		bool headless{ false };
+		// Seconds per update, or 0 to use the measured frame time.
+		float fixed_timestep{ 0 };
+		// With a fixed timestep, wait so updates keep pace with the wall clock instead of running flat out.
+		bool realtime{ true };
+		// Seed for gameplay randomness, 0 picks one from the clock.
+		uint64_t seed{ 0 };
+		// Stop after this many updates, 0 runs until the window closes or Quit is called.
+		uint64_t max_frames{ 0 };
+		// A frame taking longer than this multiple of the median frame time writes a trace, 0 turns detection off.
+		float hitch_ratio{ 3 };
+		// Frames shorter than this many seconds never count as hitches.
+		float hitch_min_time{ 1.f / 30.f };
+		// Falls back to Fifo when the surface doesn't support it.
+		PresentMode present_mode{ PresentMode::Mailbox };
+		// Frames the CPU can record ahead of the GPU, from 1 to Graphics::MAX_FRAMES_IN_FLIGHT.
+		// Fewer lowers latency but the CPU and GPU overlap less. Read at Initialize.
+		int frames_in_flight{ 2 };
+		// Caps the frame rate when the timestep isn't fixed, 0 for no cap.
+		float max_frame_rate{ 0 };
+		// Wait for the GPU to free a frame before polling input instead of after, so the frame starts from fresher input.
+		bool late_input_sampling{ false };
+		// Only draw when something visible changed, otherwise skip the frame and wait for input. For menus and idle screens.
+		bool on_demand_rendering{ false };
+		// Longest an idle frame waits for input, so timers in game code still get updated.
+		float idle_timeout{ .5f };
+		// Draws the world into a target this size and scales it up by a whole number to fit the window,
+		// for crisp pixel art at a fraction of the fill cost. The overlay stays at window resolution. 0 is off.
+		uint32_t render_width{ 0 };
+		uint32_t render_height{ 0 };
+		// Draws objects lower on screen over those above them, as top-down games need. Otherwise later objects go on top.
+		bool y_sort{ false };
+		// Ranks y sorted objects with compute shaders, on devices that can run them. Otherwise they're sorted on the CPU.
+		// Read at Initialize.
+		bool gpu_sort{ true };
+		// Threads recording draw commands each frame, 0 for one per core. Read at Initialize.
+		int record_threads{ 0 };
+	};
+
+	extern Config config;
+
 	extern void(*PreInitialization)();
 	extern void(*PostInitialization)();
 	extern void(*PreUpdate)();
@@ -34,8 +96,16 @@ namespace Engine
 	bool Update();
 	void Shutdown();
 
+	void Quit();
+
+	// Something visible changed, so draw the next frame even with on demand rendering.
+	// Transforms, sprites, objects and text call this themselves.
+	void RequestRedraw();
+
 	float GetStartTime();
-	float GetTimeElapsed();
+	double GetTimeElapsed();
 	float GetDeltaTime();
+	uint64_t GetFrameCount();
+	uint64_t GetSeed();
 	void WriteError(std::string message);
 }
@@ -0,0 +1,293 @@
+#include "FlowField.h"
+#include "TileMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Engine
+{
+	const uint32_t UNREACHED = std::numeric_limits<uint32_t>::max();
+	const uint8_t NO_DIRECTION = 8;
+	const float DIAGONAL = 0.70710678f;
+
+	const std::array<glm::ivec2, 8> direction_offsets
+	{
+		glm::ivec2{ 1, 0 }, glm::ivec2{ 1, 1 }, glm::ivec2{ 0, 1 }, glm::ivec2{ -1, 1 },
+		glm::ivec2{ -1, 0 }, glm::ivec2{ -1, -1 }, glm::ivec2{ 0, -1 }, glm::ivec2{ 1, -1 }
+	};
+
+	const std::array<glm::vec2, 9> direction_vectors
+	{
+		glm::vec2{ 1, 0 }, glm::vec2{ DIAGONAL, DIAGONAL }, glm::vec2{ 0, 1 }, glm::vec2{ -DIAGONAL, DIAGONAL },
+		glm::vec2{ -1, 0 }, glm::vec2{ -DIAGONAL, -DIAGONAL }, glm::vec2{ 0, -1 }, glm::vec2{ DIAGONAL, -DIAGONAL },
+		glm::vec2{ 0, 0 }
+	};
+
+	FlowField::~FlowField()
+	{
+		Shutdown();
+	}
+
+	void FlowField::Initialize(int new_width, int new_height, const std::vector<uint8_t> & new_blocked,
+		glm::vec2 new_origin, float cell_size, bool new_threaded)
+	{
+		Shutdown();
+
+		width = new_width;
+		height = new_height;
+		origin = new_origin;
+		inverse_cell_size = 1.f / cell_size;
+		threaded = new_threaded;
+		ready = false;
+		requested_cell = -1;
+		pending_cell = -1;
+		finished = false;
+		phase = Phase::Idle;
+
+		size_t num_cells = size_t(width) * size_t(height);
+		if (new_blocked.size() != num_cells)
+			throw std::runtime_error(std::format("Flow field collision grid has {} cells, expected {}.", new_blocked.size(), num_cells));
+
+		blocked = new_blocked;
+		front_directions.assign(num_cells, NO_DIRECTION);
+		back_directions.assign(num_cells, NO_DIRECTION);
+		costs.assign(num_cells, UNREACHED);
+		queue.assign(num_cells, 0);
+
+		if (threaded)
+		{
+			running = true;
+			worker = std::thread(&FlowField::WorkerLoop, this);
+		}
+	}
+
+	void FlowField::Initialize(const TileMap & map, const std::vector<std::string> & blocking_tilesets, bool new_threaded)
+	{
+		// The field's rows run up the world like its cells, the map's run down it.
+		int map_width = map.GetWidth();
+		int map_height = map.GetHeight();
+		std::vector<uint8_t> map_blocked = map.BuildCollision(blocking_tilesets);
+		std::vector<uint8_t> field_blocked(map_blocked.size());
+		for (int y = 0; y < map_height; ++y)
+			std::copy_n(map_blocked.begin() + size_t(map_height - 1 - y) * map_width, map_width, field_blocked.begin() + size_t(y) * map_width);
+
+		Initialize(map_width, map_height, field_blocked, map.origin, map.tile_size, new_threaded);
+	}
+
+	void FlowField::Shutdown()
+	{
+		if (!worker.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+
+	void FlowField::SetTarget(glm::vec2 world_position)
+	{
+		int cell = CellIndex(world_position);
+		if (cell < 0 || blocked[cell] || cell == requested_cell)
+			return;
+
+		requested_cell = cell;
+
+		if (threaded)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending_cell = cell;
+			}
+			wake.notify_one();
+		}
+		else
+			pending_cell = cell;
+	}
+
+	void FlowField::Update()
+	{
+		if (threaded)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (finished)
+			{
+				std::swap(front_directions, back_directions);
+				finished = false;
+				ready = true;
+
+				if (pending_cell >= 0)
+					wake.notify_one();
+			}
+			return;
+		}
+
+		if (phase == Phase::Idle && pending_cell >= 0)
+		{
+			StartJob(pending_cell);
+			pending_cell = -1;
+		}
+
+		if (phase != Phase::Idle && Advance(cells_per_slice))
+		{
+			std::swap(front_directions, back_directions);
+			phase = Phase::Idle;
+			ready = true;
+		}
+	}
+
+	glm::vec2 FlowField::Sample(glm::vec2 world_position) const
+	{
+		int cell = CellIndex(world_position);
+		if (cell < 0 || !ready)
+			return direction_vectors[NO_DIRECTION];
+
+		return direction_vectors[front_directions[cell]];
+	}
+
+	bool FlowField::IsReady() const
+	{
+		return ready;
+	}
+
+	// Always a full rebuild. The grid is bipartite, so moving the target one cell changes the parity, and so the
+	// cost, of every reachable cell; repairing the previous field would visit all of them with more work per cell.
+	void FlowField::StartJob(int target_cell)
+	{
+		std::fill(costs.begin(), costs.end(), UNREACHED);
+		costs[target_cell] = 0;
+		queue[0] = target_cell;
+		queue_head = 0;
+		queue_tail = 1;
+		direction_cursor = 0;
+		phase = Phase::Integrate;
+	}
+
+	// Runs up to budget cells of the current job, returning true once the back buffer is complete.
+	bool FlowField::Advance(int budget)
+	{
+		int num_cells = width * height;
+
+		while (budget-- > 0)
+		{
+			if (phase == Phase::Integrate)
+			{
+				if (queue_head == queue_tail)
+				{
+					phase = Phase::Directions;
+					continue;
+				}
+
+				int cell = queue[queue_head++];
+				int x = cell % width;
+				int y = cell / width;
+				uint32_t cost = costs[cell] + 1;
+
+				const std::array<int, 4> neighbours{
+					x + 1 < width ? cell + 1 : -1,
+					x > 0 ? cell - 1 : -1,
+					y + 1 < height ? cell + width : -1,
+					y > 0 ? cell - width : -1
+				};
+
+				for (int neighbour : neighbours)
+					if (neighbour >= 0 && !blocked[neighbour] && costs[neighbour] == UNREACHED)
+					{
+						costs[neighbour] = cost;
+						queue[queue_tail++] = neighbour;
+					}
+			}
+			else if (phase == Phase::Directions)
+			{
+				if (direction_cursor == num_cells)
+				{
+					phase = Phase::Finished;
+					break;
+				}
+
+				back_directions[direction_cursor] = PickDirection(direction_cursor);
+				++direction_cursor;
+			}
+			else
+				break;
+		}
+
+		return phase == Phase::Finished;
+	}
+
+	uint8_t FlowField::PickDirection(int cell) const
+	{
+		if (costs[cell] == UNREACHED || costs[cell] == 0)
+			return NO_DIRECTION;
+
+		int x = cell % width;
+		int y = cell / width;
+
+		auto open = [&](int nx, int ny)
+		{
+			return nx >= 0 && ny >= 0 && nx < width && ny < height && !blocked[size_t(ny) * width + nx];
+		};
+
+		uint8_t best = NO_DIRECTION;
+		uint32_t best_cost = costs[cell];
+		for (uint8_t d = 0; d < direction_offsets.size(); ++d)
+		{
+			int nx = x + direction_offsets[d].x;
+			int ny = y + direction_offsets[d].y;
+			if (!open(nx, ny))
+				continue;
+
+			// Don't cut corners around blocked cells.
+			if (direction_offsets[d].x != 0 && direction_offsets[d].y != 0 &&
+				(!open(nx, y) || !open(x, ny)))
+				continue;
+
+			uint32_t cost = costs[size_t(ny) * width + nx];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best = d;
+			}
+		}
+
+		return best;
+	}
+
+	void FlowField::WorkerLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			// Wait for a new target, and for the previous result to have been swapped in.
+			wake.wait(lock, [this] { return !running || (!finished && pending_cell >= 0); });
+			if (!running)
+				return;
+
+			int target_cell = pending_cell;
+			pending_cell = -1;
+			lock.unlock();
+
+			StartJob(target_cell);
+			while (running && !Advance(cells_per_slice))
+				std::this_thread::yield();
+
+			lock.lock();
+			finished = running;
+		}
+	}
+
+	int FlowField::CellIndex(glm::vec2 world_position) const
+	{
+		glm::vec2 local = (world_position - origin) * inverse_cell_size;
+		int x = int(std::floor(local.x));
+		int y = int(std::floor(local.y));
+
+		if (x < 0 || y < 0 || x >= width || y >= height)
+			return -1;
+
+		return y * width + x;
+	}
+}
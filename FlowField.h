@@ -0,0 +1,76 @@
+#pragma once
+#include "Core.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace Engine
+{
+	class TileMap;
+
+	// Integration field toward one target over a grid of open and blocked cells.
+	// The field is built a slice at a time, on a worker thread or one slice per Update, into a back
+	// buffer that is swapped in when complete, so Sample is always O(1) against a finished field.
+	class FlowField
+	{
+	public:
+		~FlowField();
+
+		void Initialize(int width, int height, const std::vector<uint8_t> & blocked,
+			glm::vec2 origin = { 0, 0 }, float cell_size = 1.f, bool threaded = true);
+		void Initialize(const TileMap & map, const std::vector<std::string> & blocking_tilesets, bool threaded = true);
+		void Shutdown();
+
+		// Only restarts the field when the target moves into a different cell.
+		void SetTarget(glm::vec2 world_position);
+		void Update();
+
+		glm::vec2 Sample(glm::vec2 world_position) const;
+		bool IsReady() const;
+
+		int cells_per_slice{ 4096 };
+	private:
+		enum class Phase
+		{
+			Idle,
+			Integrate,
+			Directions,
+			Finished
+		};
+
+		void StartJob(int target_cell);
+		bool Advance(int budget);
+		uint8_t PickDirection(int cell) const;
+		void WorkerLoop();
+		int CellIndex(glm::vec2 world_position) const;
+
+		int width{};
+		int height{};
+		glm::vec2 origin{ 0, 0 };
+		float inverse_cell_size{ 1 };
+		bool threaded{};
+		bool ready{};
+		int requested_cell{ -1 };
+
+		std::vector<uint8_t> blocked;
+		std::vector<uint8_t> front_directions;
+		std::vector<uint8_t> back_directions;
+
+		// Only touched by whoever is running the job.
+		std::vector<uint32_t> costs;
+		std::vector<int> queue;
+		Phase phase{ Phase::Idle };
+		int queue_head{};
+		int queue_tail{};
+		int direction_cursor{};
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::atomic<bool> running{};
+		int pending_cell{ -1 };
+		bool finished{};
+	};
+}
@@ -4,25 +4,33 @@
 #include "Transform.h"
 #include "Input.h"
 #include "Random.h"
+#include "Swarm.h"
 
 Engine::Object * player;
 std::vector<Engine::Object *> enemies;
 Engine::RNG rng;
+Engine::Swarm swarm;
 
 void GameInitialization()
 {
+	rng.Seed(Engine::GetSeed());
+
 	player = Engine::Object::NewObject();
 	player->sprite->SetSubsprite(2);
 
 	Engine::Sprite * enemy_sprite = Engine::Sprite::NewSprite();
 
+	std::array<float, 200> spawn_positions;
+	rng.FillFloats(spawn_positions, -4.f, 4.f);
+
 	for (int i = 0; i < 100; ++i)
 	{
 		auto enemy = Engine::Object::NewObject(enemy_sprite);
 		enemies.emplace_back(enemy);
-		enemy->transform->SetPosition(glm::vec2(rng(-4.f, 4.f), rng(-4.f, 4.f)));
+		enemy->transform->SetPosition(glm::vec2(spawn_positions[i * 2], spawn_positions[i * 2 + 1]));
 		enemy->transform->SetSize(0.75f);
 		enemy->sprite->SetSubsprite(112);
+		swarm.Add(enemy->transform->GetPosition(), enemy->transform);
 	}
 }
 
@@ -48,7 +56,8 @@ void GameUpdate()
 
 	player->transform->Move(move_vector * move_speed * Engine::GetDeltaTime());
 
-
+	swarm.SetTarget(player->transform->GetPosition());
+	swarm.Update(Engine::GetDeltaTime());
 }
 
 void GameShutdown()
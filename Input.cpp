@@ -1,84 +1,213 @@
 #include "Input.h"
 #include "Renderer.h"
+#include "Trace.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
-#include <map>
-
 namespace Engine
 {
 	namespace Input
 	{
-		std::map<Key, int> key_map
+		const int KEY_COUNT = int(Key::Count);
+		const uint32_t EVENT_BUFFER_SIZE = 256;
+
+		// GLFW key code to bound Key, or -1.
+		std::array<int, GLFW_KEY_LAST + 1> key_bindings;
+
+		// The Key each physical key was bound to when pressed, so rebinding while held still releases it.
+		std::array<int, GLFW_KEY_LAST + 1> held_bindings;
+
+		std::array<bool, KEY_COUNT> key_pressed{};
+		std::array<bool, KEY_COUNT> key_down{};
+		std::array<bool, KEY_COUNT> key_released{};
+		std::array<int, KEY_COUNT> keys_held{};
+
+		// Filled by the key callback during glfwPollEvents, drained by Update.
+		std::array<Event, EVENT_BUFFER_SIZE> event_buffer;
+		uint32_t event_head = 0;
+		uint32_t event_tail = 0;
+		int events_dropped = 0;
+
+		std::vector<Event> frame_events;
+		double sample_time = 0;
+
+		void(*source)() = nullptr;
+
+		void PushEvent(const Event & event)
 		{
-			{Key::MoveUp, GLFW_KEY_W},
-			{Key::MoveDown, GLFW_KEY_S},
-			{Key::MoveLeft, GLFW_KEY_A},
-			{Key::MoveRight, GLFW_KEY_D},
-		};
+			if (event_head - event_tail == EVENT_BUFFER_SIZE)
+			{
+				++events_dropped;
+				return;
+			}
 
-		std::map<Key, bool> key_pressed;
-		std::map<Key, bool> key_down;
-		std::map<Key, bool> key_released;
+			event_buffer[event_head++ % EVENT_BUFFER_SIZE] = event;
+		}
 
-		void Initialize()
+		void KeyCallback(GLFWwindow *, int glfw_key, int, int action, int)
 		{
-			for (auto k : key_map)
+			if (glfw_key < 0 || glfw_key > GLFW_KEY_LAST || action == GLFW_REPEAT)
+				return;
+
+			// A replay supplies every event itself, real keys would make it diverge.
+			if (source)
+				return;
+
+			int key;
+			if (action == GLFW_PRESS)
 			{
-				key_pressed[k.first] = false;
-				key_down[k.first] = false;
-				key_released[k.first] = false;
+				key = key_bindings[glfw_key];
+				held_bindings[glfw_key] = key;
 			}
+			else
+			{
+				key = held_bindings[glfw_key];
+				held_bindings[glfw_key] = -1;
+			}
+
+			if (key >= 0)
+				PushEvent({ glfwGetTime(), Key(key), action == GLFW_PRESS });
 		}
 
-		void Update()
+		// Pressed and released are both kept for presses shorter than a frame, so taps are never lost.
+		void ApplyEvent(const Event & event)
 		{
-			glfwPollEvents();
+			int key = int(event.key);
 
-			for (auto k : key_map)
+			if (event.pressed)
 			{
-				auto state = glfwGetKey(Graphics::GetWindow(), k.second);
-				if (state == GLFW_PRESS)
+				if (keys_held[key]++ == 0)
 				{
-					// If key wasn't down last frame, it was just pressed.
-					if (key_down[k.first] == false)
-						key_pressed[k.first] = true;
-					else
-						key_pressed[k.first] = false;
-
-					key_down[k.first] = true;
-					key_released[k.first] = false;
-				}
-				else
-				{
-					// If key was down last frame, it was just released.
-					if (key_down[k.first] == true)
-						key_released[k.first] = true;
-					else
-						key_released[k.first] = false;
-
-					key_down[k.first] = false;
-					key_pressed[k.first] = false;
+					key_pressed[key] = true;
+					key_down[key] = true;
 				}
 			}
+			else if (keys_held[key] > 0 && --keys_held[key] == 0)
+			{
+				key_released[key] = true;
+				key_down[key] = false;
+			}
+		}
+
+		void Initialize()
+		{
+			key_bindings.fill(-1);
+			held_bindings.fill(-1);
+			frame_events.reserve(EVENT_BUFFER_SIZE);
+
+			Bind(Key::MoveUp, GLFW_KEY_W);
+			Bind(Key::MoveDown, GLFW_KEY_S);
+			Bind(Key::MoveLeft, GLFW_KEY_A);
+			Bind(Key::MoveRight, GLFW_KEY_D);
+			Bind(Key::ToggleStats, GLFW_KEY_F3);
+
+			if (!config.headless)
+				glfwSetKeyCallback(Graphics::GetWindow(), KeyCallback);
+		}
+
+		void Update()
+		{
+			Trace::Scope scope("Input::Update");
+
+			// Only keys with events last frame can have edge flags to clear.
+			for (const auto & event : frame_events)
+			{
+				key_pressed[int(event.key)] = false;
+				key_released[int(event.key)] = false;
+			}
+			frame_events.clear();
+
+			if (source)
+				source();
+
+			if (!config.headless)
+			{
+				sample_time = glfwGetTime();
+				glfwPollEvents();
+			}
+
+			while (event_tail != event_head)
+			{
+				const Event & event = event_buffer[event_tail++ % EVENT_BUFFER_SIZE];
+				ApplyEvent(event);
+				frame_events.push_back(event);
+			}
+
+			if (events_dropped > 0)
+			{
+				WriteError(std::format("Input event buffer overflowed, {} events were dropped.", events_dropped));
+				events_dropped = 0;
+			}
 		}
 
 		void Shutdown()
 		{
+			if (!config.headless)
+				glfwSetKeyCallback(Graphics::GetWindow(), nullptr);
 		}
 
 		bool IsPressed(Key key)
 		{
-			return key_pressed[key];
+			return key_pressed[int(key)];
 		}
 		bool IsDown(Key key)
 		{
-			return key_down[key];
+			return key_down[int(key)];
 		}
 		bool IsReleased(Key key)
 		{
-			return key_released[key];
+			return key_released[int(key)];
+		}
+
+		void Bind(Key key, int glfw_key)
+		{
+			if (glfw_key < 0 || glfw_key > GLFW_KEY_LAST)
+				throw std::runtime_error(std::format("Can't bind invalid key code {}.", glfw_key));
+
+			key_bindings[glfw_key] = int(key);
+		}
+
+		void Unbind(int glfw_key)
+		{
+			if (glfw_key >= 0 && glfw_key <= GLFW_KEY_LAST)
+				key_bindings[glfw_key] = -1;
+		}
+
+		void ClearBindings(Key key)
+		{
+			for (auto & binding : key_bindings)
+				if (binding == int(key))
+					binding = -1;
+		}
+
+		void InjectEvent(Key key, bool pressed, double time)
+		{
+			PushEvent({ time, key, pressed });
+		}
+
+		void SetSource(void(*new_source)())
+		{
+			source = new_source;
+		}
+
+		void WaitForEvents(float timeout)
+		{
+			if (config.headless || source || event_tail != event_head)
+				return;
+
+			Trace::Scope scope("Input::WaitForEvents");
+			glfwWaitEventsTimeout(timeout);
+		}
+
+		double GetSampleTime()
+		{
+			return sample_time;
+		}
+
+		const std::vector<Event> & GetEvents()
+		{
+			return frame_events;
 		}
 	}
-}
\ No newline at end of file
+}
@@ -10,16 +10,45 @@ namespace Engine
 			MoveUp,
 			MoveDown,
 			MoveLeft,
-			MoveRight
+			MoveRight,
+			ToggleStats,
+			Count
+		};
+
+		struct Event
+		{
+			double time;
+			Key key;
+			bool pressed;
 		};
 
 		void Initialize();
 		void Update();
 		void Shutdown();
 
+		// Blocks until a window event arrives or the timeout passes. Returns straight away when headless,
+		// or when events could come from a source or InjectEvent, since those wouldn't wake it.
+		void WaitForEvents(float timeout);
+
 		bool IsPressed(Key key);
 		bool IsDown(Key key);
 		bool IsReleased(Key key);
+
+		// Each GLFW key drives at most one Key, a Key can have several GLFW keys bound to it.
+		void Bind(Key key, int glfw_key);
+		void Unbind(int glfw_key);
+		void ClearBindings(Key key);
+
+		// Queues an event as if it came from the keyboard, it's applied on the next Update.
+		void InjectEvent(Key key, bool pressed, double time);
+
+		// Called at the start of every Update to inject that frame's events, for bots, tests and headless runs.
+		void SetSource(void(*new_source)());
+
+		// glfwGetTime() when events were last polled, for measuring latency.
+		double GetSampleTime();
+
+		// Events applied this frame in the order they happened.
+		const std::vector<Event> & GetEvents();
 	}
 }
-
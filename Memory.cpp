@@ -0,0 +1,266 @@
+#include "Memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocation_count{ 0 };
+
+static void * AllocateCounted(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void * pointer = std::malloc(size ? size : 1))
+		return pointer;
+
+	throw std::bad_alloc();
+}
+
+static void * AllocateCountedAligned(size_t size, std::align_val_t alignment)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+	size_t align = size_t(alignment);
+	size = (size + align - 1) & ~(align - 1);
+
+#ifdef _WIN32
+	void * pointer = _aligned_malloc(size ? size : align, align);
+#else
+	void * pointer = std::aligned_alloc(align, size ? size : align);
+#endif
+	if (pointer)
+		return pointer;
+
+	throw std::bad_alloc();
+}
+
+static void FreeAligned(void * pointer)
+{
+#ifdef _WIN32
+	_aligned_free(pointer);
+#else
+	std::free(pointer);
+#endif
+}
+
+// Replaced so steady state frames can be checked for heap allocations.
+void * operator new(size_t size)
+{
+	return AllocateCounted(size);
+}
+
+void * operator new[](size_t size)
+{
+	return AllocateCounted(size);
+}
+
+void * operator new(size_t size, std::align_val_t alignment)
+{
+	return AllocateCountedAligned(size, alignment);
+}
+
+void * operator new[](size_t size, std::align_val_t alignment)
+{
+	return AllocateCountedAligned(size, alignment);
+}
+
+void operator delete(void * pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void * pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void * pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void * pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void * pointer, std::align_val_t) noexcept
+{
+	FreeAligned(pointer);
+}
+
+void operator delete[](void * pointer, std::align_val_t) noexcept
+{
+	FreeAligned(pointer);
+}
+
+void operator delete(void * pointer, size_t, std::align_val_t) noexcept
+{
+	FreeAligned(pointer);
+}
+
+void operator delete[](void * pointer, size_t, std::align_val_t) noexcept
+{
+	FreeAligned(pointer);
+}
+
+namespace Engine
+{
+	LinearArena::LinearArena(size_t capacity, std::pmr::memory_resource * upstream) :
+		upstream(upstream)
+	{
+		Reserve(capacity);
+	}
+
+	LinearArena::~LinearArena()
+	{
+		Reset();
+		if (buffer)
+			upstream->deallocate(buffer, capacity, alignof(std::max_align_t));
+	}
+
+	void LinearArena::Reset()
+	{
+		while (overflow)
+		{
+			OverflowBlock * next = overflow->next;
+			upstream->deallocate(overflow, overflow->size, overflow->alignment);
+			overflow = next;
+		}
+
+		size_t needed = used + overflow_bytes;
+		used = 0;
+		overflow_bytes = 0;
+
+		// Grow to this cycle's total so the same workload fits without touching upstream next time.
+		if (needed > capacity)
+			Reserve(needed + needed / 2);
+	}
+
+	void LinearArena::Reserve(size_t new_capacity)
+	{
+		if (new_capacity <= capacity)
+			return;
+
+		if (used > 0)
+			throw std::runtime_error("Linear arena can only grow while empty.");
+
+		if (buffer)
+			upstream->deallocate(buffer, capacity, alignof(std::max_align_t));
+
+		buffer = static_cast<std::byte *>(upstream->allocate(new_capacity, alignof(std::max_align_t)));
+		capacity = new_capacity;
+	}
+
+	size_t LinearArena::GetUsed() const
+	{
+		return used + overflow_bytes;
+	}
+
+	size_t LinearArena::GetCapacity() const
+	{
+		return capacity;
+	}
+
+	size_t LinearArena::GetPeak() const
+	{
+		return peak;
+	}
+
+	void * LinearArena::do_allocate(size_t bytes, size_t alignment)
+	{
+		uintptr_t base = reinterpret_cast<uintptr_t>(buffer);
+		uintptr_t aligned = (base + used + alignment - 1) & ~uintptr_t(alignment - 1);
+		size_t end = size_t(aligned - base) + bytes;
+
+		if (buffer && end <= capacity)
+		{
+			used = end;
+			peak = std::max(peak, used + overflow_bytes);
+			return reinterpret_cast<void *>(aligned);
+		}
+
+		size_t block_alignment = std::max(alignment, alignof(OverflowBlock));
+		size_t header = (sizeof(OverflowBlock) + block_alignment - 1) & ~(block_alignment - 1);
+		size_t block_size = header + bytes;
+
+		auto block = static_cast<OverflowBlock *>(upstream->allocate(block_size, block_alignment));
+		block->next = overflow;
+		block->size = block_size;
+		block->alignment = block_alignment;
+		overflow = block;
+
+		overflow_bytes += bytes + alignment;
+		peak = std::max(peak, used + overflow_bytes);
+		return reinterpret_cast<std::byte *>(block) + header;
+	}
+
+	void LinearArena::do_deallocate(void *, size_t, size_t)
+	{
+	}
+
+	bool LinearArena::do_is_equal(const std::pmr::memory_resource & other) const noexcept
+	{
+		return this == &other;
+	}
+
+	namespace Memory
+	{
+		LinearArena frame_arena;
+		std::atomic<uint64_t> frame_epoch{ 0 };
+
+		uint64_t frame_start_allocations = 0;
+		uint64_t frame_allocations = 0;
+
+		void Initialize()
+		{
+			frame_arena.Reserve(FRAME_ARENA_SIZE);
+			frame_start_allocations = GetAllocationCount();
+		}
+
+		void Update()
+		{
+			uint64_t count = GetAllocationCount();
+			frame_allocations = count - frame_start_allocations;
+			frame_start_allocations = count;
+
+			frame_arena.Reset();
+			frame_epoch.fetch_add(1, std::memory_order_release);
+		}
+
+		void Shutdown()
+		{
+			frame_arena.Reset();
+		}
+
+		std::pmr::memory_resource * GetFrameResource()
+		{
+			return &frame_arena;
+		}
+
+		std::pmr::memory_resource * GetThreadResource()
+		{
+			thread_local LinearArena thread_arena(THREAD_ARENA_SIZE);
+			thread_local uint64_t thread_epoch = 0;
+
+			uint64_t epoch = frame_epoch.load(std::memory_order_acquire);
+			if (thread_epoch != epoch)
+			{
+				thread_arena.Reset();
+				thread_epoch = epoch;
+			}
+
+			return &thread_arena;
+		}
+
+		uint64_t GetAllocationCount()
+		{
+			return allocation_count.load(std::memory_order_relaxed);
+		}
+
+		uint64_t GetFrameAllocationCount()
+		{
+			return frame_allocations;
+		}
+	}
+}
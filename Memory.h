@@ -0,0 +1,67 @@
+#pragma once
+#include "Core.h"
+
+#include <memory_resource>
+
+namespace Engine
+{
+	const size_t FRAME_ARENA_SIZE = 1 << 20;
+	const size_t THREAD_ARENA_SIZE = 256 << 10;
+
+	// Bump allocator that frees everything at once on Reset, deallocate does nothing.
+	// Requests that don't fit go to the upstream resource, and the arena grows to cover them at the next Reset.
+	class LinearArena : public std::pmr::memory_resource
+	{
+	public:
+		LinearArena(size_t capacity = 0, std::pmr::memory_resource * upstream = std::pmr::new_delete_resource());
+		~LinearArena();
+
+		LinearArena(const LinearArena &) = delete;
+		LinearArena & operator=(const LinearArena &) = delete;
+
+		void Reset();
+		void Reserve(size_t new_capacity);
+
+		size_t GetUsed() const;
+		size_t GetCapacity() const;
+		size_t GetPeak() const;
+	private:
+		// Placed at the start of every upstream block so they can be released without a separate list.
+		struct OverflowBlock
+		{
+			OverflowBlock * next;
+			size_t size;
+			size_t alignment;
+		};
+
+		void * do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void * pointer, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override;
+
+		std::pmr::memory_resource * upstream;
+		std::byte * buffer{};
+		size_t capacity{};
+		size_t used{};
+		size_t overflow_bytes{};
+		size_t peak{};
+		OverflowBlock * overflow{};
+	};
+
+	namespace Memory
+	{
+		void Initialize();
+		void Update();
+		void Shutdown();
+
+		// Everything allocated from here is released at the start of the next Update.
+		std::pmr::memory_resource * GetFrameResource();
+
+		// An arena per thread for job workers. It resets the first time it's fetched after each Update,
+		// so fetch it once per job and don't keep memory from it across frames.
+		std::pmr::memory_resource * GetThreadResource();
+
+		// Calls to the global operator new, in total and during the last complete frame.
+		uint64_t GetAllocationCount();
+		uint64_t GetFrameAllocationCount();
+	}
+}
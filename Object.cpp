@@ -19,9 +19,17 @@ namespace Engine
 		}
 		object->sprite = sprite;
 
+		RequestRedraw();
 		return object;
 	}
 
+	void Object::ClearObjects()
+	{
+		num_objects = 0;
+		Transform::ClearTransforms();
+		RequestRedraw();
+	}
+
 	std::array<Object, MAX_OBJECTS> & Object::GetObjects()
 	{
 		return all_objects;
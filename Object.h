@@ -7,6 +7,8 @@ namespace Engine
 	{
 	public:
 		static Object * NewObject(Sprite * sprite = nullptr);
+		// Empties the object and transform pools, every Object and Transform pointer handed out is invalidated.
+		static void ClearObjects();
 
 		static std::array<Object, MAX_OBJECTS> & GetObjects();
 		static int GetNumObjects();
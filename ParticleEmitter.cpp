@@ -0,0 +1,66 @@
+#include "ParticleEmitter.h"
+#include "Texture.h"
+
+namespace Engine
+{
+	std::array<ParticleEmitter, MAX_EMITTERS> all_emitters;
+	int num_emitters = 0;
+
+	Texture * particle_texture = nullptr;
+
+	ParticleEmitter * ParticleEmitter::NewEmitter()
+	{
+		if (num_emitters >= MAX_EMITTERS)
+			throw std::runtime_error(std::format("No more than {} particle emitters.", MAX_EMITTERS));
+
+		ParticleEmitter * emitter = &all_emitters[num_emitters++];
+		*emitter = ParticleEmitter();
+		RequestRedraw();
+		return emitter;
+	}
+
+	void ParticleEmitter::ClearEmitters()
+	{
+		num_emitters = 0;
+		RequestRedraw();
+	}
+
+	std::array<ParticleEmitter, MAX_EMITTERS> & ParticleEmitter::GetEmitters()
+	{
+		return all_emitters;
+	}
+
+	int ParticleEmitter::GetNumEmitters()
+	{
+		return num_emitters;
+	}
+
+	void ParticleEmitter::SetTexture(Texture * texture)
+	{
+		particle_texture = texture;
+		RequestRedraw();
+	}
+
+	Texture * ParticleEmitter::GetTexture()
+	{
+		return particle_texture ? particle_texture : Texture::GetTexture(0);
+	}
+
+	void ParticleEmitter::Burst(int count)
+	{
+		burst += count;
+		RequestRedraw();
+	}
+
+	int ParticleEmitter::TakeSpawnCount(float delta_time)
+	{
+		// Fractions carry over, so low rates still spawn at the right pace.
+		spawn_remainder += rate * delta_time;
+		int count = int(spawn_remainder);
+		spawn_remainder -= float(count);
+
+		count += burst;
+		burst = 0;
+		return count;
+	}
+}
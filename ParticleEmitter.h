@@ -0,0 +1,48 @@
+#pragma once
+#include "Core.h"
+
+namespace Engine
+{
+	// Spawns particles that live entirely on the GPU, where compute shaders move, age and drop them. Emitters only
+	// hand over their settings and how many to spawn each frame, so the CPU cost is per emitter, not per particle.
+	class ParticleEmitter
+	{
+	public:
+		static ParticleEmitter * NewEmitter();
+		static void ClearEmitters();
+		static std::array<ParticleEmitter, MAX_EMITTERS> & GetEmitters();
+		static int GetNumEmitters();
+
+		// Every particle is drawn from this texture, with each emitter picking its own range of sub sprites.
+		// Defaults to the first texture, like sprites.
+		static void SetTexture(Texture * texture);
+		static Texture * GetTexture();
+
+		// Spawns count particles next frame, on top of the rate.
+		void Burst(int count);
+		// The particles to spawn this frame, from the rate and any bursts since the last call.
+		int TakeSpawnCount(float delta_time);
+
+		glm::vec2 position{ 0, 0 };
+		// Particles a second, 0 for bursts only.
+		float rate{ 0 };
+		// Launch direction, spawning anywhere up to spread either side of it.
+		Radians direction{ 0 };
+		Radians spread{ 3.14159265f };
+		float min_speed{ 1 };
+		float max_speed{ 2 };
+		glm::vec2 acceleration{ 0, 0 };
+		// Fraction of the velocity lost a second.
+		float drag{ 0 };
+		float min_lifetime{ .5f };
+		float max_lifetime{ 1 };
+		// Size shrinks or grows from start to end over a particle's life.
+		float start_size{ .25f };
+		float end_size{ 0 };
+		int first_subsprite{ 0 };
+		int num_subsprites{ 1 };
+	private:
+		float spawn_remainder{};
+		int burst{};
+	};
+}
@@ -1,23 +1,205 @@
 #include "Random.h"
 
+#include <ctime>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RNG_SSE2
+#endif
+
 namespace Engine
 {
-	RNG::RNG(int seed)
+	const std::array<uint32_t, 4> JUMP{ 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+	const std::array<uint32_t, 4> LONG_JUMP{ 0xb523952e, 0x0b6f099f, 0xccf5a0ef, 0x1c580662 };
+
+	static inline uint32_t RotateLeft(uint32_t x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	static inline uint32_t Advance(uint32_t * s)
+	{
+		uint32_t result = RotateLeft(s[1] * 5, 7) * 9;
+		uint32_t t = s[1] << 9;
+
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = RotateLeft(s[3], 11);
+
+		return result;
+	}
+
+	static void ApplyJump(std::array<uint32_t, 4> & s, const std::array<uint32_t, 4> & polynomial)
+	{
+		std::array<uint32_t, 4> jumped{};
+		for (uint32_t word : polynomial)
+			for (int bit = 0; bit < 32; ++bit)
+			{
+				if (word & (1u << bit))
+					for (int i = 0; i < 4; ++i)
+						jumped[i] ^= s[i];
+
+				Advance(s.data());
+			}
+
+		s = jumped;
+	}
+
+	// Top 24 bits to a float in [0, 1).
+	static inline float ToUnitFloat(uint32_t x)
+	{
+		return float(x >> 8) * (1.f / 16777216.f);
+	}
+
+	RNG::RNG(uint64_t seed)
+	{
+		Seed(seed);
+	}
+
+	void RNG::Seed(uint64_t seed)
+	{
+		if (seed == 0)
+			seed = uint64_t(std::time(0));
+
+		// SplitMix64 spreads the seed so similar seeds still give unrelated states.
+		for (int i = 0; i < 4; i += 2)
+		{
+			seed += 0x9e3779b97f4a7c15ull;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			z ^= z >> 31;
+
+			state[i] = uint32_t(z);
+			state[i + 1] = uint32_t(z >> 32);
+		}
+
+		SeedLanes();
+	}
+
+	float RNG::operator()(float min, float max)
 	{
-        if (seed == 0)
-            seed = int(std::time(0));
+		return min + ToUnitFloat(Next()) * (max - min);
+	}
+
+	// Lemire's multiply and reject, unbiased unlike taking the modulus.
+	int RNG::operator()(int min, int max)
+	{
+		if (max <= min)
+			return min;
+
+		uint32_t range = uint32_t(int64_t(max) - int64_t(min));
+		uint64_t product = uint64_t(Next()) * range;
+		uint32_t low = uint32_t(product);
+
+		if (low < range)
+		{
+			uint32_t threshold = (0u - range) % range;
+			while (low < threshold)
+			{
+				product = uint64_t(Next()) * range;
+				low = uint32_t(product);
+			}
+		}
+
+		return int(int64_t(min) + int64_t(product >> 32));
+	}
+
+	uint32_t RNG::Next()
+	{
+		return Advance(state.data());
+	}
+
+	void RNG::FillFloats(std::span<float> values, float min, float max)
+	{
+		size_t count = values.size();
+		size_t i = 0;
+		float scale = (max - min) * (1.f / 16777216.f);
+
+#ifdef RNG_SSE2
+		__m128i s0 = _mm_load_si128(reinterpret_cast<const __m128i *>(&lane_state[0]));
+		__m128i s1 = _mm_load_si128(reinterpret_cast<const __m128i *>(&lane_state[4]));
+		__m128i s2 = _mm_load_si128(reinterpret_cast<const __m128i *>(&lane_state[8]));
+		__m128i s3 = _mm_load_si128(reinterpret_cast<const __m128i *>(&lane_state[12]));
+
+		const __m128 min4 = _mm_set1_ps(min);
+		const __m128 scale4 = _mm_set1_ps(scale);
 
-        rng.seed(seed);
+		// Runs one extra round for a partial tail and drops the unused lanes, as the scalar path does.
+		for (; i < count; i += 4)
+		{
+			// SSE2 has no 32 bit multiply, so x * 5 and x * 9 are shifts and adds.
+			__m128i times5 = _mm_add_epi32(_mm_slli_epi32(s1, 2), s1);
+			__m128i rotated = _mm_or_si128(_mm_slli_epi32(times5, 7), _mm_srli_epi32(times5, 25));
+			__m128i result = _mm_add_epi32(_mm_slli_epi32(rotated, 3), rotated);
 
-        int_distribution = std::uniform_int_distribution<int>(0, RNG_MAX_INT);
-        float_distribution = std::uniform_real_distribution<float>(0.f, 1.f);
+			__m128i t = _mm_slli_epi32(s1, 9);
+			s2 = _mm_xor_si128(s2, s0);
+			s3 = _mm_xor_si128(s3, s1);
+			s1 = _mm_xor_si128(s1, s2);
+			s0 = _mm_xor_si128(s0, s3);
+			s2 = _mm_xor_si128(s2, t);
+			s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+			__m128 floats = _mm_add_ps(min4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), scale4));
+
+			if (i + 4 <= count)
+				_mm_storeu_ps(&values[i], floats);
+			else
+			{
+				alignas(16) std::array<float, 4> tail;
+				_mm_store_ps(tail.data(), floats);
+				for (size_t lane = 0; i + lane < count; ++lane)
+					values[i + lane] = tail[lane];
+			}
+		}
+
+		_mm_store_si128(reinterpret_cast<__m128i *>(&lane_state[0]), s0);
+		_mm_store_si128(reinterpret_cast<__m128i *>(&lane_state[4]), s1);
+		_mm_store_si128(reinterpret_cast<__m128i *>(&lane_state[8]), s2);
+		_mm_store_si128(reinterpret_cast<__m128i *>(&lane_state[12]), s3);
+#else
+		for (; i < count; i += 4)
+			for (size_t lane = 0; lane < 4; ++lane)
+			{
+				uint32_t s[4]{ lane_state[lane], lane_state[4 + lane], lane_state[8 + lane], lane_state[12 + lane] };
+				uint32_t result = Advance(s);
+				for (int component = 0; component < 4; ++component)
+					lane_state[component * 4 + lane] = s[component];
+
+				if (i + lane < count)
+					values[i + lane] = min + float(result >> 8) * scale;
+			}
+#endif
+	}
+
+	void RNG::Jump()
+	{
+		ApplyJump(state, JUMP);
+		SeedLanes();
+	}
+
+	RNG RNG::Stream(int index) const
+	{
+		RNG stream = *this;
+		for (int i = 0; i <= index; ++i)
+			stream.Jump();
+
+		return stream;
+	}
+
+	// Each lane starts a long jump (2^96 draws) further on, well clear of anything Jump reaches.
+	void RNG::SeedLanes()
+	{
+		std::array<uint32_t, 4> lane = state;
+		for (int i = 0; i < 4; ++i)
+		{
+			ApplyJump(lane, LONG_JUMP);
+			for (int component = 0; component < 4; ++component)
+				lane_state[component * 4 + i] = lane[component];
+		}
 	}
-    float RNG::operator()(float min, float max)
-    {
-        return min + float_distribution(rng) * (max - min);
-    }
-    int RNG::operator()(int min, int max)
-    {
-        return min + int_distribution(rng) % (max - min);
-    }
 }
@@ -1,22 +1,35 @@
 #pragma once
 #include "Core.h"
-#include <random>
-#include <limits>
+#include <span>
 
 namespace Engine
 {
+	// xoshiro128** generator. Ranges are half open, [min, max).
 	class RNG
 	{
 	public:
-		const int RNG_MAX_INT = std::numeric_limits<int>::max();
+		// A seed of 0 seeds from the current time.
+		RNG(uint64_t seed = 0);
+		void Seed(uint64_t seed);
 
-		RNG(int seed = 0);
 		float operator()(float min, float max);
 		int operator()(int min, int max);
+		uint32_t Next();
+
+		// Four interleaved streams so batches can be generated four lanes at a time.
+		void FillFloats(std::span<float> values, float min, float max);
+
+		// Advances 2^64 draws, far enough that the skipped over stream never overlaps the new one.
+		void Jump();
+
+		// An independent generator for a thread or system, the same for the same seed and index.
+		RNG Stream(int index) const;
 	private:
-		std::random_device dev;
-		std::mt19937 rng;
-		std::uniform_int_distribution<int> int_distribution;
-		std::uniform_real_distribution<float> float_distribution;
+		void SeedLanes();
+
+		std::array<uint32_t, 4> state;
+
+		// Lane state stored component major, four lanes of s[0], then four of s[1], and so on.
+		alignas(16) std::array<uint32_t, 16> lane_state;
 	};
 }
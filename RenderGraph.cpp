@@ -0,0 +1,378 @@
+#include "RenderGraph.h"
+#include "Renderer.h"
+
+#include <algorithm>
+
+namespace Engine
+{
+	const VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	RenderGraph::Access RenderGraph::GetAccess(Usage usage)
+	{
+		if (usage == Usage::ColorAttachment)
+			return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		else if (usage == Usage::DepthAttachment)
+			return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		else if (usage == Usage::FragmentSampled)
+			return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		else if (usage == Usage::VertexStorageRead)
+			return { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		else if (usage == Usage::IndirectRead)
+			return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		else if (usage == Usage::ComputeRead)
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		else if (usage == Usage::ComputeWrite)
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		else if (usage == Usage::TransferRead)
+			return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+		else if (usage == Usage::TransferWrite)
+			return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+		else
+			// Presentation waits on a semaphore, so the barrier only has to change the layout.
+			return { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+	}
+
+	RenderGraph::Resource RenderGraph::AddResource()
+	{
+		auto unused = std::find_if(resources.begin(), resources.end(), [](const ResourceInfo & info) { return !info.in_use; });
+		if (unused == resources.end())
+			unused = resources.emplace(resources.end());
+
+		*unused = {};
+		unused->in_use = true;
+		return Resource(unused - resources.begin());
+	}
+
+	RenderGraph::Resource RenderGraph::ImportImage(VkImage image, VkImageAspectFlags aspect)
+	{
+		Resource resource = AddResource();
+		resources[resource].image = image;
+		resources[resource].aspect = aspect;
+		return resource;
+	}
+
+	RenderGraph::Resource RenderGraph::ImportBuffer(VkBuffer buffer)
+	{
+		Resource resource = AddResource();
+		resources[resource].buffer = buffer;
+		return resource;
+	}
+
+	void RenderGraph::Remove(Resource resource)
+	{
+		resources[resource] = {};
+	}
+
+	void RenderGraph::Acquired(Resource resource, VkPipelineStageFlags wait_stages)
+	{
+		resources[resource].state = { wait_stages, 0, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+	}
+
+	RenderGraph::Resource RenderGraph::CreateTransientImage(const ImageDescription & description)
+	{
+		VkImageCreateInfo image_info{};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.extent = { description.width, description.height, 1 };
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.format = description.format;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = description.usage;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkImage image;
+		if (vkCreateImage(Graphics::GetDevice(), &image_info, nullptr, &image) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create transient image.");
+
+		Resource resource = ImportImage(image, description.aspect);
+		ResourceInfo & info = resources[resource];
+		info.transient = true;
+		info.description = description;
+		vkGetImageMemoryRequirements(Graphics::GetDevice(), image, &info.memory_requirements);
+		return resource;
+	}
+
+	void RenderGraph::AllocateTransients()
+	{
+		VkDevice device = Graphics::GetDevice();
+
+		std::vector<Resource> transients;
+		for (Resource resource = 0; resource < Resource(resources.size()); ++resource)
+			if (resources[resource].in_use && resources[resource].transient)
+			{
+				resources[resource].first_pass = -1;
+				resources[resource].last_pass = -1;
+				transients.push_back(resource);
+			}
+
+		for (int pass = 0; pass < num_passes; ++pass)
+			for (const auto & use : passes[pass].uses)
+			{
+				ResourceInfo & info = resources[use.resource];
+				if (!info.transient)
+					continue;
+
+				if (info.first_pass < 0)
+					info.first_pass = pass;
+				info.last_pass = pass;
+			}
+
+		// Placed in the order they start, each image goes in the memory that has to grow least among those whose
+		// images have all finished by then. An image no pass uses can go anywhere.
+		std::stable_sort(transients.begin(), transients.end(),
+			[this](Resource a, Resource b) { return resources[a].first_pass < resources[b].first_pass; });
+
+		transient_memory.clear();
+		std::vector<int> memory_last_pass;
+		for (Resource resource : transients)
+		{
+			ResourceInfo & info = resources[resource];
+			const VkMemoryRequirements & requirements = info.memory_requirements;
+
+			int best = -1;
+			VkDeviceSize best_growth = 0;
+			for (int memory = 0; memory < int(transient_memory.size()); ++memory)
+			{
+				const TransientMemory & candidate = transient_memory[memory];
+				if ((candidate.memory_type_bits & requirements.memoryTypeBits) == 0)
+					continue;
+				if (info.first_pass >= 0 && memory_last_pass[memory] >= info.first_pass)
+					continue;
+
+				VkDeviceSize growth = requirements.size > candidate.size ? requirements.size - candidate.size : 0;
+				if (best < 0 || growth < best_growth)
+				{
+					best = memory;
+					best_growth = growth;
+				}
+			}
+
+			if (best < 0)
+			{
+				best = int(transient_memory.size());
+				transient_memory.push_back({ VK_NULL_HANDLE, 0, requirements.memoryTypeBits });
+				memory_last_pass.push_back(-1);
+			}
+
+			// Every image is bound at the start of its memory, which satisfies any alignment.
+			TransientMemory & memory = transient_memory[best];
+			memory.size = std::max(memory.size, requirements.size);
+			memory.memory_type_bits &= requirements.memoryTypeBits;
+			memory_last_pass[best] = std::max(memory_last_pass[best], info.last_pass);
+			info.memory = best;
+		}
+
+		for (auto & memory : transient_memory)
+		{
+			VkMemoryAllocateInfo allocate_info{};
+			allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocate_info.allocationSize = memory.size;
+			allocate_info.memoryTypeIndex = Graphics::FindMemoryType(memory.memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			if (vkAllocateMemory(device, &allocate_info, nullptr, &memory.memory) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate transient image memory.");
+		}
+
+		for (Resource resource : transients)
+		{
+			ResourceInfo & info = resources[resource];
+			vkBindImageMemory(device, info.image, transient_memory[info.memory].memory, 0);
+			info.view = Graphics::CreateImageView(info.image, info.description.format, info.aspect);
+		}
+
+		num_passes = 0;
+	}
+
+	void RenderGraph::DestroyTransients()
+	{
+		VkDevice device = Graphics::GetDevice();
+
+		for (Resource resource = 0; resource < Resource(resources.size()); ++resource)
+		{
+			ResourceInfo & info = resources[resource];
+			if (!info.in_use || !info.transient)
+				continue;
+
+			if (info.view != VK_NULL_HANDLE)
+				vkDestroyImageView(device, info.view, nullptr);
+			vkDestroyImage(device, info.image, nullptr);
+			Remove(resource);
+		}
+
+		for (const auto & memory : transient_memory)
+			vkFreeMemory(device, memory.memory, nullptr);
+		transient_memory.clear();
+	}
+
+	VkImage RenderGraph::GetImage(Resource resource) const
+	{
+		return resources[resource].image;
+	}
+
+	VkImageView RenderGraph::GetImageView(Resource resource) const
+	{
+		return resources[resource].view;
+	}
+
+	VkDeviceSize RenderGraph::GetTransientMemory() const
+	{
+		VkDeviceSize total = 0;
+		for (const auto & memory : transient_memory)
+			total += memory.size;
+		return total;
+	}
+
+	int RenderGraph::AddPass(const char * name, RecordFunction record, bool enabled)
+	{
+		if (num_passes == int(passes.size()))
+			passes.emplace_back();
+
+		Pass & pass = passes[num_passes];
+		pass.name = name;
+		pass.record = std::move(record);
+		pass.enabled = enabled;
+		pass.uses.clear();
+		return num_passes++;
+	}
+
+	void RenderGraph::Use(int pass, Resource resource, Usage usage, bool discard)
+	{
+		Access access = GetAccess(usage);
+		auto & uses = passes[pass].uses;
+
+		auto existing = std::find_if(uses.begin(), uses.end(), [resource](const PassUse & use) { return use.resource == resource; });
+		if (existing == uses.end())
+		{
+			uses.push_back({ resource, access, discard });
+			return;
+		}
+
+		if (resources[resource].image != VK_NULL_HANDLE && existing->access.layout != access.layout)
+			throw std::runtime_error(std::format("Pass {} uses an image in two layouts.", passes[pass].name));
+
+		existing->access.stages |= access.stages;
+		existing->access.access |= access.access;
+		existing->discard = existing->discard && discard;
+	}
+
+	void RenderGraph::AddBarriers(int pass_index, const PassUse & use, VkPipelineStageFlags & src_stages, VkPipelineStageFlags & dst_stages,
+		VkMemoryBarrier & memory_barrier)
+	{
+		ResourceInfo & info = resources[use.resource];
+		ResourceState & state = info.state;
+		const Access & access = use.access;
+		bool discard = use.discard;
+
+		TransientMemory * memory = nullptr;
+		if (info.transient)
+		{
+			if (pass_index < info.first_pass || pass_index > info.last_pass)
+				throw std::runtime_error(std::format("Pass {} uses a transient image outside the passes it was allocated for.", passes[pass_index].name));
+
+			// The memory may have been another image's since this one last used it, so it's that use to wait on.
+			memory = &transient_memory[info.memory];
+			if (!info.used_this_frame)
+			{
+				state = { memory->last_stages, memory->last_write_access, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+				discard = true;
+			}
+			info.used_this_frame = true;
+		}
+
+		bool image = info.image != VK_NULL_HANDLE;
+		bool transition = image && (discard || access.layout != state.layout);
+		VkAccessFlags write_access = access.access & WRITE_ACCESS;
+
+		if (write_access == 0 && !transition)
+		{
+			// A read waits on the last write, unless an earlier read at the same stages already has.
+			bool waited = (access.stages & ~state.read_stages) == 0 && (access.access & ~state.read_access) == 0;
+			if (!waited && state.write_stages != 0)
+			{
+				src_stages |= state.write_stages;
+				dst_stages |= access.stages;
+				memory_barrier.srcAccessMask |= state.write_access;
+				memory_barrier.dstAccessMask |= access.access;
+			}
+
+			state.read_stages |= access.stages;
+			state.read_access |= access.access;
+		}
+		else
+		{
+			// Writes and layout changes wait on every use since the last write too, though only writes need flushing.
+			VkPipelineStageFlags wait_stages = state.write_stages | state.read_stages;
+			if (wait_stages == 0)
+				wait_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			src_stages |= wait_stages;
+			dst_stages |= access.stages;
+
+			if (transition)
+			{
+				VkImageMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = state.write_access;
+				barrier.dstAccessMask = access.access;
+				barrier.oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+				barrier.newLayout = access.layout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = info.image;
+				barrier.subresourceRange = { info.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+				image_barriers.push_back(barrier);
+			}
+			else
+			{
+				memory_barrier.srcAccessMask |= state.write_access;
+				memory_barrier.dstAccessMask |= access.access;
+			}
+
+			state = { access.stages, write_access, 0, 0, image ? access.layout : VK_IMAGE_LAYOUT_UNDEFINED };
+		}
+
+		if (memory != nullptr)
+		{
+			memory->last_stages = state.write_stages | state.read_stages;
+			memory->last_write_access = state.write_access;
+		}
+	}
+
+	void RenderGraph::Execute(VkCommandBuffer command_buffer)
+	{
+		for (auto & info : resources)
+			info.used_this_frame = false;
+
+		for (int pass = 0; pass < num_passes; ++pass)
+		{
+			if (!passes[pass].enabled)
+				continue;
+
+			VkPipelineStageFlags src_stages = 0;
+			VkPipelineStageFlags dst_stages = 0;
+			VkMemoryBarrier memory_barrier{};
+			memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			image_barriers.clear();
+
+			for (const auto & use : passes[pass].uses)
+				AddBarriers(pass, use, src_stages, dst_stages, memory_barrier);
+
+			if (src_stages != 0)
+			{
+				bool memory = memory_barrier.srcAccessMask != 0 || memory_barrier.dstAccessMask != 0;
+				vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, memory ? 1 : 0, &memory_barrier, 0, nullptr,
+					uint32_t(image_barriers.size()), image_barriers.data());
+			}
+
+			if (passes[pass].record)
+				passes[pass].record(command_buffer);
+		}
+
+		num_passes = 0;
+	}
+}
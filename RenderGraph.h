@@ -0,0 +1,154 @@
+#pragma once
+#include "Core.h"
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <functional>
+
+namespace Engine
+{
+	// A frame's GPU work as passes that declare what they read and write. Passes run in the order they're added, and
+	// before each one a single barrier covers whatever its resources were last used for, so passes only wait on the
+	// passes they actually depend on and a read following a read waits on nothing. Transient images, ones whose contents
+	// never outlive the frame, are given memory by the graph, shared with any other transient image whose passes don't
+	// overlap with theirs.
+	class RenderGraph
+	{
+	public:
+		enum class Usage : uint8_t
+		{
+			ColorAttachment,
+			DepthAttachment,
+			FragmentSampled,
+			VertexStorageRead,
+			IndirectRead,
+			ComputeRead,
+			ComputeWrite,
+			TransferRead,
+			TransferWrite,
+			Present
+		};
+
+		struct Access
+		{
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			// Ignored for buffers.
+			VkImageLayout layout;
+		};
+
+		struct ImageDescription
+		{
+			uint32_t width;
+			uint32_t height;
+			VkFormat format;
+			VkImageUsageFlags usage;
+			VkImageAspectFlags aspect;
+		};
+
+		using Resource = int;
+		// Passes are added every frame, so captures should stay small enough for std::function to keep them without
+		// allocating, a couple of indices at most.
+		using RecordFunction = std::function<void(VkCommandBuffer)>;
+
+		static Access GetAccess(Usage usage);
+
+		// Images and buffers made elsewhere, whose state carries over from frame to frame. Removed ones must not be
+		// used by a pass again.
+		Resource ImportImage(VkImage image, VkImageAspectFlags aspect);
+		Resource ImportBuffer(VkBuffer buffer);
+		void Remove(Resource resource);
+		// The image comes from a semaphore waited on at these stages, with nothing worth keeping in it, such as a swap
+		// chain image just acquired.
+		void Acquired(Resource resource, VkPipelineStageFlags wait_stages);
+
+		// The image has no memory, and so no view, until AllocateTransients.
+		Resource CreateTransientImage(const ImageDescription & description);
+		// Works out how long each transient image lives from the passes added since the last Execute, then gives images
+		// that are never alive together the same memory. Every later frame must add the same passes in the same order,
+		// though any of them may be disabled. The passes are forgotten without being recorded.
+		void AllocateTransients();
+		// Destroys the transient images along with their views and memory, and removes them.
+		void DestroyTransients();
+		VkImage GetImage(Resource resource) const;
+		VkImageView GetImageView(Resource resource) const;
+		// Bytes allocated for transient images, after aliasing.
+		VkDeviceSize GetTransientMemory() const;
+
+		// A disabled pass records nothing and gets no barrier, but still counts towards how long transient images live.
+		int AddPass(const char * name, RecordFunction record, bool enabled = true);
+		// With discard the pass overwrites all of the resource, so what was in it can be dropped. A transient image is
+		// always discarded by the first pass of the frame to use it. Uses of one resource by one pass are combined.
+		void Use(int pass, Resource resource, Usage usage, bool discard = false);
+		// Records every enabled pass with the barriers it needs, then forgets the passes.
+		void Execute(VkCommandBuffer command_buffer);
+	private:
+		struct ResourceState
+		{
+			// The last write and the stages and accesses that have waited on it since. Later reads wait on the write,
+			// later writes on everything.
+			VkPipelineStageFlags write_stages;
+			VkAccessFlags write_access;
+			VkPipelineStageFlags read_stages;
+			VkAccessFlags read_access;
+			VkImageLayout layout;
+		};
+
+		struct ResourceInfo
+		{
+			VkImage image{};
+			VkBuffer buffer{};
+			VkImageAspectFlags aspect{};
+			ResourceState state{};
+			bool in_use{};
+
+			bool transient{};
+			ImageDescription description{};
+			VkImageView view{};
+			VkMemoryRequirements memory_requirements{};
+			int memory{ -1 };
+			// The passes it was planned to live between, and whether this frame has used it yet.
+			int first_pass{ -1 };
+			int last_pass{ -1 };
+			bool used_this_frame{};
+		};
+
+		// Memory shared by transient images, and its last use by any of them, which the next image to use it waits on.
+		struct TransientMemory
+		{
+			VkDeviceMemory memory{};
+			VkDeviceSize size{};
+			uint32_t memory_type_bits{};
+			VkPipelineStageFlags last_stages{};
+			VkAccessFlags last_write_access{};
+		};
+
+		struct PassUse
+		{
+			Resource resource;
+			Access access;
+			bool discard;
+		};
+
+		struct Pass
+		{
+			const char * name;
+			RecordFunction record;
+			bool enabled;
+			std::vector<PassUse> uses;
+		};
+
+		Resource AddResource();
+		void AddBarriers(int pass_index, const PassUse & use, VkPipelineStageFlags & src_stages, VkPipelineStageFlags & dst_stages,
+			VkMemoryBarrier & memory_barrier);
+
+		std::vector<ResourceInfo> resources;
+		std::vector<TransientMemory> transient_memory;
+		// Only the first num_passes are this frame's. The rest are kept from earlier frames, along with the capacity of
+		// their uses, for the passes added next.
+		std::vector<Pass> passes;
+		int num_passes = 0;
+		std::vector<VkImageMemoryBarrier> image_barriers;
+	};
+}
@@ -0,0 +1,269 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <barrier>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Engine
+{
+	const int LAYER_SHIFT = 56;
+	const int PIPELINE_SHIFT = 48;
+	const int TEXTURE_SHIFT = 32;
+	const uint64_t DEPTH_MASK = 0xFFFFFFFFull;
+
+	// Below this a queue sorts faster on one thread than it takes to start the others.
+	const size_t PARALLEL_SORT_MIN = 1 << 15;
+	const unsigned MAX_SORT_THREADS = 8;
+
+	// Threads kept from sort to sort, started by the first sort big enough to need them and joined at exit.
+	// One sort uses them at a time, any other sorting alongside it stays on its own thread.
+	struct SortWorkers
+	{
+		int num_threads;
+		std::vector<std::thread> threads;
+		std::barrier<> sync;
+		std::mutex in_use;
+
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		const std::function<void(int)> * task = nullptr;
+		uint64_t round = 0;
+		int busy = 0;
+		bool running = true;
+
+		SortWorkers()
+			: num_threads(int(std::clamp(std::thread::hardware_concurrency(), 1u, MAX_SORT_THREADS))), sync(num_threads)
+		{
+			for (int thread = 1; thread < num_threads; ++thread)
+				threads.emplace_back(&SortWorkers::WorkerLoop, this, thread);
+		}
+
+		~SortWorkers()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				running = false;
+			}
+			wake.notify_all();
+
+			for (auto & thread : threads)
+				thread.join();
+		}
+
+		// Runs the task on every thread, the calling one as thread 0, and returns once they've all finished.
+		void Run(const std::function<void(int)> & new_task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				task = &new_task;
+				++round;
+				busy = num_threads - 1;
+			}
+			wake.notify_all();
+
+			new_task(0);
+
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this] { return busy == 0; });
+		}
+
+		void WorkerLoop(int thread)
+		{
+			uint64_t seen = 0;
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true)
+			{
+				wake.wait(lock, [&] { return !running || round != seen; });
+				if (!running)
+					return;
+
+				seen = round;
+				lock.unlock();
+
+				(*task)(thread);
+
+				lock.lock();
+				if (--busy == 0)
+					done.notify_one();
+			}
+		}
+	};
+
+	SortWorkers & GetSortWorkers()
+	{
+		static SortWorkers workers;
+		return workers;
+	}
+
+	uint64_t RenderQueue::MakeKey(Layer layer, Pipeline pipeline, int texture, uint32_t depth)
+	{
+		return uint64_t(layer) << LAYER_SHIFT
+			| uint64_t(pipeline) << PIPELINE_SHIFT
+			| uint64_t(uint16_t(texture)) << TEXTURE_SHIFT
+			| depth;
+	}
+
+	RenderQueue::Layer RenderQueue::GetLayer(uint64_t key)
+	{
+		return Layer(uint8_t(key >> LAYER_SHIFT));
+	}
+
+	RenderQueue::Pipeline RenderQueue::GetPipeline(uint64_t key)
+	{
+		return Pipeline(uint8_t(key >> PIPELINE_SHIFT));
+	}
+
+	int RenderQueue::GetTexture(uint64_t key)
+	{
+		return int(uint16_t(key >> TEXTURE_SHIFT));
+	}
+
+	uint64_t RenderQueue::GetState(uint64_t key)
+	{
+		return key & ~DEPTH_MASK;
+	}
+
+	uint32_t RenderQueue::FloatKey(float value)
+	{
+		// Flipping every bit of a negative reverses its order, setting the sign bit puts positives after them.
+		uint32_t bits = std::bit_cast<uint32_t>(value);
+		return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+	}
+
+	void RenderQueue::Clear()
+	{
+		entries.clear();
+	}
+
+	void RenderQueue::Reserve(size_t count)
+	{
+		entries.reserve(count);
+		scratch.reserve(count);
+	}
+
+	void RenderQueue::Submit(uint64_t key, uint32_t index)
+	{
+		entries.push_back({ key, index });
+	}
+
+	void RenderQueue::Sort()
+	{
+		size_t count = entries.size();
+		if (count < 2)
+			return;
+
+		SortWorkers * workers = nullptr;
+		std::unique_lock<std::mutex> workers_lock;
+		if (count >= PARALLEL_SORT_MIN)
+		{
+			workers = &GetSortWorkers();
+			workers_lock = std::unique_lock<std::mutex>(workers->in_use, std::try_to_lock);
+			if (!workers_lock.owns_lock())
+				workers = nullptr;
+		}
+
+		int num_threads = workers ? workers->num_threads : 1;
+		auto sync = [workers] { if (workers) workers->sync.arrive_and_wait(); };
+
+		scratch.resize(count);
+		chunk_counts.resize(num_threads);
+
+		// Every thread runs the same passes in step, so they all agree on which buffer holds the keys.
+		auto sort_chunk = [&](int thread)
+		{
+			size_t begin = count * thread / num_threads;
+			size_t end = count * (thread + 1) / num_threads;
+			auto & counts = chunk_counts[thread];
+
+			// Every byte's histogram in one read of the keys.
+			counts = {};
+			for (size_t i = begin; i < end; ++i)
+				for (int byte = 0; byte < 8; ++byte)
+					++counts[byte][(entries[i].key >> (byte * 8)) & 0xFF];
+
+			sync();
+
+			// A byte every key shares wouldn't move anything. Most are, since keys only use a few layers and textures.
+			std::array<bool, 8> skip{};
+			for (int byte = 0; byte < 8; ++byte)
+			{
+				int shift = byte * 8;
+				uint32_t shared = 0;
+				for (const auto & chunk : chunk_counts)
+					shared += chunk[byte][(entries[0].key >> shift) & 0xFF];
+				skip[byte] = shared == count;
+			}
+
+			// Nobody recounts until everyone has read the first counts.
+			sync();
+
+			std::vector<Entry> * source = &entries;
+			std::vector<Entry> * destination = &scratch;
+			bool counted = true;
+			for (int byte = 0; byte < 8; ++byte)
+			{
+				if (skip[byte])
+					continue;
+
+				int shift = byte * 8;
+
+				// The last pass moved keys between slices, so each slice's counts only still hold with one thread.
+				if (!counted)
+				{
+					counts[byte] = {};
+					for (size_t i = begin; i < end; ++i)
+						++counts[byte][((*source)[i].key >> shift) & 0xFF];
+
+					sync();
+				}
+
+				// A slice's keys go after every key with a smaller byte, then after its own byte's keys in earlier slices.
+				std::array<uint32_t, 256> offsets;
+				uint32_t offset = 0;
+				for (int value = 0; value < 256; ++value)
+					for (int chunk = 0; chunk < num_threads; ++chunk)
+					{
+						if (chunk == thread)
+							offsets[value] = offset;
+						offset += chunk_counts[chunk][byte][value];
+					}
+
+				for (size_t i = begin; i < end; ++i)
+				{
+					const Entry & entry = (*source)[i];
+					(*destination)[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+				}
+
+				sync();
+
+				std::swap(source, destination);
+				counted = num_threads == 1;
+			}
+
+			return source;
+		};
+
+		std::vector<Entry> * sorted = nullptr;
+		if (num_threads == 1)
+			sorted = sort_chunk(0);
+		else
+			workers->Run([&](int thread)
+			{
+				std::vector<Entry> * result = sort_chunk(thread);
+				if (thread == 0)
+					sorted = result;
+			});
+
+		if (sorted != &entries)
+			entries.swap(scratch);
+	}
+
+	const std::vector<RenderQueue::Entry> & RenderQueue::GetEntries() const
+	{
+		return entries;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Core.h"
+
+#include <bit>
+
+namespace Engine
+{
+	// Draws collected with a 64 bit key each and radix sorted, so draws sharing a layer, pipeline and texture end up
+	// next to each other for one instanced call, front to back within those.
+	class RenderQueue
+	{
+	public:
+		enum class Layer : uint8_t
+		{
+			Background,
+			World,
+			Overlay
+		};
+
+		// Opaque sprites skip the alpha test so the depth test can reject hidden pixels before they're shaded.
+		enum class Pipeline : uint8_t
+		{
+			Opaque,
+			AlphaTested
+		};
+
+		struct Entry
+		{
+			uint64_t key;
+			// Whatever the submitter uses to find the draw again, an object index for instance.
+			uint32_t index;
+		};
+
+		// From most to least significant: layer, pipeline, texture, then depth with 0 at the front.
+		static uint64_t MakeKey(Layer layer, Pipeline pipeline, int texture, uint32_t depth);
+		static Layer GetLayer(uint64_t key);
+		static Pipeline GetPipeline(uint64_t key);
+		static int GetTexture(uint64_t key);
+		// Everything but the depth, keys with the same state can be drawn by one call.
+		static uint64_t GetState(uint64_t key);
+		// Bits that sort in the same order as the float, negatives included.
+		static uint32_t FloatKey(float value);
+
+		void Clear();
+		void Reserve(size_t count);
+		void Submit(uint64_t key, uint32_t index);
+		// Least significant byte first, skipping any byte every key shares. Stable, so equal keys keep their submit order.
+		// Large queues are split between threads, each counting and scattering its own slice of every pass.
+		void Sort();
+
+		const std::vector<Entry> & GetEntries() const;
+	private:
+		std::vector<Entry> entries;
+		std::vector<Entry> scratch;
+		// Each thread's count of every byte value, per byte of the key.
+		std::vector<std::array<std::array<uint32_t, 256>, 8>> chunk_counts;
+	};
+}
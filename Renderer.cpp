@@ -3,9 +3,18 @@
 #include "Sprite.h"
 #include "Transform.h"
 #include "Object.h"
+#include "Stats.h"
+#include "Text.h"
+#include "Trace.h"
+#include "Input.h"
+#include "StaticLayer.h"
+#include "RenderQueue.h"
+#include "ParticleEmitter.h"
+#include "RenderGraph.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
@@ -13,6 +22,13 @@
 #include <cstdlib>
 #include <cstdint>
 #include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <utility>
+#include <functional>
 
 namespace Engine
 {
@@ -42,62 +58,388 @@ namespace Engine
 
 		VkRenderPass render_pass;
 		VkDescriptorSetLayout descriptor_set_layout;
+		VkDescriptorSetLayout texture_set_layout;
 		VkPipelineLayout pipeline_layout;
+		// Alpha tested, and the same again without the test or blending for opaque sprites.
 		VkPipeline graphics_pipeline;
+		VkPipeline opaque_pipeline;
+		// Alpha tested like sprites, but reading the particle buffer instead of instances.
+		VkPipeline particle_pipeline;
 
 		VkCommandPool command_pool;
 		std::vector<VkCommandBuffer> command_buffers;
 
+		// Two timestamps per swap chain image, bracketing its command buffer.
+		VkQueryPool timestamp_pool{};
+		float gpu_frame_time = 0;
+
 		VkDescriptorPool descriptor_pool;
 		std::vector<VkDescriptorSet> descriptor_sets;
 
+		// A sampler set per texture, written the first time the texture is drawn.
+		VkDescriptorPool texture_descriptor_pool;
+		std::array<VkDescriptorSet, MAX_TEXTURES> texture_descriptor_sets{};
+
 		VkSampler texture_sampler;
 
-		VkImage depth_image;
-		VkDeviceMemory depth_image_memory;
-		VkImageView depth_image_view;
+		// Orders the frame's passes and places the barriers between them. Depth images and the low resolution target
+		// are its transient images, sharing memory wherever their passes allow.
+		RenderGraph render_graph;
+		std::vector<RenderGraph::Resource> swap_chain_resources;
+		RenderGraph::Resource depth_target;
+
+		// With a low resolution target the world is drawn by low_res_render_pass, blitted up to the swap chain
+		// image, and the overlay is drawn over it by overlay_render_pass. All three passes share the pipelines.
+		bool low_res = false;
+		VkExtent2D low_res_extent{};
+		VkRenderPass low_res_render_pass;
+		VkRenderPass overlay_render_pass;
+		RenderGraph::Resource low_res_target;
+		RenderGraph::Resource low_res_depth_target;
+		VkFramebuffer low_res_framebuffer;
+		VkOffset2D upscale_offset{};
+		VkExtent2D upscale_extent{};
+
+		// Static layers are drawn by layer_render_pass into their caches, which share a depth image since they're
+		// drawn one after another. The caches are sampled by a quad each in the world pass.
+		VkRenderPass layer_render_pass;
+		VkExtent2D layer_extent{};
+		RenderGraph::Resource layer_depth_target;
+		VkDescriptorPool layer_descriptor_pool;
+
+		// Outline corners for every mesh, the full quad first. Stays mapped so textures can add theirs as they load.
+		VkBuffer mesh_buffer;
+		VkDeviceMemory mesh_buffer_memory;
+		glm::vec2 * meshes_mapped;
+		int num_meshes = 0;
+		// Runs of meshes below num_meshes that unloaded textures gave back, in order and never touching.
+		struct MeshRange
+		{
+			uint32_t first;
+			int count;
+		};
+		std::vector<MeshRange> free_meshes;
+
+		// Matches the Clip struct in shader.vert, everything needed to find a clip's frame and where it is in the texture.
+		struct ClipData
+		{
+			uint32_t first_subsprite;
+			uint32_t num_frames;
+			float frame_rate;
+			uint32_t loop_mode;
+			uint32_t images_x;
+			uint32_t images_y;
+			uint32_t first_mesh;
+			uint32_t padding;
+		};
+
+		VkBuffer clip_buffer;
+		VkDeviceMemory clip_buffer_memory;
+		ClipData * clips_mapped;
+
+		// Storage buffers in every set 0: instances, meshes and clips.
+		const uint32_t INSTANCE_SET_BUFFERS = 3;
 
-		VkBuffer vertex_buffer;
-		VkDeviceMemory vertex_buffer_memory;
+		// Matches the push constants in shader.vert.
+		struct PushConstants
+		{
+			glm::mat4 view_projection;
+			float time;
+		};
 
 		VkBuffer index_buffer;
 		VkDeviceMemory index_buffer_memory;
 
-		std::vector<VkBuffer> uniform_buffers;
-		std::vector<VkDeviceMemory> uniform_buffers_memory;
+		std::vector<VkBuffer> instance_buffers;
+		std::vector<VkDeviceMemory> instance_buffers_memory;
 
+		// Acquire and present only take binary semaphores, everything else waits on the timeline.
 		std::vector<VkSemaphore> image_available_semaphores;
 		std::vector<VkSemaphore> render_finished_semaphores;
-		std::vector<VkFence> in_flight_fences;
-		std::vector<VkFence> images_in_flight;
+		// Counts up once for every submission to the graphics queue, as each finishes. Submissions are signalled in order,
+		// so reaching a value means everything submitted before it has finished too.
+		VkSemaphore timeline{};
+		uint64_t timeline_value = 0;
+		// What the last frame submitted from each slot, and the last frame drawn to each swap chain image, will signal.
+		// 0 for none.
+		std::vector<uint64_t> frame_values;
+		std::vector<uint64_t> image_values;
 		size_t current_frame = 0;
+		bool frame_waited = false;
 
-		static bool framebuffer_resized;
+		// The last one time commands submitted, which the next frame waits on.
+		uint64_t upload_value = 0;
+		uint64_t upload_value_waited = 0;
 
-		const std::vector<Vertex> vertices
+		// Objects released while the GPU may still be using them, destroyed once the timeline reaches their value.
+		struct Retired
 		{
-			{ { -.5f, -.5f, 0 }, { 1, 0 } },
-			{ {  .5f, -.5f, 0 }, { 0, 0 } },
-			{ {  .5f,  .5f, 0 }, { 0, 1 } },
-			{ { -.5f,  .5f, 0 }, { 1, 1 } }
+			uint64_t value;
+			std::function<void()> destroy;
 		};
+		std::vector<Retired> retired;
+
+		// When the input used by the frame in each slot was polled, 0 once its latency has been counted.
+		std::array<double, MAX_FRAMES_IN_FLIGHT> input_sample_times{};
+
+		static bool framebuffer_resized;
 
+		// A fan over a mesh's corners. The vertex shader looks each corner up in the instance's mesh.
 		const std::vector<uint32_t> indices
 		{
 			0, 1, 2,
-			2, 3, 0
+			0, 2, 3,
+			0, 3, 4,
+			0, 4, 5,
+			0, 5, 6,
+			0, 6, 7
+		};
+		static_assert(MESH_VERTICES == 8, "Update the indices and the mesh size in shader.vert.");
+
+		// Matches the storage buffer in shader.vert. Sorted objects and static layer quads come first, then overlay glyphs.
+		static_assert(MAX_INSTANCES == 1528, "Update the instance count in shader.vert.");
+		struct InstanceBuffer
+		{
+			glm::mat4 model[MAX_INSTANCES];
+			glm::mat3 tex_offset[MAX_INSTANCES];
+			// Written straight to the depth buffer, from 0 at the front to 1 at the back.
+			float depth[MAX_INSTANCES];
+			uint32_t mesh[MAX_INSTANCES];
+			// NO_CLIP unless the sprite is playing one.
+			uint32_t clip[MAX_INSTANCES];
+			float clip_start[MAX_INSTANCES];
+		};
+
+		const uint32_t NO_CLIP = UINT32_MAX;
+		// What one instance takes across the buffer's arrays.
+		const uint64_t INSTANCE_SIZE = sizeof(InstanceBuffer) / MAX_INSTANCES;
+
+		// Layer tiles use the same layout, so they're drawn by the same pipeline.
+		static_assert(MAX_LAYER_TILES <= MAX_INSTANCES, "Layer tiles must fit in an instance buffer.");
+
+		std::vector<InstanceBuffer *> instance_buffers_mapped;
+
+		// Instances sharing a layer, pipeline and texture, drawn with one call.
+		struct Batch
+		{
+			int texture;
+			uint32_t first_instance;
+			uint32_t instance_count;
+			RenderQueue::Layer layer;
+			RenderQueue::Pipeline pipeline;
+		};
+
+		std::vector<Batch> batches;
+		RenderQueue render_queue;
+		// Where each object falls in the painter's order, the first furthest back.
+		RenderQueue order_queue;
+		std::array<uint16_t, MAX_OBJECTS> object_order;
+		std::array<uint16_t, MAX_INSTANCES> instance_slots;
+		glm::mat4 world_view_projection{ 1 };
+		glm::mat4 overlay_view_projection{ 1 };
+		// Half the width and height of the world the camera sees.
+		glm::vec2 view_half_size{ 1 };
+		// Whole target pixels per world unit in low resolution mode, zero otherwise.
+		float pixels_per_unit = 0;
+
+		// The camera looks down on the world from this far away at zoom 1.
+		const float CAMERA_DISTANCE = 10.f;
+		const Radians FIELD_OF_VIEW = glm::radians(45.f);
+
+		struct LayerCache
+		{
+			VkImage image{};
+			VkDeviceMemory image_memory{};
+			VkImageView image_view{};
+			VkFramebuffer framebuffer{};
+			VkDescriptorSet texture_set{};
+			RenderGraph::Resource resource{};
+
+			// Tiles only change with the layer, so they're kept in a buffer of their own rather than rewritten each frame.
+			VkBuffer tile_buffer{};
+			VkDeviceMemory tile_buffer_memory{};
+			InstanceBuffer * tiles_mapped{};
+			VkDescriptorSet tile_set{};
+			std::vector<Batch> batches;
+			uint64_t tiles_version{};
+
+			// The area last drawn, in world units. A zero size means the cache needs drawing.
+			glm::vec2 center{};
+			glm::vec2 half_size{};
+			glm::mat4 view_projection{ 1 };
+			bool redraw{};
+			// The last frame to draw from the tile buffer, which must finish before the tiles are rewritten.
+			uint64_t drawn_value{};
+			// The last frame that could use the slot before its layer was removed, which must finish before its sets are rewritten.
+			uint64_t removed_value{};
+		};
+
+		std::array<LayerCache, MAX_STATIC_LAYERS> layer_caches;
+		int num_static_layers = 0;
+
+		// Matches the structs in shaders/particle.glsl. The GPU only ever reads emitters, particles never leave it.
+		struct ParticleEmitterData
+		{
+			glm::vec2 position;
+			glm::vec2 acceleration;
+			float direction;
+			float spread;
+			float min_speed;
+			float max_speed;
+			float min_lifetime;
+			float max_lifetime;
+			float start_size;
+			float end_size;
+			float drag;
+			uint32_t first_spawn;
+			uint32_t spawn_count;
+			uint32_t first_subsprite;
+			uint32_t num_subsprites;
+			uint32_t padding;
+		};
+
+		struct ParticleFrame
+		{
+			float delta_time;
+			uint32_t seed;
+			uint32_t num_emitters;
+			uint32_t spawn_count;
+			uint32_t images_x;
+			uint32_t images_y;
+			uint32_t first_mesh;
+			uint32_t padding;
+			ParticleEmitterData emitters[MAX_EMITTERS];
+		};
+
+		static_assert(MAX_PARTICLES == 32768 && MAX_EMITTERS == 16, "Update the limits in shaders/particle.glsl.");
+		const VkDeviceSize PARTICLE_SIZE = 64;
+		// The indirect draw command for the buffer's particles, padded to the particles' alignment.
+		const VkDeviceSize PARTICLE_HEADER_SIZE = 32;
+		const uint32_t PARTICLE_GROUP_SIZE = 64;
+
+		// Each frame's update reads the particles from one buffer and writes the survivors and new spawns to the other.
+		std::array<VkBuffer, 2> particle_buffers;
+		std::array<VkDeviceMemory, 2> particle_buffers_memory;
+		std::array<RenderGraph::Resource, 2> particle_resources;
+		// The buffer with the latest particles.
+		int particle_source = 0;
+
+		std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> particle_frame_buffers;
+		std::array<VkDeviceMemory, MAX_FRAMES_IN_FLIGHT> particle_frame_buffers_memory;
+		std::array<ParticleFrame *, MAX_FRAMES_IN_FLIGHT> particle_frames_mapped;
+
+		VkDescriptorSetLayout particle_set_layout;
+		VkPipelineLayout particle_compute_layout;
+		VkPipeline particle_simulate_pipeline;
+		VkPipeline particle_spawn_pipeline;
+		VkDescriptorPool particle_descriptor_pool;
+		// Update sets by frame in flight then by the buffer read from, draw sets by the buffer drawn.
+		std::array<std::array<VkDescriptorSet, 2>, MAX_FRAMES_IN_FLIGHT> particle_update_sets;
+		std::array<VkDescriptorSet, 2> particle_draw_sets;
+
+		uint32_t particle_spawn_count = 0;
+		// Whether any particle could still be alive, so the frame needs to update and draw them.
+		bool particles_active = false;
+		float particles_alive_until = 0;
+
+		// Matches SortBuffer in shaders/sort.glsl. Each pass moves the keys, and the instance slots they belong to,
+		// from one half to the other.
+		const uint32_t SORT_GROUP_SIZE = 256;
+		const uint32_t SORT_RADIX = 256;
+		const uint32_t MAX_SORT_GROUPS = (MAX_OBJECTS + SORT_GROUP_SIZE - 1) / SORT_GROUP_SIZE;
+		struct SortBuffer
+		{
+			uint32_t count;
+			uint32_t first_order;
+			uint32_t num_orders;
+			uint32_t padding;
+			uint32_t keys[2][MAX_OBJECTS];
+			uint32_t slots[2][MAX_OBJECTS];
+			uint32_t digit_counts[SORT_RADIX * MAX_SORT_GROUPS];
+		};
+
+		static_assert(MAX_OBJECTS == 500 && MAX_INSTANCES == 1528, "Update the limits in shaders/sort.glsl and sort_scatter.comp.");
+
+		struct SortPass
+		{
+			uint32_t shift;
+			uint32_t source;
+			uint32_t last;
+		};
+
+		// With Config::y_sort, objects are ranked by compute shaders when the device can run them, the last pass writing
+		// each object's depth into the instance buffer. One sort buffer and set per swap chain image, like the instances.
+		bool gpu_sort = false;
+		std::vector<VkBuffer> sort_buffers;
+		std::vector<VkDeviceMemory> sort_buffers_memory;
+		std::vector<SortBuffer *> sort_buffers_mapped;
+		std::vector<VkDescriptorSet> sort_sets;
+		std::vector<RenderGraph::Resource> instance_resources;
+		VkDescriptorSetLayout sort_set_layout;
+		VkPipelineLayout sort_layout;
+		VkPipeline sort_count_pipeline;
+		VkPipeline sort_scan_pipeline;
+		VkPipeline sort_scatter_pipeline;
+		// A pass per byte that isn't the same in every key, at least one so the depths still get written.
+		std::array<SortPass, 4> sort_passes;
+		uint32_t num_sort_passes = 0;
+
+		// Part of a render pass recorded into a secondary command buffer, so recording can be spread over threads.
+		// The primary buffer runs the jobs in the order they were added.
+		struct RecordJob
+		{
+			VkRenderPass render_pass;
+			VkFramebuffer framebuffer;
+			VkExtent2D extent;
+			VkDescriptorSet instance_set;
+			glm::mat4 view_projection;
+			const std::vector<Batch> * batches;
+			size_t first_batch;
+			size_t end_batch;
+			// Draws the particles after the batches.
+			bool particles;
+
+			VkCommandBuffer command_buffer;
+			uint32_t draw_calls;
 		};
 
-		struct UniformBufferObject
+		// Pools can only be used by one thread at a time, so each recording thread has its own for every frame in flight.
+		struct RecordThread
 		{
-			glm::mat4 model[MAX_OBJECTS];
-			glm::mat3 tex_offset[MAX_OBJECTS];
-			glm::mat4 view;
-			glm::mat4 projection;
-		} ubo{};
+			std::array<VkCommandPool, MAX_FRAMES_IN_FLIGHT> pools{};
+			std::array<std::vector<VkCommandBuffer>, MAX_FRAMES_IN_FLIGHT> command_buffers;
+			// How many of the frame's command buffers have been recorded so far.
+			size_t num_used{};
+		};
+
+		// A pass with fewer batches than this is recorded as one job, splitting it would cost more than it saves.
+		const size_t MIN_BATCHES_PER_JOB = 64;
+		const int MAX_RECORD_THREADS = 16;
+
+		std::vector<RecordJob> record_jobs;
+		std::atomic<size_t> next_record_job = 0;
+		// The main thread records as thread 0, workers take the rest.
+		std::vector<RecordThread> record_threads;
+		std::vector<std::thread> record_workers;
+		std::mutex record_mutex;
+		std::condition_variable record_wake;
+		std::condition_variable record_done;
+		// Bumped for every round of jobs, so a worker can tell it hasn't helped with this one yet.
+		uint64_t record_round = 0;
+		int record_workers_busy = 0;
+		bool record_workers_running = false;
+		std::exception_ptr record_error;
 
 		void Initialize()
 		{
+			// The null renderer, textures only record their metadata.
+			if (config.headless)
+			{
+				Texture::LoadTextures();
+				Text::Initialize();
+				return;
+			}
+
 			CreateWindow();
 			CreateInstance();
 			SetupDebugMessenger();
@@ -110,26 +452,74 @@ namespace Engine
 			CreateDescriptorSetLayout();
 			CreateGraphicsPipeline();
 			CreateCommandPool();
+			CreateTimeline();
+			CreateRecordThreads();
 			CreateDepthResources();
-			CreateFramebuffers();
+			CreateLowResTarget();
+			CreateMeshBuffer();
+			CreateClipBuffer();
 			Texture::LoadTextures();
+			Text::Initialize();
 			CreateTextureSampler();
-			CreateVertexBuffer();
+			CreateTextureDescriptorPool();
+			CreateLayerDescriptorSets();
+			CreateLayerCaches();
 			CreateIndexBuffer();
-			CreateUniformBuffers();
+			CreateSortPipelines();
+			CreateInstanceBuffers();
 			CreateDescriptorPool();
 			CreateDescriptorSets();
+			CreateParticleResources();
+			AllocateRenderTargets();
+			CreateTimestampPool();
 			CreateCommandBuffers();
 			CreateSyncObjects();
 		}
 
+		void WaitForFrame()
+		{
+			if (config.headless || frame_waited)
+				return;
+
+			Trace::Scope scope("Wait for frame");
+
+			using Clock = std::chrono::high_resolution_clock;
+			auto & stats = Stats::Current();
+
+			auto wait_start = Clock::now();
+			WaitForTimeline(frame_values[current_frame]);
+			stats.fence_wait_time += std::chrono::duration<float>(Clock::now() - wait_start).count();
+
+			DestroyRetired();
+
+			// Input to the GPU finishing the frame that used it, overstated by however long the value sat reached.
+			if (input_sample_times[current_frame] > 0)
+			{
+				stats.latency = float(glfwGetTime() - input_sample_times[current_frame]);
+				input_sample_times[current_frame] = 0;
+			}
+
+			frame_waited = true;
+		}
+
 		void Update()
 		{
-			vkWaitForFences(device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+			if (config.headless)
+				return;
+
+			Trace::Scope scope("Graphics::Update");
+
+			using Clock = std::chrono::high_resolution_clock;
+			auto & stats = Stats::Current();
+
+			WaitForFrame();
+			frame_waited = false;
 
+			Trace::BeginScope("Acquire image");
 			uint32_t image_index;
 			VkResult result = vkAcquireNextImageKHR(device, swap_chain, UINT64_MAX,
 				image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+			Trace::EndScope();
 
 			if (result == VK_ERROR_OUT_OF_DATE_KHR)
 			{
@@ -139,20 +529,51 @@ namespace Engine
 			else if (!(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR))
 				throw std::runtime_error("Failed to acquire swap chain image.");
 
-			if (images_in_flight[image_index] != VK_NULL_HANDLE)
-				vkWaitForFences(device, 1, &images_in_flight[image_index], VK_TRUE, UINT64_MAX);
+			if (image_values[image_index] != 0)
+			{
+				Trace::BeginScope("Wait for image");
+				auto wait_start = Clock::now();
+				WaitForTimeline(image_values[image_index]);
+				stats.fence_wait_time += std::chrono::duration<float>(Clock::now() - wait_start).count();
+				Trace::EndScope();
+
+				ReadTimestamps(image_index);
+			}
+
+			UpdateView();
+			UpdateLayers();
+			UpdateInstances(image_index);
+			UpdateParticles();
 
-			images_in_flight[image_index] = in_flight_fences[current_frame];
+			// Nothing else is submitted before this frame, so it can be given its value while it's still being recorded.
+			uint64_t frame_value = ++timeline_value;
+			frame_values[current_frame] = frame_value;
+			image_values[image_index] = frame_value;
 
-			UpdateUniformBuffer(image_index);
+			RecordCommandBuffer(image_index);
 
-			const std::array<VkSemaphore, 1> wait_semaphores{ image_available_semaphores[current_frame] };
-			const std::array<VkPipelineStageFlags, 1> wait_stages{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-			const std::array<VkSemaphore, 1> signal_semaphores{ render_finished_semaphores[current_frame] };
+			// Uploads since the last frame are waited on at the start of this one, rather than by the CPU.
+			std::array<VkSemaphore, 2> wait_semaphores{ image_available_semaphores[current_frame], timeline };
+			std::array<VkPipelineStageFlags, 2> wait_stages{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+			// Binary semaphores ignore their values.
+			std::array<uint64_t, 2> wait_values{ 0, upload_value };
+			uint32_t wait_count = upload_value > upload_value_waited ? 2 : 1;
+			upload_value_waited = upload_value;
+
+			const std::array<VkSemaphore, 2> signal_semaphores{ render_finished_semaphores[current_frame], timeline };
+			const std::array<uint64_t, 2> signal_values{ 0, frame_value };
+
+			VkTimelineSemaphoreSubmitInfo timeline_info{};
+			timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timeline_info.waitSemaphoreValueCount = wait_count;
+			timeline_info.pWaitSemaphoreValues = wait_values.data();
+			timeline_info.signalSemaphoreValueCount = uint32_t(signal_values.size());
+			timeline_info.pSignalSemaphoreValues = signal_values.data();
 
 			VkSubmitInfo submit_info{};
 			submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-			submit_info.waitSemaphoreCount = uint32_t(wait_semaphores.size());
+			submit_info.pNext = &timeline_info;
+			submit_info.waitSemaphoreCount = wait_count;
 			submit_info.pWaitSemaphores = wait_semaphores.data();
 			submit_info.pWaitDstStageMask = wait_stages.data();
 			submit_info.commandBufferCount = 1;
@@ -160,20 +581,23 @@ namespace Engine
 			submit_info.signalSemaphoreCount = uint32_t(signal_semaphores.size());
 			submit_info.pSignalSemaphores = signal_semaphores.data();
 
-			vkResetFences(device, 1, &in_flight_fences[current_frame]);
+			Trace::BeginScope("Submit and present");
 
-			if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS)
+			if (vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
 				throw std::runtime_error("Failed to submit draw command buffer.");
 
+			input_sample_times[current_frame] = Input::GetSampleTime();
+
 			VkPresentInfoKHR present_info{};
 			present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-			present_info.waitSemaphoreCount = uint32_t(wait_semaphores.size());
-			present_info.pWaitSemaphores = signal_semaphores.data();
+			present_info.waitSemaphoreCount = 1;
+			present_info.pWaitSemaphores = &render_finished_semaphores[current_frame];
 			present_info.swapchainCount = 1;
 			present_info.pSwapchains = &swap_chain;
 			present_info.pImageIndices = &image_index;
 
 			result = vkQueuePresentKHR(present_queue, &present_info);
+			Trace::EndScope();
 
 			if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized)
 			{
@@ -183,35 +607,85 @@ namespace Engine
 			else if (result != VK_SUCCESS)
 				throw std::runtime_error("Failed to present swap chain image.");
 
-			current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+			current_frame = (current_frame + 1) % frame_values.size();
 
 		}
 
 		void Shutdown()
 		{
+			if (config.headless)
+			{
+				Texture::UnloadTextures();
+				return;
+			}
+
 			vkDeviceWaitIdle(device);
 
 			CleanupSwapChain();
 
 			Texture::UnloadTextures();
+			// The device is idle, so everything waiting goes now, before the pools its sets came from.
+			DestroyRetired();
 
 			vkDestroySampler(device, texture_sampler, nullptr);
 
+			vkDestroyDescriptorPool(device, texture_descriptor_pool, nullptr);
+
+			for (int i = 0; i < num_static_layers; ++i)
+				DestroyLayerTileBuffer(i);
+
+			vkDestroyDescriptorPool(device, layer_descriptor_pool, nullptr);
+
+			if (gpu_sort)
+			{
+				vkDestroyPipeline(device, sort_count_pipeline, nullptr);
+				vkDestroyPipeline(device, sort_scan_pipeline, nullptr);
+				vkDestroyPipeline(device, sort_scatter_pipeline, nullptr);
+				vkDestroyPipelineLayout(device, sort_layout, nullptr);
+				vkDestroyDescriptorSetLayout(device, sort_set_layout, nullptr);
+			}
+
+			vkDestroyPipeline(device, particle_simulate_pipeline, nullptr);
+			vkDestroyPipeline(device, particle_spawn_pipeline, nullptr);
+			vkDestroyPipelineLayout(device, particle_compute_layout, nullptr);
+			vkDestroyDescriptorPool(device, particle_descriptor_pool, nullptr);
+			vkDestroyDescriptorSetLayout(device, particle_set_layout, nullptr);
+
+			for (size_t i = 0; i < particle_buffers.size(); ++i)
+			{
+				vkDestroyBuffer(device, particle_buffers[i], nullptr);
+				vkFreeMemory(device, particle_buffers_memory[i], nullptr);
+			}
+
+			for (size_t i = 0; i < particle_frame_buffers.size(); ++i)
+			{
+				vkUnmapMemory(device, particle_frame_buffers_memory[i]);
+				vkDestroyBuffer(device, particle_frame_buffers[i], nullptr);
+				vkFreeMemory(device, particle_frame_buffers_memory[i], nullptr);
+			}
+
+			vkDestroyDescriptorSetLayout(device, texture_set_layout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
 
-			vkDestroyBuffer(device, vertex_buffer, nullptr);
-			vkFreeMemory(device, vertex_buffer_memory, nullptr);
+			vkUnmapMemory(device, mesh_buffer_memory);
+			vkDestroyBuffer(device, mesh_buffer, nullptr);
+			vkFreeMemory(device, mesh_buffer_memory, nullptr);
+
+			vkUnmapMemory(device, clip_buffer_memory);
+			vkDestroyBuffer(device, clip_buffer, nullptr);
+			vkFreeMemory(device, clip_buffer_memory, nullptr);
 
 			vkDestroyBuffer(device, index_buffer, nullptr);
 			vkFreeMemory(device, index_buffer_memory, nullptr);
 
-			for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+			for (size_t i = 0; i < frame_values.size(); i++)
 			{
 				vkDestroySemaphore(device, render_finished_semaphores[i], nullptr);
 				vkDestroySemaphore(device, image_available_semaphores[i], nullptr);
-				vkDestroyFence(device, in_flight_fences[i], nullptr);
 			}
+			vkDestroySemaphore(device, timeline, nullptr);
 
+			DestroyRecordThreads();
 			vkDestroyCommandPool(device, command_pool, nullptr);
 
 			vkDestroyDevice(device, nullptr);
@@ -237,6 +711,25 @@ namespace Engine
 			return window;
 		}
 
+		float GetGpuFrameTime()
+		{
+			return gpu_frame_time;
+		}
+
+		const Camera & GetCamera()
+		{
+			return camera;
+		}
+
+		void SetCamera(const Camera & new_camera)
+		{
+			if (new_camera.zoom == camera.zoom && new_camera.offset == camera.offset)
+				return;
+
+			camera = new_camera;
+			RequestRedraw();
+		}
+
 		inline glm::vec2 WindowSize()
 		{
 			return glm::vec2(swap_chain_extent.width, swap_chain_extent.height);
@@ -251,20 +744,39 @@ namespace Engine
 		{
 
 			framebuffer_resized = true;
+			RequestRedraw();
 		}
 
-		void CleanupSwapChain()
+		// The window was uncovered or needs repainting for some other reason.
+		void WindowRefreshCallback(GLFWwindow * /*window*/)
 		{
-			vkDestroyImageView(device, depth_image_view, nullptr);
-			vkDestroyImage(device, depth_image, nullptr);
-			vkFreeMemory(device, depth_image_memory, nullptr);
+			RequestRedraw();
+		}
 
+		void CleanupSwapChain()
+		{
 			for (auto framebuffer : swap_chain_framebuffers)
 				vkDestroyFramebuffer(device, framebuffer, nullptr);
 
+			if (low_res)
+			{
+				vkDestroyFramebuffer(device, low_res_framebuffer, nullptr);
+				vkDestroyRenderPass(device, low_res_render_pass, nullptr);
+				vkDestroyRenderPass(device, overlay_render_pass, nullptr);
+			}
+
+			CleanupLayerCaches();
+			vkDestroyRenderPass(device, layer_render_pass, nullptr);
+
+			render_graph.DestroyTransients();
+			for (auto resource : swap_chain_resources)
+				render_graph.Remove(resource);
+
 			vkFreeCommandBuffers(device, command_pool, uint32_t(command_buffers.size()), command_buffers.data());
 
 			vkDestroyPipeline(device, graphics_pipeline, nullptr);
+			vkDestroyPipeline(device, opaque_pipeline, nullptr);
+			vkDestroyPipeline(device, particle_pipeline, nullptr);
 			vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
 			vkDestroyRenderPass(device, render_pass, nullptr);
 
@@ -273,22 +785,43 @@ namespace Engine
 
 			vkDestroySwapchainKHR(device, swap_chain, nullptr);
 
+			if (timestamp_pool != VK_NULL_HANDLE)
+				vkDestroyQueryPool(device, timestamp_pool, nullptr);
+
 			for (size_t i = 0; i < SwapChainSize(); i++)
 			{
-				vkDestroyBuffer(device, uniform_buffers[i], nullptr);
-				vkFreeMemory(device, uniform_buffers_memory[i], nullptr);
+				vkUnmapMemory(device, instance_buffers_memory[i]);
+				vkDestroyBuffer(device, instance_buffers[i], nullptr);
+				vkFreeMemory(device, instance_buffers_memory[i], nullptr);
+				render_graph.Remove(instance_resources[i]);
 			}
 
+			if (gpu_sort)
+				for (size_t i = 0; i < SwapChainSize(); i++)
+				{
+					vkUnmapMemory(device, sort_buffers_memory[i]);
+					vkDestroyBuffer(device, sort_buffers[i], nullptr);
+					vkFreeMemory(device, sort_buffers_memory[i], nullptr);
+				}
+
 			vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
 		}
 
 		void CreateDepthResources()
 		{
-			VkFormat depth_format = FindDepthFormat();
-			CreateImage(swap_chain_extent.width, swap_chain_extent.height, depth_format, VK_IMAGE_TILING_OPTIMAL,
-				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depth_image, depth_image_memory);
-			depth_image_view = CreateImageView(depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
-			TransitionImageLayout(depth_image, depth_format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+			depth_target = render_graph.CreateTransientImage({ swap_chain_extent.width, swap_chain_extent.height, FindDepthFormat(),
+				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT });
+		}
+
+		// Transient images only get memory once the graph has seen a frame's passes, so everything drawing to them
+		// waits until the rest of the frame's resources exist.
+		void AllocateRenderTargets()
+		{
+			DeclareFrame(0);
+			render_graph.AllocateTransients();
+			Stats::Current().target_memory = render_graph.GetTransientMemory();
+
+			CreateFramebuffers();
 		}
 
 		void RecreateSwapChain()
@@ -303,6 +836,8 @@ namespace Engine
 
 			vkDeviceWaitIdle(device);
 
+			++Stats::Current().swap_chain_recreations;
+
 			CleanupSwapChain();
 
 			CreateSwapChain();
@@ -310,13 +845,17 @@ namespace Engine
 			CreateRenderPass();
 			CreateGraphicsPipeline();
 			CreateDepthResources();
-			CreateFramebuffers();
-			CreateUniformBuffers();
+			CreateLowResTarget();
+			CreateLayerCaches();
+			CreateInstanceBuffers();
 			CreateDescriptorPool();
 			CreateDescriptorSets();
+			AllocateRenderTargets();
+			CreateTimestampPool();
 			CreateCommandBuffers();
 
-			images_in_flight.resize(SwapChainSize(), VK_NULL_HANDLE);
+			// Everything is idle, and the new command buffers haven't written their timestamps yet.
+			image_values.assign(SwapChainSize(), 0);
 		}
 
 		void CreateWindow()
@@ -325,6 +864,7 @@ namespace Engine
 			glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 			window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
 			glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
+			glfwSetWindowRefreshCallback(window, WindowRefreshCallback);
 		}
 
 		void CreateInstance()
@@ -338,7 +878,7 @@ namespace Engine
 			appInfo.applicationVersion = VK_MAKE_VERSION(0, 0, 0);
 			appInfo.pEngineName = "Paper";
 			appInfo.engineVersion = VK_MAKE_VERSION(0, 0, 0);
-			appInfo.apiVersion = VK_API_VERSION_1_0;
+			appInfo.apiVersion = VK_API_VERSION_1_2;
 
 			VkInstanceCreateInfo creation_info{};
 			creation_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -443,8 +983,13 @@ namespace Engine
 			VkPhysicalDeviceFeatures device_features{};
 			device_features.samplerAnisotropy = VK_TRUE;
 
+			VkPhysicalDeviceVulkan12Features vulkan_12_features{};
+			vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			vulkan_12_features.timelineSemaphore = VK_TRUE;
+
 			VkDeviceCreateInfo creation_info{};
 			creation_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+			creation_info.pNext = &vulkan_12_features;
 
 			creation_info.queueCreateInfoCount = uint32_t(queue_creation_infos.size());
 			creation_info.pQueueCreateInfos = queue_creation_infos.data();
@@ -495,6 +1040,28 @@ namespace Engine
 			swap_chain_info.imageArrayLayers = 1;
 			swap_chain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+			// The low resolution target is blitted into the swap chain images, which needs support for both.
+			low_res = false;
+			if (config.render_width > 0 && config.render_height > 0)
+			{
+				VkFormatProperties format_properties;
+				vkGetPhysicalDeviceFormatProperties(physical_device, surface_format.format, &format_properties);
+
+				const VkFormatFeatureFlags BLIT_FEATURES = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+				low_res = (swap_chain_support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+					&& (format_properties.optimalTilingFeatures & BLIT_FEATURES) == BLIT_FEATURES;
+
+				static bool warned = false;
+				if (!low_res && !warned)
+				{
+					WriteError("The swap chain can't be blitted to, drawing at window resolution instead.");
+					warned = true;
+				}
+			}
+
+			if (low_res)
+				swap_chain_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
 			QueueFamilyIndices queue_family_indices = FindQueueFamilies(physical_device);
 			uint32_t queueFamilyIndices[] = {
 				queue_family_indices.graphics_family.value(),
@@ -537,19 +1104,39 @@ namespace Engine
 
 			for (size_t i = 0; i < SwapChainSize(); i++)
 				swap_chain_image_views[i] = CreateImageView(swap_chain_images[i], swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+			swap_chain_resources.resize(SwapChainSize());
+			for (size_t i = 0; i < SwapChainSize(); i++)
+				swap_chain_resources[i] = render_graph.ImportImage(swap_chain_images[i], VK_IMAGE_ASPECT_COLOR_BIT);
 		}
 
 		void CreateRenderPass()
+		{
+			render_pass = BuildRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR);
+
+			if (low_res)
+			{
+				low_res_render_pass = BuildRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR);
+				overlay_render_pass = BuildRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD);
+			}
+
+			layer_render_pass = BuildRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR);
+		}
+
+		// Passes only differ in whether the color attachment is cleared, so they're all compatible with one pipeline.
+		// Attachments start and end in the layouts the pass draws with and the render graph places every barrier, so
+		// the passes have no dependencies of their own.
+		VkRenderPass BuildRenderPass(VkAttachmentLoadOp color_load_op)
 		{
 			VkAttachmentDescription color_attach{};
 			color_attach.format = swap_chain_image_format;
 			color_attach.samples = VK_SAMPLE_COUNT_1_BIT;
-			color_attach.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			color_attach.loadOp = color_load_op;
 			color_attach.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 			color_attach.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			color_attach.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			color_attach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			color_attach.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			color_attach.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			color_attach.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 			VkAttachmentReference color_attach_ref{};
 			color_attach_ref.attachment = 0;
@@ -562,7 +1149,7 @@ namespace Engine
 			depth_attach.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 			depth_attach.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			depth_attach.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			depth_attach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			depth_attach.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 			depth_attach.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 			VkAttachmentReference depth_attach_ref{};
@@ -575,14 +1162,6 @@ namespace Engine
 			subpass.pColorAttachments = &color_attach_ref;
 			subpass.pDepthStencilAttachment = &depth_attach_ref;
 
-			VkSubpassDependency subpass_dependency{};
-			subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-			subpass_dependency.dstSubpass = 0;
-			subpass_dependency.srcAccessMask = 0;
-			subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-			subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-			subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
 			std::array<VkAttachmentDescription, 2> attachments{ color_attach, depth_attach };
 
 			VkRenderPassCreateInfo render_pass_info{};
@@ -591,42 +1170,52 @@ namespace Engine
 			render_pass_info.pAttachments = attachments.data();
 			render_pass_info.subpassCount = 1;
 			render_pass_info.pSubpasses = &subpass;
-			render_pass_info.dependencyCount = 1;
-			render_pass_info.pDependencies = &subpass_dependency;
 
-			if (vkCreateRenderPass(device, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS)
+			VkRenderPass new_render_pass;
+			if (vkCreateRenderPass(device, &render_pass_info, nullptr, &new_render_pass) != VK_SUCCESS)
 				throw std::runtime_error("Failed to create render pass.");
+
+			return new_render_pass;
 		}
 
 		void CreateDescriptorSetLayout()
 		{
-			VkDescriptorSetLayoutBinding ubo_layout_binding{};
-			ubo_layout_binding.binding = 0;
-			ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			ubo_layout_binding.descriptorCount = 1;
-			ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+			// Set 0 is the frame's instances and the meshes, set 1 the texture being drawn.
+			std::array<VkDescriptorSetLayoutBinding, INSTANCE_SET_BUFFERS> instance_layout_bindings{};
+			for (uint32_t binding = 0; binding < instance_layout_bindings.size(); ++binding)
+			{
+				instance_layout_bindings[binding].binding = binding;
+				instance_layout_bindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				instance_layout_bindings[binding].descriptorCount = 1;
+				instance_layout_bindings[binding].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+			}
+
+			VkDescriptorSetLayoutCreateInfo layout_info{};
+			layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layout_info.bindingCount = uint32_t(instance_layout_bindings.size());
+			layout_info.pBindings = instance_layout_bindings.data();
+
+			if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &descriptor_set_layout) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create descriptor set layout.");
 
 			VkDescriptorSetLayoutBinding sampler_layout_binding{};
-			sampler_layout_binding.binding = 1;
+			sampler_layout_binding.binding = 0;
 			sampler_layout_binding.descriptorCount = 1;
 			sampler_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 			sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-			std::array<VkDescriptorSetLayoutBinding, 2> bindings = { ubo_layout_binding, sampler_layout_binding };
-
-			VkDescriptorSetLayoutCreateInfo layout_info{};
-			layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-			layout_info.bindingCount = uint32_t(bindings.size());
-			layout_info.pBindings = bindings.data();
+			layout_info.bindingCount = 1;
+			layout_info.pBindings = &sampler_layout_binding;
 
-			if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &descriptor_set_layout) != VK_SUCCESS)
-				throw std::runtime_error("Failed to create descriptor set layout.");
+			if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &texture_set_layout) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create texture descriptor set layout.");
 		}
 
 		void CreateGraphicsPipeline()
 		{
 			VkShaderModule vertex_shader_module = CreateShaderModule(ReadFile("shaders/vert.spv"));
 			VkShaderModule fragment_shader_module = CreateShaderModule(ReadFile("shaders/frag.spv"));
+			VkShaderModule particle_shader_module = CreateShaderModule(ReadFile("shaders/particle_vert.spv"));
 
 			VkPipelineShaderStageCreateInfo vertex_shader_stage_info{};
 			vertex_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -645,39 +1234,27 @@ namespace Engine
 				fragment_shader_stage_info
 			};
 
-			auto binding_description = Vertex::GetBindingDescription();
-			auto attribute_descriptions = Vertex::GetAttributeDescriptions();
-
+			// No vertex buffers, corners are read from the mesh buffer by index.
 			VkPipelineVertexInputStateCreateInfo vertex_input_info{};
 			vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-			vertex_input_info.vertexBindingDescriptionCount = 1;
-			vertex_input_info.pVertexBindingDescriptions = &binding_description;
-			vertex_input_info.vertexAttributeDescriptionCount = uint32_t(attribute_descriptions.size());
-			vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
 
 			VkPipelineInputAssemblyStateCreateInfo input_assembly_info{};
 			input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 			input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 			input_assembly_info.primitiveRestartEnable = VK_FALSE;
 
-			VkViewport viewport{};
-			viewport.x = 0.0f;
-			viewport.y = 0.0f;
-			viewport.width = WindowSize().x;
-			viewport.height = WindowSize().y;
-			viewport.minDepth = 0.0f;
-			viewport.maxDepth = 1.0f;
-
-			VkRect2D scissor{};
-			scissor.offset = { 0, 0 };
-			scissor.extent = swap_chain_extent;
-
+			// Set per pass, since the low resolution target and the swap chain differ in size.
 			VkPipelineViewportStateCreateInfo viewport_info{};
 			viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 			viewport_info.viewportCount = 1;
-			viewport_info.pViewports = &viewport;
 			viewport_info.scissorCount = 1;
-			viewport_info.pScissors = &scissor;
+
+			std::array<VkDynamicState, 2> dynamic_states{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+			VkPipelineDynamicStateCreateInfo dynamic_state_info{};
+			dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+			dynamic_state_info.dynamicStateCount = uint32_t(dynamic_states.size());
+			dynamic_state_info.pDynamicStates = dynamic_states.data();
 
 			VkPipelineRasterizationStateCreateInfo rasterizer_info{};
 			rasterizer_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -685,7 +1262,8 @@ namespace Engine
 			rasterizer_info.rasterizerDiscardEnable = VK_FALSE;
 			rasterizer_info.polygonMode = VK_POLYGON_MODE_FILL;
 			rasterizer_info.lineWidth = 1.0f;
-			rasterizer_info.cullMode = VK_CULL_MODE_BACK_BIT;
+			// Sprites are single quads, and the world and overlay projections wind them in opposite directions.
+			rasterizer_info.cullMode = VK_CULL_MODE_NONE;
 			rasterizer_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 			rasterizer_info.depthBiasEnable = VK_FALSE;
 
@@ -710,11 +1288,19 @@ namespace Engine
 			color_blend_info.attachmentCount = 1;
 			color_blend_info.pAttachments = &color_blend_attachment;
 
+			std::array<VkDescriptorSetLayout, 2> set_layouts{ descriptor_set_layout, texture_set_layout };
+
+			VkPushConstantRange push_constant_range{};
+			push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+			push_constant_range.offset = 0;
+			push_constant_range.size = sizeof(PushConstants);
+
 			VkPipelineLayoutCreateInfo pipeline_layout_info{};
 			pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-			pipeline_layout_info.setLayoutCount = 1;
-			pipeline_layout_info.pSetLayouts = &descriptor_set_layout;
-			pipeline_layout_info.pushConstantRangeCount = 0;
+			pipeline_layout_info.setLayoutCount = uint32_t(set_layouts.size());
+			pipeline_layout_info.pSetLayouts = set_layouts.data();
+			pipeline_layout_info.pushConstantRangeCount = 1;
+			pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
 			if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS)
 				throw std::runtime_error("Failed to create pipeline layout.");
@@ -723,7 +1309,8 @@ namespace Engine
 			depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 			depth_stencil_state.depthTestEnable = VK_TRUE;
 			depth_stencil_state.depthWriteEnable = VK_TRUE;
-			depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
+			// Each instance carries its own depth, only glyphs share one and then the last drawn wins.
+			depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
 			depth_stencil_state.depthBoundsTestEnable = VK_FALSE;
 			depth_stencil_state.stencilTestEnable = VK_FALSE;
 
@@ -738,38 +1325,234 @@ namespace Engine
 			pipeline_info.pMultisampleState = &multisampling_info;
 			pipeline_info.pDepthStencilState = &depth_stencil_state;
 			pipeline_info.pColorBlendState = &color_blend_info;
-			pipeline_info.pDynamicState = nullptr;
+			pipeline_info.pDynamicState = &dynamic_state_info;
 			pipeline_info.layout = pipeline_layout;
 			pipeline_info.renderPass = render_pass;
 			pipeline_info.subpass = 0;
 
-			if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS)
-				throw std::runtime_error("Failed to create graphics pipeline.");
+			// The opaque pipeline turns off the shader's alpha test, and with it blending.
+			VkBool32 alpha_test = VK_FALSE;
+			VkSpecializationMapEntry alpha_test_entry{ 0, 0, sizeof(VkBool32) };
+
+			VkSpecializationInfo opaque_specialization{};
+			opaque_specialization.mapEntryCount = 1;
+			opaque_specialization.pMapEntries = &alpha_test_entry;
+			opaque_specialization.dataSize = sizeof(VkBool32);
+			opaque_specialization.pData = &alpha_test;
+
+			std::array<VkPipelineShaderStageCreateInfo, 2> opaque_shader_stages = shader_stages;
+			opaque_shader_stages[1].pSpecializationInfo = &opaque_specialization;
+
+			VkPipelineColorBlendAttachmentState opaque_blend_attachment = color_blend_attachment;
+			opaque_blend_attachment.blendEnable = VK_FALSE;
+
+			VkPipelineColorBlendStateCreateInfo opaque_blend_info = color_blend_info;
+			opaque_blend_info.pAttachments = &opaque_blend_attachment;
+
+			VkGraphicsPipelineCreateInfo opaque_pipeline_info = pipeline_info;
+			opaque_pipeline_info.pStages = opaque_shader_stages.data();
+			opaque_pipeline_info.pColorBlendState = &opaque_blend_info;
 
+			std::array<VkPipelineShaderStageCreateInfo, 2> particle_shader_stages = shader_stages;
+			particle_shader_stages[0].module = particle_shader_module;
+
+			VkGraphicsPipelineCreateInfo particle_pipeline_info = pipeline_info;
+			particle_pipeline_info.pStages = particle_shader_stages.data();
+
+			std::array<VkGraphicsPipelineCreateInfo, 3> pipeline_infos{ pipeline_info, opaque_pipeline_info, particle_pipeline_info };
+			std::array<VkPipeline, 3> pipelines;
+
+			if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, uint32_t(pipeline_infos.size()), pipeline_infos.data(), nullptr, pipelines.data()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create graphics pipelines.");
+
+			graphics_pipeline = pipelines[0];
+			opaque_pipeline = pipelines[1];
+			particle_pipeline = pipelines[2];
+
+			vkDestroyShaderModule(device, particle_shader_module, nullptr);
 			vkDestroyShaderModule(device, fragment_shader_module, nullptr);
 			vkDestroyShaderModule(device, vertex_shader_module, nullptr);
 		}
 
+		VkFramebuffer CreateFramebuffer(VkRenderPass pass, VkImageView color_view, VkImageView depth_view, VkExtent2D extent)
+		{
+			std::array<VkImageView, 2> attachments{ color_view, depth_view };
+
+			VkFramebufferCreateInfo framebuffer_info{};
+			framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebuffer_info.renderPass = pass;
+			framebuffer_info.attachmentCount = uint32_t(attachments.size());
+			framebuffer_info.pAttachments = attachments.data();
+			framebuffer_info.width = extent.width;
+			framebuffer_info.height = extent.height;
+			framebuffer_info.layers = 1;
+
+			VkFramebuffer framebuffer;
+			if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &framebuffer) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create framebuffer.");
+
+			return framebuffer;
+		}
+
+		// Every pass draws to a color image and a depth image, the render graph's for any that are transient.
 		void CreateFramebuffers()
 		{
 			swap_chain_framebuffers.resize(swap_chain_image_views.size());
-
 			for (size_t i = 0; i < swap_chain_image_views.size(); i++)
-			{
-				std::array<VkImageView, 2> attachments{ swap_chain_image_views[i], depth_image_view };
+				swap_chain_framebuffers[i] = CreateFramebuffer(render_pass, swap_chain_image_views[i],
+					render_graph.GetImageView(depth_target), swap_chain_extent);
+
+			if (low_res)
+				low_res_framebuffer = CreateFramebuffer(low_res_render_pass, render_graph.GetImageView(low_res_target),
+					render_graph.GetImageView(low_res_depth_target), low_res_extent);
+
+			for (int i = 0; i < num_static_layers; ++i)
+				layer_caches[i].framebuffer = CreateFramebuffer(layer_render_pass, layer_caches[i].image_view,
+					render_graph.GetImageView(layer_depth_target), layer_extent);
+		}
+
+		void CreateLowResTarget()
+		{
+			if (!low_res)
+				return;
+
+			low_res_extent = { config.render_width, config.render_height };
+
+			low_res_target = render_graph.CreateTransientImage({ low_res_extent.width, low_res_extent.height, swap_chain_image_format,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT });
+			low_res_depth_target = render_graph.CreateTransientImage({ low_res_extent.width, low_res_extent.height, FindDepthFormat(),
+				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT });
+
+			// The largest whole number scale that fits, centred. A window smaller than the target just gets squashed.
+			uint32_t scale = std::max(1u, std::min(swap_chain_extent.width / low_res_extent.width, swap_chain_extent.height / low_res_extent.height));
+			upscale_extent.width = std::min(low_res_extent.width * scale, swap_chain_extent.width);
+			upscale_extent.height = std::min(low_res_extent.height * scale, swap_chain_extent.height);
+			upscale_offset.x = int32_t(swap_chain_extent.width - upscale_extent.width) / 2;
+			upscale_offset.y = int32_t(swap_chain_extent.height - upscale_extent.height) / 2;
+		}
+
+		// Nearest neighbour, so each target pixel becomes an exact square of window pixels.
+		// The render graph has the swap chain image ready to be written and the target ready to be read.
+		void RecordUpscale(VkCommandBuffer command_buffer, uint32_t image_index)
+		{
+			VkImage swap_chain_image = swap_chain_images[image_index];
+
+			// Borders left over from the whole number scale. The blit overwrites the rest, so it waits on the clear.
+			VkImageSubresourceRange range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			vkCmdClearColorImage(command_buffer, swap_chain_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_color, 1, &range);
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			VkImageBlit blit{};
+			blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			blit.srcOffsets[1] = { int32_t(low_res_extent.width), int32_t(low_res_extent.height), 1 };
+			blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			blit.dstOffsets[0] = { upscale_offset.x, upscale_offset.y, 0 };
+			blit.dstOffsets[1] = { upscale_offset.x + int32_t(upscale_extent.width), upscale_offset.y + int32_t(upscale_extent.height), 1 };
+
+			vkCmdBlitImage(command_buffer, render_graph.GetImage(low_res_target), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				swap_chain_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+		}
+
+		// Layer caches are sized from the world target, so their pixels match its pixels.
+		void CreateLayerCaches()
+		{
+			VkExtent2D world_extent = low_res ? low_res_extent : swap_chain_extent;
+			uint32_t max_size = physical_device_properties.limits.maxImageDimension2D;
+			float scale = 1.f + 2.f * LAYER_CACHE_MARGIN;
+			layer_extent.width = std::min(uint32_t(std::ceil(float(world_extent.width) * scale)), max_size);
+			layer_extent.height = std::min(uint32_t(std::ceil(float(world_extent.height) * scale)), max_size);
 
-				VkFramebufferCreateInfo framebuffer_info{};
-				framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-				framebuffer_info.renderPass = render_pass;
-				framebuffer_info.attachmentCount = uint32_t(attachments.size());
-				framebuffer_info.pAttachments = attachments.data();
-				framebuffer_info.width = swap_chain_extent.width;
-				framebuffer_info.height = swap_chain_extent.height;
-				framebuffer_info.layers = 1;
+			layer_depth_target = render_graph.CreateTransientImage({ layer_extent.width, layer_extent.height, FindDepthFormat(),
+				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT });
 
-				if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &swap_chain_framebuffers[i]) != VK_SUCCESS)
-					throw std::runtime_error("Failed to create framebuffer.");
+			for (int i = 0; i < num_static_layers; ++i)
+				CreateLayerImage(i);
+		}
+
+		// The caches themselves are kept from frame to frame, so they aren't transient.
+		void CreateLayerImage(int layer)
+		{
+			LayerCache & cache = layer_caches[layer];
+			CreateImage(layer_extent.width, layer_extent.height, swap_chain_image_format, VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				cache.image, cache.image_memory);
+			cache.image_view = CreateImageView(cache.image, swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT);
+			cache.resource = render_graph.ImportImage(cache.image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+			VkDescriptorImageInfo image_info{};
+			image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			image_info.imageView = cache.image_view;
+			image_info.sampler = texture_sampler;
+
+			VkWriteDescriptorSet descriptor_write{};
+			descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_write.dstSet = cache.texture_set;
+			descriptor_write.dstBinding = 0;
+			descriptor_write.dstArrayElement = 0;
+			descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptor_write.descriptorCount = 1;
+			descriptor_write.pImageInfo = &image_info;
+
+			vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+
+			// The new image is empty.
+			cache.half_size = glm::vec2(0);
+		}
+
+		void DestroyLayerImage(int layer)
+		{
+			LayerCache & cache = layer_caches[layer];
+			vkDestroyFramebuffer(device, cache.framebuffer, nullptr);
+			vkDestroyImageView(device, cache.image_view, nullptr);
+			vkDestroyImage(device, cache.image, nullptr);
+			vkFreeMemory(device, cache.image_memory, nullptr);
+			render_graph.Remove(cache.resource);
+		}
+
+		void CleanupLayerCaches()
+		{
+			for (int i = 0; i < num_static_layers; ++i)
+				DestroyLayerImage(i);
+		}
+
+		// Only layers that exist get a cache. A removed layer's cache goes once the frames drawing from it finish,
+		// and its slot is only waited on if a new layer needs the slot's descriptor sets before then.
+		void ResizeLayerCaches(int count)
+		{
+			for (int i = count; i < num_static_layers; ++i)
+			{
+				LayerCache & cache = layer_caches[i];
+				render_graph.Remove(cache.resource);
+				DestroyLater([framebuffer = cache.framebuffer, image_view = cache.image_view, image = cache.image, image_memory = cache.image_memory,
+					tile_buffer = cache.tile_buffer, tile_buffer_memory = cache.tile_buffer_memory]
+				{
+					vkDestroyFramebuffer(device, framebuffer, nullptr);
+					vkDestroyImageView(device, image_view, nullptr);
+					vkDestroyImage(device, image, nullptr);
+					vkFreeMemory(device, image_memory, nullptr);
+					vkUnmapMemory(device, tile_buffer_memory);
+					vkDestroyBuffer(device, tile_buffer, nullptr);
+					vkFreeMemory(device, tile_buffer_memory, nullptr);
+				});
+				cache.removed_value = timeline_value;
+			}
+
+			for (int i = num_static_layers; i < count; ++i)
+			{
+				WaitForTimeline(layer_caches[i].removed_value);
+				CreateLayerTileBuffer(i);
+				CreateLayerImage(i);
+				layer_caches[i].framebuffer = CreateFramebuffer(layer_render_pass, layer_caches[i].image_view,
+					render_graph.GetImageView(layer_depth_target), layer_extent);
 			}
+
+			num_static_layers = count;
 		}
 
 		void LoadTextures()
@@ -783,12 +1566,57 @@ namespace Engine
 			VkCommandPoolCreateInfo command_pool_info{};
 			command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 			command_pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
+			command_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 			if (vkCreateCommandPool(device, &command_pool_info, nullptr, &command_pool) != VK_SUCCESS)
 				throw std::runtime_error("Failed to create command pool.");
 		}
 
-		void CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize buffer_size)
+		// Recording threads outlive the swap chain, their command buffers are recorded fresh every frame.
+		void CreateRecordThreads()
+		{
+			int num_threads = config.record_threads > 0 ? config.record_threads : int(std::thread::hardware_concurrency());
+			num_threads = std::clamp(num_threads, 1, MAX_RECORD_THREADS);
+
+			QueueFamilyIndices queue_family_indices = FindQueueFamilies(physical_device);
+
+			// Pools are reset whole each frame rather than buffer by buffer.
+			VkCommandPoolCreateInfo command_pool_info{};
+			command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			command_pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
+			command_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			record_threads.resize(size_t(num_threads));
+			for (auto & thread : record_threads)
+				for (auto & pool : thread.pools)
+					if (vkCreateCommandPool(device, &command_pool_info, nullptr, &pool) != VK_SUCCESS)
+						throw std::runtime_error("Failed to create recording command pool.");
+
+			record_workers_running = true;
+			for (int thread = 1; thread < num_threads; ++thread)
+				record_workers.emplace_back(RecordWorkerLoop, thread);
+		}
+
+		void DestroyRecordThreads()
+		{
+			{
+				std::lock_guard<std::mutex> lock(record_mutex);
+				record_workers_running = false;
+			}
+			record_wake.notify_all();
+
+			for (auto & worker : record_workers)
+				worker.join();
+			record_workers.clear();
+
+			// Destroying a pool frees its command buffers.
+			for (auto & thread : record_threads)
+				for (auto pool : thread.pools)
+					vkDestroyCommandPool(device, pool, nullptr);
+			record_threads.clear();
+		}
+
+		uint64_t CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize buffer_size)
 		{
 			VkCommandBuffer cb;
 			BeginSingleTimeCommands(cb);
@@ -797,240 +1625,1219 @@ namespace Engine
 			copy_region.size = buffer_size;
 			vkCmdCopyBuffer(cb, src_buffer, dst_buffer, 1, &copy_region);
 
-			EndSingleTimeCommands(cb);
+			return EndSingleTimeCommands(cb);
 		}
 
-		void CreateVertexBuffer()
+		void CreateMeshBuffer()
 		{
-			VkDeviceSize buffer_size = sizeof(vertices[0]) * vertices.size();
-
-			VkBuffer staging_buffer;
-			VkDeviceMemory staging_buffer_memory;
+			VkDeviceSize buffer_size = sizeof(glm::vec2) * MESH_VERTICES * MAX_MESHES;
 
-			CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			CreateBuffer(buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				staging_buffer, staging_buffer_memory);
+				mesh_buffer, mesh_buffer_memory);
 
 			void * data;
-			vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-			memcpy(data, vertices.data(), size_t(buffer_size));
-			vkUnmapMemory(device, staging_buffer_memory);
+			vkMapMemory(device, mesh_buffer_memory, 0, buffer_size, 0, &data);
+			meshes_mapped = static_cast<glm::vec2 *>(data);
+
+			// Each quad corner twice, so its fan has degenerate triangles between them.
+			const std::array<glm::vec2, MESH_VERTICES> full_quad{ {
+				{ 0, 0 }, { 0, 0 }, { 1, 0 }, { 1, 0 }, { 1, 1 }, { 1, 1 }, { 0, 1 }, { 0, 1 } } };
+
+			num_meshes = 0;
+			free_meshes.clear();
+			AddMeshes(full_quad.data(), 1);
+		}
 
-			CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory);
+		uint32_t AddMeshes(const glm::vec2 * corners, int count)
+		{
+			uint32_t first_mesh;
+			auto range = std::find_if(free_meshes.begin(), free_meshes.end(), [count](const MeshRange & free) { return free.count >= count; });
+			if (range != free_meshes.end())
+			{
+				first_mesh = range->first;
+				range->first += uint32_t(count);
+				range->count -= count;
+				if (range->count == 0)
+					free_meshes.erase(range);
+			}
+			else
+			{
+				if (num_meshes + count > MAX_MESHES)
+					return FULL_MESH;
 
-			CopyBuffer(staging_buffer, vertex_buffer, buffer_size);
+				first_mesh = uint32_t(num_meshes);
+				num_meshes += count;
+			}
 
-			vkDestroyBuffer(device, staging_buffer, nullptr);
-			vkFreeMemory(device, staging_buffer_memory, nullptr);
+			// Nothing in flight reads free meshes or ones past the end, so there's no need to wait for the GPU.
+			std::copy_n(corners, size_t(count) * MESH_VERTICES, meshes_mapped + size_t(first_mesh) * MESH_VERTICES);
+			return first_mesh;
 		}
 
-		void CreateTextureSampler()
+		void ReleaseMeshes(uint32_t first_mesh, int count)
 		{
-			VkSamplerCreateInfo sampler_info{};
-			sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-			sampler_info.magFilter = VK_FILTER_NEAREST;
-			sampler_info.minFilter = VK_FILTER_NEAREST;
-			sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-			sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-			sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-			sampler_info.anisotropyEnable = VK_TRUE;
-			sampler_info.maxAnisotropy = physical_device_properties.limits.maxSamplerAnisotropy;
-			sampler_info.borderColor = VK_BORDER_COLOR_INT_TRANSPARENT_BLACK;
-			sampler_info.unnormalizedCoordinates = VK_FALSE;
-			sampler_info.compareEnable = VK_FALSE;
+			auto range = std::lower_bound(free_meshes.begin(), free_meshes.end(), first_mesh,
+				[](const MeshRange & free, uint32_t first) { return free.first < first; });
+			range = free_meshes.insert(range, { first_mesh, count });
+
+			// Joined with its neighbours, so a bigger texture can take the space of several smaller ones.
+			if (range + 1 != free_meshes.end() && range->first + range->count == (range + 1)->first)
+			{
+				range->count += (range + 1)->count;
+				free_meshes.erase(range + 1);
+			}
+			if (range != free_meshes.begin() && (range - 1)->first + (range - 1)->count == range->first)
+			{
+				(range - 1)->count += range->count;
+				free_meshes.erase(range);
+			}
+
+			if (!free_meshes.empty() && free_meshes.back().first + free_meshes.back().count == uint32_t(num_meshes))
+			{
+				num_meshes = int(free_meshes.back().first);
+				free_meshes.pop_back();
+			}
+		}
+
+		void CreateClipBuffer()
+		{
+			VkDeviceSize buffer_size = sizeof(ClipData) * MAX_CLIPS;
+
+			CreateBuffer(buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				clip_buffer, clip_buffer_memory);
+
+			void * data;
+			vkMapMemory(device, clip_buffer_memory, 0, buffer_size, 0, &data);
+			clips_mapped = static_cast<ClipData *>(data);
+		}
+
+		void WriteClip(int clip)
+		{
+			// Slots are only reused once the GPU is done with their last texture, so like meshes nothing in flight reads
+			// the slot being written.
+			const AnimationClip & animation = Texture::GetClip(clip);
+			glm::ivec2 num_images = animation.texture->GetNumImages();
+
+			clips_mapped[clip] = { uint32_t(animation.first_subsprite), uint32_t(animation.num_frames), animation.frame_rate,
+				uint32_t(animation.loop_mode), uint32_t(num_images.x), uint32_t(num_images.y), animation.texture->GetMesh(0), 0 };
+		}
+
+		void CreateTextureSampler()
+		{
+			VkSamplerCreateInfo sampler_info{};
+			sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			sampler_info.magFilter = VK_FILTER_NEAREST;
+			sampler_info.minFilter = VK_FILTER_NEAREST;
+			sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+			sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+			sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+			sampler_info.anisotropyEnable = VK_TRUE;
+			sampler_info.maxAnisotropy = physical_device_properties.limits.maxSamplerAnisotropy;
+			sampler_info.borderColor = VK_BORDER_COLOR_INT_TRANSPARENT_BLACK;
+			sampler_info.unnormalizedCoordinates = VK_FALSE;
+			sampler_info.compareEnable = VK_FALSE;
 			sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
 			sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 			sampler_info.mipLodBias = 0.0f;
 			sampler_info.minLod = 0.0f;
 			sampler_info.maxLod = 0.0f;
 
-			if (vkCreateSampler(device, &sampler_info, nullptr, &texture_sampler) != VK_SUCCESS)
-				throw std::runtime_error("Failed to create texture sampler.");
+			if (vkCreateSampler(device, &sampler_info, nullptr, &texture_sampler) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create texture sampler.");
+		}
+
+		void CreateIndexBuffer()
+		{
+			VkDeviceSize buffer_size = sizeof(indices[0]) * indices.size();
+
+			VkBuffer staging_buffer;
+			VkDeviceMemory staging_buffer_memory;
+
+			CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				staging_buffer, staging_buffer_memory);
+
+			void * data;
+			vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
+			memcpy(data, indices.data(), size_t(buffer_size));
+			vkUnmapMemory(device, staging_buffer_memory);
+
+			CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, index_buffer_memory);
+
+			uint64_t copied = CopyBuffer(staging_buffer, index_buffer, buffer_size);
+			DestroyLater([staging_buffer, staging_buffer_memory]
+			{
+				vkDestroyBuffer(device, staging_buffer, nullptr);
+				vkFreeMemory(device, staging_buffer_memory, nullptr);
+			}, copied);
+		}
+
+		// Stays mapped, instances are written straight into it each frame.
+		void CreateInstanceBuffers()
+		{
+			VkDeviceSize buffer_size = sizeof(InstanceBuffer);
+
+			instance_buffers.resize(SwapChainSize());
+			instance_buffers_memory.resize(SwapChainSize());
+			instance_buffers_mapped.resize(SwapChainSize());
+			instance_resources.resize(SwapChainSize());
+
+			for (size_t i = 0; i < SwapChainSize(); ++i)
+			{
+				CreateBuffer(buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					instance_buffers[i], instance_buffers_memory[i]);
+
+				void * data;
+				vkMapMemory(device, instance_buffers_memory[i], 0, buffer_size, 0, &data);
+				instance_buffers_mapped[i] = static_cast<InstanceBuffer *>(data);
+
+				// The sort writes depths into it on the GPU, which the draws must wait for.
+				instance_resources[i] = render_graph.ImportBuffer(instance_buffers[i]);
+			}
+
+			if (!gpu_sort)
+				return;
+
+			sort_buffers.resize(SwapChainSize());
+			sort_buffers_memory.resize(SwapChainSize());
+			sort_buffers_mapped.resize(SwapChainSize());
+
+			for (size_t i = 0; i < SwapChainSize(); ++i)
+			{
+				CreateBuffer(sizeof(SortBuffer), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					sort_buffers[i], sort_buffers_memory[i]);
+
+				void * data;
+				vkMapMemory(device, sort_buffers_memory[i], 0, sizeof(SortBuffer), 0, &data);
+				sort_buffers_mapped[i] = static_cast<SortBuffer *>(data);
+			}
+		}
+
+		void CreateDescriptorPool()
+		{
+			// An instance set per swap chain image, and a sort set reading its sort buffer and writing its instances.
+			uint32_t sets_per_image = gpu_sort ? 2 : 1;
+
+			VkDescriptorPoolSize pool_size{};
+			pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			pool_size.descriptorCount = uint32_t(SwapChainSize()) * (INSTANCE_SET_BUFFERS + (gpu_sort ? 2 : 0));
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = 1;
+			pool_info.pPoolSizes = &pool_size;
+			pool_info.maxSets = uint32_t(SwapChainSize()) * sets_per_image;
+
+			if (vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create descriptor pool.");
+		}
+
+		void CreateTextureDescriptorPool()
+		{
+			VkDescriptorPoolSize pool_size{};
+			pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			pool_size.descriptorCount = MAX_TEXTURES;
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = 1;
+			pool_info.pPoolSizes = &pool_size;
+			pool_info.maxSets = MAX_TEXTURES;
+			// Unloaded textures give their sets back.
+			pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+
+			if (vkCreateDescriptorPool(device, &pool_info, nullptr, &texture_descriptor_pool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create texture descriptor pool.");
+
+			texture_descriptor_sets.fill(VK_NULL_HANDLE);
+		}
+
+		// Sets for every layer slot, pointed at a layer's tile buffer and cache when it gets them.
+		void CreateLayerDescriptorSets()
+		{
+			std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+			pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			pool_sizes[0].descriptorCount = MAX_STATIC_LAYERS * INSTANCE_SET_BUFFERS;
+			pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			pool_sizes[1].descriptorCount = MAX_STATIC_LAYERS;
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = uint32_t(pool_sizes.size());
+			pool_info.pPoolSizes = pool_sizes.data();
+			pool_info.maxSets = MAX_STATIC_LAYERS * 2;
+
+			if (vkCreateDescriptorPool(device, &pool_info, nullptr, &layer_descriptor_pool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create static layer descriptor pool.");
+
+			for (auto & cache : layer_caches)
+			{
+				std::array<VkDescriptorSetLayout, 2> layouts{ descriptor_set_layout, texture_set_layout };
+				std::array<VkDescriptorSet, 2> sets;
+
+				VkDescriptorSetAllocateInfo allocate_info{};
+				allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+				allocate_info.descriptorPool = layer_descriptor_pool;
+				allocate_info.descriptorSetCount = uint32_t(layouts.size());
+				allocate_info.pSetLayouts = layouts.data();
+
+				if (vkAllocateDescriptorSets(device, &allocate_info, sets.data()) != VK_SUCCESS)
+					throw std::runtime_error("Failed to allocate static layer descriptor sets.");
+
+				cache.tile_set = sets[0];
+				cache.texture_set = sets[1];
+			}
+		}
+
+		// Tile buffers outlive the swap chain.
+		void CreateLayerTileBuffer(int layer)
+		{
+			LayerCache & cache = layer_caches[layer];
+			VkDeviceSize buffer_size = sizeof(InstanceBuffer);
+
+			CreateBuffer(buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				cache.tile_buffer, cache.tile_buffer_memory);
+
+			void * data;
+			vkMapMemory(device, cache.tile_buffer_memory, 0, buffer_size, 0, &data);
+			cache.tiles_mapped = static_cast<InstanceBuffer *>(data);
+
+			WriteInstanceSet(cache.tile_set, cache.tile_buffer);
+
+			cache.tiles_version = 0;
+		}
+
+		void DestroyLayerTileBuffer(int layer)
+		{
+			LayerCache & cache = layer_caches[layer];
+			vkUnmapMemory(device, cache.tile_buffer_memory);
+			vkDestroyBuffer(device, cache.tile_buffer, nullptr);
+			vkFreeMemory(device, cache.tile_buffer_memory, nullptr);
+		}
+
+		// Indices past the last texture are the static layer caches.
+		VkDescriptorSet GetTextureDescriptorSet(int texture)
+		{
+			if (texture >= MAX_TEXTURES)
+				return layer_caches[texture - MAX_TEXTURES].texture_set;
+
+			if (texture_descriptor_sets[texture] != VK_NULL_HANDLE)
+				return texture_descriptor_sets[texture];
+
+			VkImageView image_view = Texture::GetTexture(texture)->GetImageView();
+			if (image_view == VK_NULL_HANDLE)
+				throw std::runtime_error(std::format("Drawing with texture {}, which isn't loaded.", texture));
+
+			VkDescriptorSetAllocateInfo allocate_info{};
+			allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocate_info.descriptorPool = texture_descriptor_pool;
+			allocate_info.descriptorSetCount = 1;
+			allocate_info.pSetLayouts = &texture_set_layout;
+
+			VkDescriptorSet descriptor_set;
+			if (vkAllocateDescriptorSets(device, &allocate_info, &descriptor_set) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate texture descriptor set.");
+
+			VkDescriptorImageInfo image_info{};
+			image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			image_info.imageView = image_view;
+			image_info.sampler = texture_sampler;
+
+			VkWriteDescriptorSet descriptor_write{};
+			descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_write.dstSet = descriptor_set;
+			descriptor_write.dstBinding = 0;
+			descriptor_write.dstArrayElement = 0;
+			descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptor_write.descriptorCount = 1;
+			descriptor_write.pImageInfo = &image_info;
+
+			vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+
+			texture_descriptor_sets[texture] = descriptor_set;
+			return descriptor_set;
+		}
+
+		void ReleaseTextureDescriptorSet(int texture)
+		{
+			VkDescriptorSet descriptor_set = texture_descriptor_sets[texture];
+			if (descriptor_set == VK_NULL_HANDLE)
+				return;
+
+			texture_descriptor_sets[texture] = VK_NULL_HANDLE;
+			DestroyLater([descriptor_set] { vkFreeDescriptorSets(device, texture_descriptor_pool, 1, &descriptor_set); });
+		}
+
+		void CreateDescriptorSets()
+		{
+			std::pmr::vector<VkDescriptorSetLayout> layouts(SwapChainSize(), descriptor_set_layout, Memory::GetFrameResource());
+
+			VkDescriptorSetAllocateInfo allocate_info{};
+			allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocate_info.descriptorPool = descriptor_pool;
+			allocate_info.descriptorSetCount = int32_t(SwapChainSize());
+			allocate_info.pSetLayouts = layouts.data();
+
+			descriptor_sets.resize(SwapChainSize());
+			if (vkAllocateDescriptorSets(device, &allocate_info, descriptor_sets.data()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate descriptor sets.");
+
+			for (size_t i = 0; i < SwapChainSize(); ++i)
+				WriteInstanceSet(descriptor_sets[i], instance_buffers[i]);
+
+			if (!gpu_sort)
+				return;
+
+			std::pmr::vector<VkDescriptorSetLayout> sort_layouts(SwapChainSize(), sort_set_layout, Memory::GetFrameResource());
+			allocate_info.pSetLayouts = sort_layouts.data();
+
+			sort_sets.resize(SwapChainSize());
+			if (vkAllocateDescriptorSets(device, &allocate_info, sort_sets.data()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate sort descriptor sets.");
+
+			for (size_t i = 0; i < SwapChainSize(); ++i)
+			{
+				std::array<VkDescriptorBufferInfo, 2> buffer_infos{};
+				buffer_infos[0] = { sort_buffers[i], 0, VK_WHOLE_SIZE };
+				buffer_infos[1] = { instance_buffers[i], 0, VK_WHOLE_SIZE };
+
+				std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
+				for (uint32_t binding = 0; binding < descriptor_writes.size(); ++binding)
+				{
+					descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					descriptor_writes[binding].dstSet = sort_sets[i];
+					descriptor_writes[binding].dstBinding = binding;
+					descriptor_writes[binding].dstArrayElement = 0;
+					descriptor_writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					descriptor_writes[binding].descriptorCount = 1;
+					descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
+				}
+
+				vkUpdateDescriptorSets(device, uint32_t(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+			}
+		}
+
+		// Points a set 0 at its instances, or particles, and the shared meshes and clips.
+		void WriteInstanceSet(VkDescriptorSet set, VkBuffer instance_buffer)
+		{
+			std::array<VkDescriptorBufferInfo, INSTANCE_SET_BUFFERS> buffer_infos{};
+			buffer_infos[0].buffer = instance_buffer;
+			buffer_infos[1].buffer = mesh_buffer;
+			buffer_infos[2].buffer = clip_buffer;
+			for (auto & buffer_info : buffer_infos)
+			{
+				buffer_info.offset = 0;
+				buffer_info.range = VK_WHOLE_SIZE;
+			}
+
+			std::array<VkWriteDescriptorSet, INSTANCE_SET_BUFFERS> descriptor_writes{};
+			for (uint32_t binding = 0; binding < descriptor_writes.size(); ++binding)
+			{
+				descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptor_writes[binding].dstSet = set;
+				descriptor_writes[binding].dstBinding = binding;
+				descriptor_writes[binding].dstArrayElement = 0;
+				descriptor_writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				descriptor_writes[binding].descriptorCount = 1;
+				descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
+			}
+
+			vkUpdateDescriptorSets(device, uint32_t(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+		}
+
+		// Particle buffers and the compute pipelines that update them outlive the swap chain, only the draw pipeline doesn't.
+		void CreateParticleResources()
+		{
+			VkDeviceSize buffer_size = PARTICLE_HEADER_SIZE + PARTICLE_SIZE * MAX_PARTICLES;
+			for (size_t i = 0; i < particle_buffers.size(); ++i)
+				CreateBuffer(buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particle_buffers[i], particle_buffers_memory[i]);
+
+			// Both start empty, drawing the sprite index fan.
+			VkDrawIndexedIndirectCommand empty_draw{ uint32_t(indices.size()), 0, 0, 0, 0 };
+			VkCommandBuffer command_buffer;
+			BeginSingleTimeCommands(command_buffer);
+			for (VkBuffer buffer : particle_buffers)
+				vkCmdUpdateBuffer(command_buffer, buffer, 0, sizeof(empty_draw), &empty_draw);
+			EndSingleTimeCommands(command_buffer);
+			particle_source = 0;
+
+			for (size_t i = 0; i < particle_buffers.size(); ++i)
+				particle_resources[i] = render_graph.ImportBuffer(particle_buffers[i]);
+
+			for (size_t i = 0; i < particle_frame_buffers.size(); ++i)
+			{
+				CreateBuffer(sizeof(ParticleFrame), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					particle_frame_buffers[i], particle_frame_buffers_memory[i]);
+
+				void * data;
+				vkMapMemory(device, particle_frame_buffers_memory[i], 0, sizeof(ParticleFrame), 0, &data);
+				particle_frames_mapped[i] = static_cast<ParticleFrame *>(data);
+			}
+
+			// The particles read, the particles written, then the frame's emitters.
+			std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+			for (uint32_t binding = 0; binding < bindings.size(); ++binding)
+			{
+				bindings[binding].binding = binding;
+				bindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				bindings[binding].descriptorCount = 1;
+				bindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			}
+
+			VkDescriptorSetLayoutCreateInfo layout_info{};
+			layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layout_info.bindingCount = uint32_t(bindings.size());
+			layout_info.pBindings = bindings.data();
+
+			if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &particle_set_layout) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create particle descriptor set layout.");
+
+			VkPipelineLayoutCreateInfo pipeline_layout_info{};
+			pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pipeline_layout_info.setLayoutCount = 1;
+			pipeline_layout_info.pSetLayouts = &particle_set_layout;
+
+			if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &particle_compute_layout) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create particle pipeline layout.");
+
+			VkShaderModule simulate_shader_module = CreateShaderModule(ReadFile("shaders/particle_simulate.spv"));
+			VkShaderModule spawn_shader_module = CreateShaderModule(ReadFile("shaders/particle_spawn.spv"));
+
+			std::array<VkComputePipelineCreateInfo, 2> pipeline_infos{};
+			std::array<VkShaderModule, 2> shader_modules{ simulate_shader_module, spawn_shader_module };
+			for (size_t i = 0; i < pipeline_infos.size(); ++i)
+			{
+				pipeline_infos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+				pipeline_infos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+				pipeline_infos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+				pipeline_infos[i].stage.module = shader_modules[i];
+				pipeline_infos[i].stage.pName = "main";
+				pipeline_infos[i].layout = particle_compute_layout;
+			}
+
+			std::array<VkPipeline, 2> pipelines;
+			if (vkCreateComputePipelines(device, VK_NULL_HANDLE, uint32_t(pipeline_infos.size()), pipeline_infos.data(), nullptr, pipelines.data()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create particle compute pipelines.");
+
+			particle_simulate_pipeline = pipelines[0];
+			particle_spawn_pipeline = pipelines[1];
+
+			vkDestroyShaderModule(device, spawn_shader_module, nullptr);
+			vkDestroyShaderModule(device, simulate_shader_module, nullptr);
+
+			const uint32_t num_update_sets = uint32_t(MAX_FRAMES_IN_FLIGHT * 2);
+			const uint32_t num_draw_sets = uint32_t(particle_draw_sets.size());
+
+			VkDescriptorPoolSize pool_size{};
+			pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			pool_size.descriptorCount = num_update_sets * 3 + num_draw_sets * INSTANCE_SET_BUFFERS;
+
+			VkDescriptorPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.poolSizeCount = 1;
+			pool_info.pPoolSizes = &pool_size;
+			pool_info.maxSets = num_update_sets + num_draw_sets;
+
+			if (vkCreateDescriptorPool(device, &pool_info, nullptr, &particle_descriptor_pool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create particle descriptor pool.");
+
+			VkDescriptorSetAllocateInfo allocate_info{};
+			allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocate_info.descriptorPool = particle_descriptor_pool;
+			allocate_info.descriptorSetCount = 1;
+
+			for (size_t frame = 0; frame < particle_update_sets.size(); ++frame)
+				for (size_t source = 0; source < particle_buffers.size(); ++source)
+				{
+					VkDescriptorSet & set = particle_update_sets[frame][source];
+					allocate_info.pSetLayouts = &particle_set_layout;
+					if (vkAllocateDescriptorSets(device, &allocate_info, &set) != VK_SUCCESS)
+						throw std::runtime_error("Failed to allocate particle descriptor sets.");
+
+					std::array<VkDescriptorBufferInfo, 3> buffer_infos{};
+					buffer_infos[0] = { particle_buffers[source], 0, VK_WHOLE_SIZE };
+					buffer_infos[1] = { particle_buffers[1 - source], 0, VK_WHOLE_SIZE };
+					buffer_infos[2] = { particle_frame_buffers[frame], 0, VK_WHOLE_SIZE };
+
+					std::array<VkWriteDescriptorSet, 3> descriptor_writes{};
+					for (uint32_t binding = 0; binding < descriptor_writes.size(); ++binding)
+					{
+						descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+						descriptor_writes[binding].dstSet = set;
+						descriptor_writes[binding].dstBinding = binding;
+						descriptor_writes[binding].dstArrayElement = 0;
+						descriptor_writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+						descriptor_writes[binding].descriptorCount = 1;
+						descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
+					}
+
+					vkUpdateDescriptorSets(device, uint32_t(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+				}
+
+			// Drawn with the sprites' set layout, the particle buffer standing in for the instances.
+			for (size_t i = 0; i < particle_draw_sets.size(); ++i)
+			{
+				allocate_info.pSetLayouts = &descriptor_set_layout;
+				if (vkAllocateDescriptorSets(device, &allocate_info, &particle_draw_sets[i]) != VK_SUCCESS)
+					throw std::runtime_error("Failed to allocate particle descriptor sets.");
+
+				WriteInstanceSet(particle_draw_sets[i], particle_buffers[i]);
+			}
+		}
+
+		// The sort's pipelines outlive the swap chain, its buffers and sets don't. Devices that can't run a group per
+		// 256 keys sort on the CPU instead.
+		void CreateSortPipelines()
+		{
+			const auto & limits = physical_device_properties.limits;
+			gpu_sort = config.gpu_sort && limits.maxComputeWorkGroupSize[0] >= SORT_GROUP_SIZE
+				&& limits.maxComputeWorkGroupInvocations >= SORT_GROUP_SIZE;
+			if (!gpu_sort)
+				return;
+
+			// The sort buffer, then the instances it writes depths to.
+			std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+			for (uint32_t binding = 0; binding < bindings.size(); ++binding)
+			{
+				bindings[binding].binding = binding;
+				bindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				bindings[binding].descriptorCount = 1;
+				bindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			}
+
+			VkDescriptorSetLayoutCreateInfo layout_info{};
+			layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layout_info.bindingCount = uint32_t(bindings.size());
+			layout_info.pBindings = bindings.data();
+
+			if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &sort_set_layout) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create sort descriptor set layout.");
+
+			VkPushConstantRange push_constant_range{};
+			push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			push_constant_range.offset = 0;
+			push_constant_range.size = sizeof(SortPass);
+
+			VkPipelineLayoutCreateInfo pipeline_layout_info{};
+			pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pipeline_layout_info.setLayoutCount = 1;
+			pipeline_layout_info.pSetLayouts = &sort_set_layout;
+			pipeline_layout_info.pushConstantRangeCount = 1;
+			pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+			if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &sort_layout) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create sort pipeline layout.");
+
+			std::array<VkShaderModule, 3> shader_modules{
+				CreateShaderModule(ReadFile("shaders/sort_count.spv")),
+				CreateShaderModule(ReadFile("shaders/sort_scan.spv")),
+				CreateShaderModule(ReadFile("shaders/sort_scatter.spv"))
+			};
+
+			std::array<VkComputePipelineCreateInfo, 3> pipeline_infos{};
+			for (size_t i = 0; i < pipeline_infos.size(); ++i)
+			{
+				pipeline_infos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+				pipeline_infos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+				pipeline_infos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+				pipeline_infos[i].stage.module = shader_modules[i];
+				pipeline_infos[i].stage.pName = "main";
+				pipeline_infos[i].layout = sort_layout;
+			}
+
+			std::array<VkPipeline, 3> pipelines;
+			if (vkCreateComputePipelines(device, VK_NULL_HANDLE, uint32_t(pipeline_infos.size()), pipeline_infos.data(), nullptr, pipelines.data()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create sort compute pipelines.");
+
+			sort_count_pipeline = pipelines[0];
+			sort_scan_pipeline = pipelines[1];
+			sort_scatter_pipeline = pipelines[2];
+
+			for (auto module : shader_modules)
+				vkDestroyShaderModule(device, module, nullptr);
+		}
+
+		void CreateCommandBuffers()
+		{
+			command_buffers.resize(swap_chain_framebuffers.size());
+
+			VkCommandBufferAllocateInfo allocate_info{};
+			allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocate_info.commandPool = command_pool;
+			allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocate_info.commandBufferCount = (uint32_t)command_buffers.size();
+
+			if (vkAllocateCommandBuffers(device, &allocate_info, command_buffers.data()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate command buffers.");
+		}
+
+		// Ages and moves last frame's particles into particle_source, dropping the dead, then spawns this frame's after them.
+		// The render graph orders it after the last frame to draw either buffer, and the draws after it.
+		void RecordParticleUpdate(VkCommandBuffer command_buffer)
+		{
+			int previous = 1 - particle_source;
+
+			vkCmdFillBuffer(command_buffer, particle_buffers[particle_source], offsetof(VkDrawIndexedIndirectCommand, instanceCount), sizeof(uint32_t), 0);
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			VkDescriptorSet set = particle_update_sets[current_frame][previous];
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_compute_layout, 0, 1, &set, 0, nullptr);
+
+			// The live count is only known on the GPU, so every slot gets a thread and the ones past it return.
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_simulate_pipeline);
+			vkCmdDispatch(command_buffer, MAX_PARTICLES / PARTICLE_GROUP_SIZE, 1, 1);
+
+			if (particle_spawn_count > 0)
+			{
+				// Spawns append to the same count the survivors did.
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_spawn_pipeline);
+				vkCmdDispatch(command_buffer, (particle_spawn_count + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+			}
+		}
+
+		// Adds jobs drawing the batches of one layer, split evenly between threads when there are enough to go round.
+		void AddRecordJobs(VkRenderPass pass, VkFramebuffer framebuffer, VkExtent2D extent, VkDescriptorSet instance_set,
+			const glm::mat4 & view_projection, const std::vector<Batch> & pass_batches, RenderQueue::Layer layer, bool particles)
+		{
+			// Batches are sorted by layer first, so each layer's are together.
+			auto is_layer = [layer](const Batch & batch) { return batch.layer == layer; };
+			size_t first = size_t(std::find_if(pass_batches.begin(), pass_batches.end(), is_layer) - pass_batches.begin());
+			size_t end = size_t(std::find_if_not(pass_batches.begin() + first, pass_batches.end(), is_layer) - pass_batches.begin());
+
+			size_t count = end - first;
+			size_t num_jobs = std::clamp(count / MIN_BATCHES_PER_JOB, size_t(1), record_threads.size());
+			for (size_t job = 0; job < num_jobs; ++job)
+				record_jobs.push_back({ pass, framebuffer, extent, instance_set, view_projection, &pass_batches,
+					first + count * job / num_jobs, first + count * (job + 1) / num_jobs, particles && job == num_jobs - 1 });
+		}
+
+		// Each pass counts every group's keys by digit, works out where each group's keys of each digit go, then moves them.
+		void RecordObjectSort(VkCommandBuffer command_buffer, uint32_t image_index)
+		{
+			uint32_t groups = (sort_buffers_mapped[image_index]->count + SORT_GROUP_SIZE - 1) / SORT_GROUP_SIZE;
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			auto wait_for_last_dispatch = [&]
+			{
+				vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, 1, &barrier, 0, nullptr, 0, nullptr);
+			};
+
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sort_layout, 0, 1, &sort_sets[image_index], 0, nullptr);
+
+			for (uint32_t pass = 0; pass < num_sort_passes; ++pass)
+			{
+				if (pass > 0)
+					wait_for_last_dispatch();
+
+				vkCmdPushConstants(command_buffer, sort_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SortPass), &sort_passes[pass]);
+
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sort_count_pipeline);
+				vkCmdDispatch(command_buffer, groups, 1, 1);
+				wait_for_last_dispatch();
+
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sort_scan_pipeline);
+				vkCmdDispatch(command_buffer, 1, 1, 1);
+				wait_for_last_dispatch();
+
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sort_scatter_pipeline);
+				vkCmdDispatch(command_buffer, groups, 1, 1);
+			}
+		}
+
+		// Re-recorded every frame, since the batches change with the objects being drawn. The draws themselves are
+		// recorded into secondary buffers by every recording thread, the primary buffer only runs them in the render
+		// graph's passes.
+		void RecordCommandBuffer(uint32_t image_index)
+		{
+			Trace::Scope scope("Graphics::RecordCommandBuffer");
+
+			record_jobs.clear();
+
+			// The update writes the buffer last frame's read from, and this frame draws what it writes.
+			if (particles_active)
+				particle_source = 1 - particle_source;
+
+			// Stale caches are redrawn from their own tile buffers before anything samples them.
+			for (int i = 0; i < num_static_layers; ++i)
+			{
+				LayerCache & cache = layer_caches[i];
+				if (cache.redraw)
+					AddRecordJobs(layer_render_pass, cache.framebuffer, layer_extent, cache.tile_set, cache.view_projection,
+						cache.batches, RenderQueue::Layer::World, false);
+			}
+
+			VkDescriptorSet instance_set = descriptor_sets[image_index];
+			VkFramebuffer swap_chain_framebuffer = swap_chain_framebuffers[image_index];
+			if (low_res)
+			{
+				AddRecordJobs(low_res_render_pass, low_res_framebuffer, low_res_extent, instance_set, world_view_projection,
+					batches, RenderQueue::Layer::World, particles_active);
+				AddRecordJobs(overlay_render_pass, swap_chain_framebuffer, swap_chain_extent, instance_set, overlay_view_projection,
+					batches, RenderQueue::Layer::Overlay, false);
+			}
+			else
+			{
+				AddRecordJobs(render_pass, swap_chain_framebuffer, swap_chain_extent, instance_set, world_view_projection,
+					batches, RenderQueue::Layer::World, particles_active);
+				AddRecordJobs(render_pass, swap_chain_framebuffer, swap_chain_extent, instance_set, overlay_view_projection,
+					batches, RenderQueue::Layer::Overlay, false);
+			}
+
+			// Texture sets are allocated the first time they're asked for, which only this thread may do.
+			for (const auto & job : record_jobs)
+			{
+				for (size_t i = job.first_batch; i < job.end_batch; ++i)
+					GetTextureDescriptorSet((*job.batches)[i].texture);
+				if (job.particles)
+					GetTextureDescriptorSet(ParticleEmitter::GetTexture()->GetIndex());
+			}
+
+			RunRecordJobs();
+
+			VkCommandBuffer command_buffer = command_buffers[image_index];
+
+			VkCommandBufferBeginInfo begin_info{};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+			if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+				throw std::runtime_error("Failed to begin recording command buffer.");
+
+			if (timestamp_pool != VK_NULL_HANDLE)
+			{
+				vkCmdResetQueryPool(command_buffer, timestamp_pool, image_index * 2, 2);
+				vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool, image_index * 2);
+			}
+
+			// Submitted waiting on the image being acquired, at the stage the first pass to use it starts from.
+			render_graph.Acquired(swap_chain_resources[image_index], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+			DeclareFrame(image_index);
+			render_graph.Execute(command_buffer);
+
+			if (timestamp_pool != VK_NULL_HANDLE)
+				vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool, image_index * 2 + 1);
+
+			if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+				throw std::runtime_error("Failed to record command buffer.");
+		}
+
+		// The same passes every frame, with any that have nothing to draw disabled, since the render graph allocated its
+		// transient images from them. The passes only look up their framebuffers and jobs once they're recorded.
+		void DeclareFrame(uint32_t image_index)
+		{
+			using Usage = RenderGraph::Usage;
+			RenderGraph::Resource swap_chain_resource = swap_chain_resources[image_index];
+
+			int sort = render_graph.AddPass("Object sort", [image_index](VkCommandBuffer command_buffer)
+			{
+				RecordObjectSort(command_buffer, image_index);
+			}, num_sort_passes > 0);
+			render_graph.Use(sort, instance_resources[image_index], Usage::ComputeWrite);
+
+			int particles = render_graph.AddPass("Particles", RecordParticleUpdate, particles_active);
+			render_graph.Use(particles, particle_resources[1 - particle_source], Usage::ComputeRead);
+			render_graph.Use(particles, particle_resources[particle_source], Usage::TransferWrite);
+			render_graph.Use(particles, particle_resources[particle_source], Usage::ComputeWrite);
+
+			for (int i = 0; i < MAX_STATIC_LAYERS; ++i)
+			{
+				int layer = render_graph.AddPass("Static layer", [i](VkCommandBuffer command_buffer)
+				{
+					const VkClearColorValue transparent{ { 0, 0, 0, 0 } };
+					LayerCache & cache = layer_caches[i];
+					ExecuteJobs(command_buffer, layer_render_pass, cache.framebuffer, layer_extent, transparent);
+					cache.redraw = false;
+					cache.drawn_value = frame_values[current_frame];
+					++Stats::Current().layer_redraws;
+				}, i < num_static_layers && layer_caches[i].redraw);
+				if (i < num_static_layers)
+					render_graph.Use(layer, layer_caches[i].resource, Usage::ColorAttachment, true);
+				render_graph.Use(layer, layer_depth_target, Usage::DepthAttachment, true);
+			}
+
+			int world = render_graph.AddPass("World", [image_index](VkCommandBuffer command_buffer)
+			{
+				if (low_res)
+					ExecuteJobs(command_buffer, low_res_render_pass, low_res_framebuffer, low_res_extent, clear_color);
+				else
+					ExecuteJobs(command_buffer, render_pass, swap_chain_framebuffers[image_index], swap_chain_extent, clear_color);
+			});
+			render_graph.Use(world, low_res ? low_res_target : swap_chain_resource, Usage::ColorAttachment, true);
+			render_graph.Use(world, low_res ? low_res_depth_target : depth_target, Usage::DepthAttachment, true);
+			render_graph.Use(world, instance_resources[image_index], Usage::VertexStorageRead);
+			for (int i = 0; i < num_static_layers; ++i)
+				render_graph.Use(world, layer_caches[i].resource, Usage::FragmentSampled);
+			if (particles_active)
+			{
+				render_graph.Use(world, particle_resources[particle_source], Usage::IndirectRead);
+				render_graph.Use(world, particle_resources[particle_source], Usage::VertexStorageRead);
+			}
+
+			// The world target is scaled up into the swap chain image before the overlay is drawn over it.
+			if (low_res)
+			{
+				int upscale = render_graph.AddPass("Upscale", [image_index](VkCommandBuffer command_buffer) { RecordUpscale(command_buffer, image_index); });
+				render_graph.Use(upscale, low_res_target, Usage::TransferRead);
+				render_graph.Use(upscale, swap_chain_resource, Usage::TransferWrite, true);
+
+				int overlay = render_graph.AddPass("Overlay", [image_index](VkCommandBuffer command_buffer)
+				{
+					ExecuteJobs(command_buffer, overlay_render_pass, swap_chain_framebuffers[image_index], swap_chain_extent, clear_color);
+				});
+				render_graph.Use(overlay, swap_chain_resource, Usage::ColorAttachment);
+				render_graph.Use(overlay, depth_target, Usage::DepthAttachment, true);
+			}
+
+			int present = render_graph.AddPass("Present", nullptr);
+			render_graph.Use(present, swap_chain_resource, Usage::Present);
+		}
+
+		// Runs the jobs drawing to a framebuffer in one render pass, in the order they were added.
+		void ExecuteJobs(VkCommandBuffer command_buffer, VkRenderPass pass, VkFramebuffer framebuffer, VkExtent2D extent, VkClearColorValue color)
+		{
+			std::array<VkClearValue, 2> clear_values;
+			clear_values[0].color = color;
+			clear_values[1].depthStencil = { 1.f, 0 };
+
+			VkRenderPassBeginInfo render_pass_info{};
+			render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			render_pass_info.renderPass = pass;
+			render_pass_info.framebuffer = framebuffer;
+			render_pass_info.renderArea.offset = { 0, 0 };
+			render_pass_info.renderArea.extent = extent;
+			render_pass_info.clearValueCount = uint32_t(clear_values.size());
+			render_pass_info.pClearValues = clear_values.data();
+
+			vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+			auto & stats = Stats::Current();
+			for (const auto & job : record_jobs)
+				if (job.framebuffer == framebuffer)
+				{
+					vkCmdExecuteCommands(command_buffer, 1, &job.command_buffer);
+					stats.draw_calls += job.draw_calls;
+				}
+
+			vkCmdEndRenderPass(command_buffer);
 		}
 
-		void CreateIndexBuffer()
+		void RunRecordJobs()
 		{
-			VkDeviceSize buffer_size = sizeof(indices[0]) * indices.size();
+			Trace::Scope scope("Graphics::RunRecordJobs");
 
-			VkBuffer staging_buffer;
-			VkDeviceMemory staging_buffer_memory;
+			// The fence for this frame has been waited on, so nothing recorded from these pools is still in use.
+			for (auto & thread : record_threads)
+			{
+				vkResetCommandPool(device, thread.pools[current_frame], 0);
+				thread.num_used = 0;
+			}
 
-			CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				staging_buffer, staging_buffer_memory);
+			next_record_job = 0;
 
-			void * data;
-			vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-			memcpy(data, indices.data(), size_t(buffer_size));
-			vkUnmapMemory(device, staging_buffer_memory);
+			// A single job isn't worth waking anyone for.
+			bool parallel = record_jobs.size() > 1 && !record_workers.empty();
+			if (parallel)
+			{
+				{
+					std::lock_guard<std::mutex> lock(record_mutex);
+					++record_round;
+					record_workers_busy = int(record_workers.size());
+				}
+				record_wake.notify_all();
+			}
 
-			CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, index_buffer_memory);
+			if (!parallel)
+			{
+				RecordJobs(0);
+				return;
+			}
+
+			// The workers are still recording into this frame's pools and jobs, so wait for them before throwing.
+			std::exception_ptr error;
+			try
+			{
+				RecordJobs(0);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+				next_record_job = record_jobs.size();
+			}
 
-			CopyBuffer(staging_buffer, index_buffer, buffer_size);
+			std::unique_lock<std::mutex> lock(record_mutex);
+			record_done.wait(lock, [] { return record_workers_busy == 0; });
 
-			vkDestroyBuffer(device, staging_buffer, nullptr);
-			vkFreeMemory(device, staging_buffer_memory, nullptr);
+			if (!error)
+				error = std::exchange(record_error, nullptr);
+			record_error = nullptr;
+			if (error)
+				std::rethrow_exception(error);
 		}
 
-		void CreateUniformBuffers()
+		void RecordJobs(int thread)
 		{
-			VkDeviceSize buffer_size = sizeof(UniformBufferObject);
-
-			uniform_buffers.resize(SwapChainSize());
-			uniform_buffers_memory.resize(SwapChainSize());
-
-			for (size_t i = 0; i < SwapChainSize(); ++i)
-				CreateBuffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					uniform_buffers[i], uniform_buffers_memory[i]);
+			for (size_t job = next_record_job++; job < record_jobs.size(); job = next_record_job++)
+				RecordSecondary(thread, job);
 		}
 
-		void CreateDescriptorPool()
+		// Secondary buffers only inherit the render pass, so each job binds everything it draws with.
+		void RecordSecondary(int thread, size_t job_index)
 		{
-			std::array<VkDescriptorPoolSize, 2> pool_sizes{};
-			pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			pool_sizes[0].descriptorCount = uint32_t(SwapChainSize());
-			pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			pool_sizes[1].descriptorCount = uint32_t(SwapChainSize());
+			RecordJob & job = record_jobs[job_index];
+			RecordThread & recorder = record_threads[thread];
+			auto & thread_buffers = recorder.command_buffers[current_frame];
 
-			VkDescriptorPoolCreateInfo pool_info{};
-			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-			pool_info.poolSizeCount = uint32_t(pool_sizes.size());
-			pool_info.pPoolSizes = pool_sizes.data();
-			pool_info.maxSets = uint32_t(SwapChainSize());
+			if (recorder.num_used == thread_buffers.size())
+			{
+				VkCommandBufferAllocateInfo allocate_info{};
+				allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				allocate_info.commandPool = recorder.pools[current_frame];
+				allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				allocate_info.commandBufferCount = 1;
+
+				VkCommandBuffer new_buffer;
+				if (vkAllocateCommandBuffers(device, &allocate_info, &new_buffer) != VK_SUCCESS)
+					throw std::runtime_error("Failed to allocate secondary command buffer.");
+				thread_buffers.push_back(new_buffer);
+			}
 
-			if (vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS)
-				throw std::runtime_error("Failed to create descriptor pool.");
-		}
+			VkCommandBuffer command_buffer = thread_buffers[recorder.num_used++];
 
-		void CreateDescriptorSets()
-		{
-			std::vector<VkDescriptorSetLayout> layouts(SwapChainSize(), descriptor_set_layout);
+			VkCommandBufferInheritanceInfo inheritance_info{};
+			inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritance_info.renderPass = job.render_pass;
+			inheritance_info.subpass = 0;
+			inheritance_info.framebuffer = job.framebuffer;
 
-			VkDescriptorSetAllocateInfo allocate_info{};
-			allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-			allocate_info.descriptorPool = descriptor_pool;
-			allocate_info.descriptorSetCount = int32_t(SwapChainSize());
-			allocate_info.pSetLayouts = layouts.data();
+			VkCommandBufferBeginInfo begin_info{};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			begin_info.pInheritanceInfo = &inheritance_info;
 
-			descriptor_sets.resize(SwapChainSize());
-			if (vkAllocateDescriptorSets(device, &allocate_info, descriptor_sets.data()) != VK_SUCCESS)
-				throw std::runtime_error("Failed to allocate descriptor sets.");
+			if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+				throw std::runtime_error("Failed to begin recording secondary command buffer.");
 
-			for (size_t i = 0; i < SwapChainSize(); ++i)
+			VkViewport viewport{ 0, 0, float(job.extent.width), float(job.extent.height), 0, 1 };
+			VkRect2D scissor{ { 0, 0 }, job.extent };
+			vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+			vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+			vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &job.instance_set, 0, nullptr);
+
+			PushConstants push_constants{ job.view_projection, float(GetTimeElapsed()) };
+			vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &push_constants);
+
+			// Batches come sorted, so the pipeline and texture only change between runs.
+			VkPipeline bound_pipeline = VK_NULL_HANDLE;
+			VkDescriptorSet bound_texture_set = VK_NULL_HANDLE;
+			uint32_t draw_calls = 0;
+			for (size_t i = job.first_batch; i < job.end_batch; ++i)
 			{
-				VkDescriptorBufferInfo buffer_info{};
-				buffer_info.buffer = uniform_buffers[i];
-				buffer_info.offset = 0;
-				buffer_info.range = sizeof(UniformBufferObject);
+				const Batch & batch = (*job.batches)[i];
 
-				VkDescriptorImageInfo image_info{};
-				image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				image_info.imageView = Texture::GetTexture(0)->GetImageView();
-				image_info.sampler = texture_sampler;
+				VkPipeline pipeline = batch.pipeline == RenderQueue::Pipeline::Opaque ? opaque_pipeline : graphics_pipeline;
+				if (pipeline != bound_pipeline)
+				{
+					vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+					bound_pipeline = pipeline;
+				}
 
-				std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
-				descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptor_writes[0].dstSet = descriptor_sets[i];
-				descriptor_writes[0].dstBinding = 0;
-				descriptor_writes[0].dstArrayElement = 0;
-				descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-				descriptor_writes[0].descriptorCount = 1;
-				descriptor_writes[0].pBufferInfo = &buffer_info;
-
-				descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptor_writes[1].dstSet = descriptor_sets[i];
-				descriptor_writes[1].dstBinding = 1;
-				descriptor_writes[1].dstArrayElement = 0;
-				descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-				descriptor_writes[1].descriptorCount = 1;
-				descriptor_writes[1].pImageInfo = &image_info;
+				VkDescriptorSet texture_set = GetTextureDescriptorSet(batch.texture);
+				if (texture_set != bound_texture_set)
+				{
+					vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &texture_set, 0, nullptr);
+					bound_texture_set = texture_set;
+				}
 
-				vkUpdateDescriptorSets(device, uint32_t(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+				vkCmdDrawIndexed(command_buffer, uint32_t(indices.size()), batch.instance_count, 0, 0, batch.first_instance);
+				++draw_calls;
 			}
+
+			if (job.particles)
+			{
+				// However many particles the update left, without the CPU ever reading the count.
+				VkDescriptorSet texture_set = GetTextureDescriptorSet(ParticleEmitter::GetTexture()->GetIndex());
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particle_pipeline);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &particle_draw_sets[particle_source], 0, nullptr);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &texture_set, 0, nullptr);
+				vkCmdDrawIndexedIndirect(command_buffer, particle_buffers[particle_source], 0, 1, 0);
+				++draw_calls;
+			}
+
+			if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+				throw std::runtime_error("Failed to record secondary command buffer.");
+
+			job.command_buffer = command_buffer;
+			job.draw_calls = draw_calls;
 		}
 
-		void CreateCommandBuffers()
+		void RecordWorkerLoop(int thread)
 		{
-			std::array<VkClearValue, 2> clear_values;
-			clear_values[0].color = clear_color;
-			clear_values[1].depthStencil = { 1.f, 0 };
-
-			command_buffers.resize(swap_chain_framebuffers.size());
+			uint64_t round = 0;
+			std::unique_lock<std::mutex> lock(record_mutex);
+			while (true)
+			{
+				record_wake.wait(lock, [&] { return !record_workers_running || record_round != round; });
+				if (!record_workers_running)
+					return;
 
-			VkCommandBufferAllocateInfo allocate_info{};
-			allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-			allocate_info.commandPool = command_pool;
-			allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-			allocate_info.commandBufferCount = (uint32_t)command_buffers.size();
+				round = record_round;
+				lock.unlock();
 
-			if (vkAllocateCommandBuffers(device, &allocate_info, command_buffers.data()) != VK_SUCCESS)
-				throw std::runtime_error("Failed to allocate command buffers.");
+				// Thrown again on the main thread, once every worker is done with the jobs.
+				std::exception_ptr error;
+				try
+				{
+					RecordJobs(thread);
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
 
-			for (size_t i = 0; i < command_buffers.size(); ++i)
-			{
-				VkRenderPassBeginInfo render_pass_info{};
-				render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-				render_pass_info.renderPass = render_pass;
-				render_pass_info.framebuffer = swap_chain_framebuffers[i];
-				render_pass_info.renderArea.offset = { 0, 0 };
-				render_pass_info.renderArea.extent = swap_chain_extent;
-				render_pass_info.clearValueCount = uint32_t(clear_values.size());
-				render_pass_info.pClearValues = clear_values.data();
+				lock.lock();
+				if (error && !record_error)
+					record_error = error;
+				if (--record_workers_busy == 0)
+					record_done.notify_one();
+			}
+		}
 
-				VkCommandBufferBeginInfo begin_info{};
-				begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-				begin_info.flags = 0;
+		void CreateTimestampPool()
+		{
+			timestamp_pool = VK_NULL_HANDLE;
+			gpu_frame_time = 0;
 
-				std::array<VkBuffer, 1> vertex_buffers{ vertex_buffer };
-				std::array<VkDeviceSize, 1> offsets{ 0 };
+			// GPU timings are optional, without support they just read as zero.
+			if (!physical_device_properties.limits.timestampComputeAndGraphics)
+				return;
 
-				if (vkBeginCommandBuffer(command_buffers[i], &begin_info) != VK_SUCCESS)
-					throw std::runtime_error("Failed to begin recording command buffer.");
+			VkQueryPoolCreateInfo query_pool_info{};
+			query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			query_pool_info.queryCount = SwapChainSize() * 2;
 
-				vkCmdBeginRenderPass(command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+			if (vkCreateQueryPool(device, &query_pool_info, nullptr, &timestamp_pool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create timestamp query pool.");
+		}
 
-				vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
-				vkCmdBindVertexBuffers(command_buffers[i], 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
-				vkCmdBindIndexBuffer(command_buffers[i], index_buffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdBindDescriptorSets(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets[i], 0, nullptr);
-				vkCmdDrawIndexed(command_buffers[i], uint32_t(indices.size()), MAX_SPRITES, 0, 0, 0);
+		void ReadTimestamps(uint32_t image_index)
+		{
+			if (timestamp_pool == VK_NULL_HANDLE)
+				return;
 
-				vkCmdEndRenderPass(command_buffers[i]);
+			std::array<uint64_t, 2> timestamps{};
+			if (vkGetQueryPoolResults(device, timestamp_pool, image_index * 2, 2, sizeof(timestamps), timestamps.data(),
+				sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+				return;
 
-				if (vkEndCommandBuffer(command_buffers[i]) != VK_SUCCESS)
-					throw std::runtime_error("Failed to record command buffer.");
-			}
+			gpu_frame_time = float(double(timestamps[1] - timestamps[0]) * physical_device_properties.limits.timestampPeriod * 1e-9);
 		}
 
 		void CreateSyncObjects()
 		{
-			image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-			render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-			in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-			images_in_flight.resize(SwapChainSize(), VK_NULL_HANDLE);
+			size_t frames_in_flight = size_t(std::clamp(config.frames_in_flight, 1, MAX_FRAMES_IN_FLIGHT));
+			image_available_semaphores.resize(frames_in_flight);
+			render_finished_semaphores.resize(frames_in_flight);
+			frame_values.assign(frames_in_flight, 0);
+			image_values.assign(SwapChainSize(), 0);
 
 			VkSemaphoreCreateInfo semaphore_info{};
 			semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-			VkFenceCreateInfo fence_info{};
-			fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-			fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-			for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+			for (size_t i = 0; i < frames_in_flight; i++)
 			{
 				if (vkCreateSemaphore(device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
-					vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
-					vkCreateFence(device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS)
+					vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS)
 				{
 					throw std::runtime_error("Failed to create synchronization objects for a frame.");
 				}
 			}
 		}
 
-		VkShaderModule CreateShaderModule(const std::vector<char> & code)
+		// Made before anything is uploaded, since every submission signals it.
+		void CreateTimeline()
+		{
+			VkSemaphoreTypeCreateInfo type_info{};
+			type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			type_info.initialValue = timeline_value;
+
+			VkSemaphoreCreateInfo semaphore_info{};
+			semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			semaphore_info.pNext = &type_info;
+
+			if (vkCreateSemaphore(device, &semaphore_info, nullptr, &timeline) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create timeline semaphore.");
+		}
+
+		void WaitForTimeline(uint64_t value)
+		{
+			if (value == 0)
+				return;
+
+			VkSemaphoreWaitInfo wait_info{};
+			wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			wait_info.semaphoreCount = 1;
+			wait_info.pSemaphores = &timeline;
+			wait_info.pValues = &value;
+
+			if (vkWaitSemaphores(device, &wait_info, UINT64_MAX) != VK_SUCCESS)
+				throw std::runtime_error("Failed to wait for the timeline semaphore.");
+		}
+
+		uint64_t GetCompletedValue()
+		{
+			uint64_t value;
+			if (vkGetSemaphoreCounterValue(device, timeline, &value) != VK_SUCCESS)
+				throw std::runtime_error("Failed to read the timeline semaphore.");
+			return value;
+		}
+
+		void DestroyLater(std::function<void()> destroy, uint64_t after)
+		{
+			retired.push_back({ after == 0 ? timeline_value : after, std::move(destroy) });
+		}
+
+		void DestroyRetired()
+		{
+			if (retired.empty())
+				return;
+
+			uint64_t completed = GetCompletedValue();
+			std::erase_if(retired, [completed](Retired & object)
+			{
+				if (object.value > completed)
+					return false;
+				object.destroy();
+				return true;
+			});
+		}
+
+		VkShaderModule CreateShaderModule(const std::pmr::vector<char> & code)
 		{
 			VkShaderModuleCreateInfo shader_module_info{};
 			shader_module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -1044,10 +2851,9 @@ namespace Engine
 			return shader_module;
 		}
 
-		void UpdateUniformBuffer(uint32_t current_image)
+		int ComposeObjectTransforms(glm::mat4 * models, glm::mat3 * tex_offsets, const uint16_t * slots, uint32_t * meshes,
+			uint32_t * clips, float * clip_starts)
 		{
-			float aspect = float(WindowSize().x) / float(WindowSize().y);
-
 			auto objects = Object::GetObjects();
 			int num_objects = Object::GetNumObjects();
 
@@ -1055,31 +2861,386 @@ namespace Engine
 			{
 				auto transform = objects[i].transform;
 				auto sprite = objects[i].sprite;
+				int slot = slots ? slots[i] : i;
+
+				models[slot] = glm::mat4(1);
+				models[slot] = glm::translate(models[slot], glm::vec3(-transform->GetPosition(), 0));
+				models[slot] = glm::rotate(models[slot], transform->GetRotation(), glm::vec3(0, 0, 1));
+				models[slot] = glm::scale(models[slot], glm::vec3(transform->GetSize(), 1));
+
+				tex_offsets[slot] = sprite->GetTexOffset();
+				if (meshes)
+					meshes[slot] = sprite->GetMesh();
+				if (clips)
+					clips[slot] = uint32_t(sprite->GetClip());
+				if (clip_starts)
+					clip_starts[slot] = sprite->GetClipStart();
+			}
+
+			return num_objects;
+		}
+
+		int GetTextureIndex(Texture * texture)
+		{
+			return texture ? texture->GetIndex() : 0;
+		}
+
+		RenderQueue::Pipeline GetSpritePipeline(Texture * texture, int subsprite)
+		{
+			return texture && texture->IsOpaque(subsprite) ? RenderQueue::Pipeline::Opaque : RenderQueue::Pipeline::AlphaTested;
+		}
+
+		// A playing clip can show any of its frames, so it's only opaque when all of them are.
+		RenderQueue::Pipeline GetSpritePipeline(Sprite * sprite)
+		{
+			if (sprite->GetClip() >= 0)
+				return Texture::GetClip(sprite->GetClip()).opaque ? RenderQueue::Pipeline::Opaque : RenderQueue::Pipeline::AlphaTested;
+
+			return GetSpritePipeline(sprite->GetTexture(), sprite->GetSubsprite());
+		}
+
+		// Later draws go in front, so depth matches the order things were made in, as painting them in order would.
+		float OrderDepth(int order, int count)
+		{
+			return 1.f - float(order + 1) / float(count + 1);
+		}
 
-				ubo.model[i] = glm::mat4(1);
-				ubo.model[i] = glm::translate(ubo.model[i], glm::vec3(-transform->GetPosition(), 0));
-				ubo.model[i] = glm::rotate(ubo.model[i],transform->GetRotation(), glm::vec3(0, 0, 1));
-				ubo.model[i] = glm::scale(ubo.model[i], glm::vec3(transform->GetSize(), 1));
+		// The sort key's depth counts up from the front, the reverse of the order.
+		uint32_t OrderKeyDepth(int order, int count)
+		{
+			return uint32_t(count - 1 - order);
+		}
+
+		// Groups runs of sorted draws sharing a layer, pipeline and texture. Draw i of the queue goes in instance slot i.
+		void BatchQueue(const RenderQueue & queue, std::vector<Batch> & queue_batches)
+		{
+			const auto & entries = queue.GetEntries();
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				uint64_t key = entries[i].key;
+				if (i == 0 || RenderQueue::GetState(key) != RenderQueue::GetState(entries[i - 1].key))
+					queue_batches.push_back({ RenderQueue::GetTexture(key), uint32_t(i), 0, RenderQueue::GetLayer(key), RenderQueue::GetPipeline(key) });
 
-				ubo.tex_offset[i] = sprite->GetTexOffset();
+				++queue_batches.back().instance_count;
 			}
-			for (int i = num_objects; i < MAX_OBJECTS; ++i)
+		}
+
+		void OrderObjects(int num_objects)
+		{
+			auto & objects = Object::GetObjects();
+
+			// Sorted on the GPU, the CPU only needs an order for batching, so creation order does.
+			if (!config.y_sort || gpu_sort)
 			{
-				ubo.model[i] = glm::mat4(0);
-				ubo.tex_offset[i] = glm::mat3(0);
+				for (int i = 0; i < num_objects; ++i)
+					object_order[i] = uint16_t(i);
+				return;
 			}
 
-			ubo.view = glm::lookAt(glm::vec3(0, 0, 10), glm::vec3(0, 0, 0), glm::vec3(0, -1, 0));
-			ubo.projection = glm::perspective(glm::radians(45.f), aspect, 0.1f, 20.f);
-			ubo.projection[1][1] *= -1; // Unflip Y for vulkan compatability.
+			// Positions are y up, so the highest object goes furthest back. The sort is stable, so ties keep creation order.
+			order_queue.Clear();
+			for (int i = 0; i < num_objects; ++i)
+				order_queue.Submit(RenderQueue::FloatKey(-objects[i].transform->GetPosition().y), uint32_t(i));
 
-			void * data;
-			vkMapMemory(device, uniform_buffers_memory[current_image], 0, sizeof(ubo), 0, &data);
-			memcpy(data, &ubo, sizeof(ubo));
-			vkUnmapMemory(device, uniform_buffers_memory[current_image]);
+			order_queue.Sort();
+
+			const auto & entries = order_queue.GetEntries();
+			for (size_t order = 0; order < entries.size(); ++order)
+				object_order[entries[order].index] = uint16_t(order);
+		}
+
+		// Hands the GPU sort each object's y key and instance slot. The depths written above for creation order are
+		// overwritten by the sort's last pass.
+		void WriteSortKeys(uint32_t current_image, int num_objects, int num_orders)
+		{
+			auto & objects = Object::GetObjects();
+			SortBuffer & sort = *sort_buffers_mapped[current_image];
+			sort.count = uint32_t(num_objects);
+			sort.first_order = MAX_STATIC_LAYERS;
+			sort.num_orders = uint32_t(num_orders);
+
+			// Same as OrderObjects on the CPU, the highest object goes furthest back and ties keep creation order.
+			uint32_t any_bits = 0;
+			uint32_t all_bits = ~0u;
+			for (int i = 0; i < num_objects; ++i)
+			{
+				uint32_t key = RenderQueue::FloatKey(-objects[i].transform->GetPosition().y);
+				sort.keys[0][i] = key;
+				sort.slots[0][i] = instance_slots[i];
+				any_bits |= key;
+				all_bits &= key;
+			}
+
+			uint32_t differing = any_bits & ~all_bits;
+			for (uint32_t shift = 0; shift < 32; shift += 8)
+				if ((differing >> shift) & 0xFF || (shift == 24 && num_sort_passes == 0))
+				{
+					sort_passes[num_sort_passes] = { shift, num_sort_passes % 2, 0 };
+					++num_sort_passes;
+				}
+			sort_passes[num_sort_passes - 1].last = 1;
+		}
+
+		void UpdateView()
+		{
+			float distance = CAMERA_DISTANCE / camera.zoom;
+			float half_height = distance * std::tan(FIELD_OF_VIEW * .5f);
+
+			if (low_res)
+			{
+				// Orthographic at a whole number of target pixels per world unit, close to what the perspective view
+				// would show, with the camera snapped so texels land on the same target pixels every frame.
+				glm::vec2 world_size{ float(low_res_extent.width), float(low_res_extent.height) };
+				pixels_per_unit = std::max(1.f, std::round(world_size.y * .5f / half_height));
+
+				view_half_size = world_size * .5f / pixels_per_unit;
+				glm::mat4 projection = glm::ortho(-view_half_size.x, view_half_size.x, -view_half_size.y, view_half_size.y, 0.1f, distance * 2.f);
+				projection[1][1] *= -1;
+				world_view_projection = projection * CameraView(SnapToPixels(camera.offset, world_size), distance);
+			}
+			else
+			{
+				glm::vec2 world_size = WindowSize();
+				float aspect = world_size.x / world_size.y;
+				glm::mat4 view = CameraView(camera.offset, distance);
+				glm::mat4 projection = glm::perspective(FIELD_OF_VIEW, aspect, 0.1f, distance * 2.f);
+				projection[1][1] *= -1; // Unflip Y for vulkan compatability.
+				world_view_projection = projection * view;
+				view_half_size = glm::vec2(aspect, 1) * half_height;
+				pixels_per_unit = 0;
+			}
+
+			// Vulkan's clip space already has y pointing down, so this maps window pixels from the top left.
+			overlay_view_projection = glm::ortho(0.f, float(swap_chain_extent.width), 0.f, float(swap_chain_extent.height));
+		}
+
+		// Moves a centre so the edges of a view that many pixels across fall between pixels of the world grid.
+		glm::vec2 SnapToPixels(glm::vec2 center, glm::vec2 size_pixels)
+		{
+			glm::vec2 half_pixels = size_pixels * .5f;
+			return (glm::round(center * pixels_per_unit - half_pixels) + half_pixels) / pixels_per_unit;
+		}
+
+		// Object positions are negated when drawn, so the camera looks down on the negated offset too.
+		glm::mat4 CameraView(glm::vec2 offset, float distance)
+		{
+			return glm::lookAt(glm::vec3(-offset, distance), glm::vec3(-offset, 0), glm::vec3(0, -1, 0));
+		}
+
+		// Sorts this frame's objects and layer quads through the render queue, so each run sharing a pipeline and texture
+		// is one instanced draw, then appends the overlay glyphs.
+		void UpdateInstances(uint32_t current_image)
+		{
+			Trace::Scope scope("Graphics::UpdateInstances");
+
+			InstanceBuffer * instances = instance_buffers_mapped[current_image];
+			auto & objects = Object::GetObjects();
+			int num_objects = Object::GetNumObjects();
+
+			// Static layers sit behind every object.
+			const int num_orders = MAX_STATIC_LAYERS + MAX_OBJECTS;
+
+			OrderObjects(num_objects);
+
+			render_queue.Clear();
+			for (int i = 0; i < num_static_layers; ++i)
+				render_queue.Submit(RenderQueue::MakeKey(RenderQueue::Layer::World, RenderQueue::Pipeline::AlphaTested,
+					MAX_TEXTURES + i, OrderKeyDepth(i, num_orders)), uint32_t(MAX_OBJECTS + i));
+
+			bool animating = false;
+			for (int i = 0; i < num_objects; ++i)
+			{
+				Sprite * sprite = objects[i].sprite;
+				Texture * texture = sprite ? sprite->GetTexture() : nullptr;
+				RenderQueue::Pipeline pipeline = sprite ? GetSpritePipeline(sprite) : RenderQueue::Pipeline::AlphaTested;
+				render_queue.Submit(RenderQueue::MakeKey(RenderQueue::Layer::World, pipeline, GetTextureIndex(texture),
+					OrderKeyDepth(MAX_STATIC_LAYERS + object_order[i], num_orders)), uint32_t(i));
+
+				animating = animating || (sprite && sprite->IsAnimating());
+			}
+
+			// The shader picks the frames, but only when there's a frame to draw them in.
+			if (animating)
+				RequestRedraw();
+
+			render_queue.Sort();
+
+			batches.clear();
+			BatchQueue(render_queue, batches);
+
+			const auto & entries = render_queue.GetEntries();
+			for (size_t slot = 0; slot < entries.size(); ++slot)
+			{
+				int index = int(entries[slot].index);
+				if (index < MAX_OBJECTS)
+				{
+					instance_slots[index] = uint16_t(slot);
+					instances->depth[slot] = OrderDepth(MAX_STATIC_LAYERS + object_order[index], num_orders);
+					continue;
+				}
+
+				// Placed and sized like an object, the quad's texture coordinates already match the cache's layout.
+				int layer = index - MAX_OBJECTS;
+				const LayerCache & cache = layer_caches[layer];
+				instances->model[slot] = glm::mat4(1);
+				instances->model[slot] = glm::translate(instances->model[slot], glm::vec3(-cache.center, 0));
+				instances->model[slot] = glm::scale(instances->model[slot], glm::vec3(cache.half_size * 2.f, 1));
+				instances->tex_offset[slot] = glm::mat3(1);
+				instances->depth[slot] = OrderDepth(layer, num_orders);
+				instances->mesh[slot] = FULL_MESH;
+				instances->clip[slot] = NO_CLIP;
+			}
+
+			ComposeObjectTransforms(instances->model, instances->tex_offset, instance_slots.data(), instances->mesh,
+				instances->clip, instances->clip_start);
+
+			num_sort_passes = 0;
+			if (config.y_sort && gpu_sort && num_objects > 0)
+				WriteSortKeys(current_image, num_objects, num_orders);
+
+			int first_glyph = int(entries.size());
+			int num_glyphs = Text::ComposeGlyphs(instances->model + first_glyph, instances->tex_offset + first_glyph, MAX_GLYPHS);
+			std::fill_n(instances->depth + first_glyph, num_glyphs, 0.f);
+			// Glyphs are mirrored by their texture offset, so an outline found in the font's cells wouldn't line up.
+			std::fill_n(instances->mesh + first_glyph, num_glyphs, FULL_MESH);
+			std::fill_n(instances->clip + first_glyph, num_glyphs, NO_CLIP);
+			if (num_glyphs > 0)
+				batches.push_back({ Text::GetFont()->GetIndex(), uint32_t(first_glyph), uint32_t(num_glyphs),
+					RenderQueue::Layer::Overlay, RenderQueue::Pipeline::AlphaTested });
+
+			auto & stats = Stats::Current();
+			uint32_t num_instances = uint32_t(first_glyph + num_glyphs);
+			stats.instances += num_instances;
+			stats.bytes_uploaded += uint64_t(num_instances) * INSTANCE_SIZE;
+		}
+
+		// Hands the GPU this frame's emitter settings and spawn counts. Nothing here depends on how many particles there are.
+		void UpdateParticles()
+		{
+			Trace::Scope scope("Graphics::UpdateParticles");
+
+			ParticleFrame & frame = *particle_frames_mapped[current_frame];
+			auto & emitters = ParticleEmitter::GetEmitters();
+			int num_emitters = ParticleEmitter::GetNumEmitters();
+			Texture * texture = ParticleEmitter::GetTexture();
+			float delta_time = GetDeltaTime();
+			float now = float(GetTimeElapsed());
+
+			bool emitting = false;
+			particle_spawn_count = 0;
+			for (int i = 0; i < num_emitters; ++i)
+			{
+				ParticleEmitter & emitter = emitters[i];
+				uint32_t count = std::min(uint32_t(emitter.TakeSpawnCount(delta_time)), uint32_t(MAX_PARTICLES) - particle_spawn_count);
+
+				frame.emitters[i] = { emitter.position, emitter.acceleration, emitter.direction, emitter.spread,
+					emitter.min_speed, emitter.max_speed, emitter.min_lifetime, emitter.max_lifetime,
+					emitter.start_size, emitter.end_size, emitter.drag, particle_spawn_count, count,
+					uint32_t(std::max(emitter.first_subsprite, 0)), uint32_t(std::max(emitter.num_subsprites, 1)), 0 };
+
+				particle_spawn_count += count;
+				emitting = emitting || emitter.rate > 0;
+				if (count > 0)
+					particles_alive_until = std::max(particles_alive_until, now + emitter.max_lifetime);
+			}
+
+			glm::ivec2 num_images = texture->GetNumImages();
+			frame.delta_time = delta_time;
+			frame.seed = uint32_t(GetSeed() ^ (GetFrameCount() * 0x9E3779B97F4A7C15ull));
+			frame.num_emitters = uint32_t(num_emitters);
+			frame.spawn_count = particle_spawn_count;
+			frame.images_x = uint32_t(num_images.x);
+			frame.images_y = uint32_t(num_images.y);
+			frame.first_mesh = texture->GetMesh(0);
+
+			// Particles only move when frames are drawn, so on demand rendering has to keep drawing while any live.
+			particles_active = emitting || particle_spawn_count > 0 || now < particles_alive_until;
+			if (particles_active)
+				RequestRedraw();
+		}
+
+		// Decides which layer caches to redraw this frame, rewriting the tiles of any that changed.
+		void UpdateLayers()
+		{
+			Trace::Scope scope("Graphics::UpdateLayers");
+
+			auto & layers = StaticLayer::GetLayers();
+			if (StaticLayer::GetNumLayers() != num_static_layers)
+				ResizeLayerCaches(StaticLayer::GetNumLayers());
+
+			glm::vec2 half_size = view_half_size * (1.f + 2.f * LAYER_CACHE_MARGIN);
+			// In low resolution the caches are exactly their image at the view's pixel density, so they composite 1:1.
+			if (pixels_per_unit > 0)
+				half_size = glm::vec2(float(layer_extent.width), float(layer_extent.height)) * .5f / pixels_per_unit;
+			// How far the camera can move from a cache's centre before the view reaches past its edge.
+			glm::vec2 slack = half_size - view_half_size;
+
+			for (int i = 0; i < num_static_layers; ++i)
+			{
+				LayerCache & cache = layer_caches[i];
+
+				if (cache.tiles_version != layers[i].GetVersion())
+				{
+					WriteLayerTiles(i);
+					cache.half_size = glm::vec2(0);
+				}
+
+				glm::vec2 moved = glm::abs(camera.offset - cache.center);
+				if (cache.half_size != half_size || moved.x > slack.x || moved.y > slack.y)
+				{
+					// Orthographic over the cached area, looking down from where the world camera would be.
+					float distance = CAMERA_DISTANCE / camera.zoom;
+					glm::mat4 projection = glm::ortho(-half_size.x, half_size.x, -half_size.y, half_size.y, 0.1f, distance * 2.f);
+					projection[1][1] *= -1;
+
+					cache.center = pixels_per_unit > 0 ? SnapToPixels(camera.offset, glm::vec2(float(layer_extent.width), float(layer_extent.height))) : camera.offset;
+					cache.half_size = half_size;
+					cache.view_projection = projection * CameraView(cache.center, distance);
+					cache.redraw = true;
+				}
+			}
+		}
+
+		void WriteLayerTiles(int layer)
+		{
+			LayerCache & cache = layer_caches[layer];
+			const auto & tiles = StaticLayer::GetLayers()[layer].GetTiles();
+			int num_tiles = int(tiles.size());
+
+			// A previous frame may still be drawing from the buffer. Static layers change rarely enough to just wait.
+			WaitForTimeline(cache.drawn_value);
+
+			RenderQueue tile_queue;
+			tile_queue.Reserve(tiles.size());
+			for (int i = 0; i < num_tiles; ++i)
+				tile_queue.Submit(RenderQueue::MakeKey(RenderQueue::Layer::World, GetSpritePipeline(tiles[i].texture, tiles[i].subsprite),
+					GetTextureIndex(tiles[i].texture), OrderKeyDepth(i, MAX_LAYER_TILES)), uint32_t(i));
+
+			tile_queue.Sort();
+
+			cache.batches.clear();
+			BatchQueue(tile_queue, cache.batches);
+
+			const auto & entries = tile_queue.GetEntries();
+			for (size_t slot = 0; slot < entries.size(); ++slot)
+			{
+				int index = int(entries[slot].index);
+				const auto & tile = tiles[index];
+
+				cache.tiles_mapped->model[slot] = glm::mat4(1);
+				cache.tiles_mapped->model[slot] = glm::translate(cache.tiles_mapped->model[slot], glm::vec3(-tile.position, 0));
+				cache.tiles_mapped->model[slot] = glm::scale(cache.tiles_mapped->model[slot], glm::vec3(tile.size, tile.size, 1));
+				cache.tiles_mapped->tex_offset[slot] = tile.texture ? tile.texture->GetOffset(tile.subsprite) : glm::mat3(1);
+				cache.tiles_mapped->depth[slot] = OrderDepth(index, MAX_LAYER_TILES);
+				cache.tiles_mapped->mesh[slot] = tile.texture ? tile.texture->GetMesh(tile.subsprite) : FULL_MESH;
+				cache.tiles_mapped->clip[slot] = NO_CLIP;
+			}
+
+			cache.tiles_version = StaticLayer::GetLayers()[layer].GetVersion();
+			Stats::Current().bytes_uploaded += uint64_t(num_tiles) * INSTANCE_SIZE;
 		}
 
-		VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> & available_formats)
+		VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::pmr::vector<VkSurfaceFormatKHR> & available_formats)
 		{
 			for (const auto & format : available_formats)
 				if (format.format == VK_FORMAT_B8G8R8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
@@ -1088,10 +3249,16 @@ namespace Engine
 			return available_formats[0];
 		}
 
-		VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> & availablePresentModes)
+		VkPresentModeKHR ChooseSwapPresentMode(const std::pmr::vector<VkPresentModeKHR> & availablePresentModes)
 		{
+			VkPresentModeKHR wanted = VK_PRESENT_MODE_FIFO_KHR;
+			if (config.present_mode == PresentMode::Mailbox)
+				wanted = VK_PRESENT_MODE_MAILBOX_KHR;
+			else if (config.present_mode == PresentMode::Immediate)
+				wanted = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
 			for (const auto & available_present_mode : availablePresentModes)
-				if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR)
+				if (available_present_mode == wanted)
 					return available_present_mode;
 
 			return VK_PRESENT_MODE_FIFO_KHR;
@@ -1158,10 +3325,19 @@ namespace Engine
 			if (details.formats.empty() || details.present_modes.empty())
 				return false;
 
-			VkPhysicalDeviceFeatures supported_features;
-			vkGetPhysicalDeviceFeatures(device_candidate, &supported_features);
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(device_candidate, &properties);
+			if (properties.apiVersion < VK_API_VERSION_1_2)
+				return false;
+
+			VkPhysicalDeviceVulkan12Features vulkan_12_features{};
+			vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			VkPhysicalDeviceFeatures2 supported_features{};
+			supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supported_features.pNext = &vulkan_12_features;
+			vkGetPhysicalDeviceFeatures2(device_candidate, &supported_features);
 
-			if (!supported_features.samplerAnisotropy)
+			if (!supported_features.features.samplerAnisotropy || !vulkan_12_features.timelineSemaphore)
 				return false;
 
 			return true;
@@ -1172,7 +3348,7 @@ namespace Engine
 			// Get the available extensions.
 			uint32_t extension_count;
 			vkEnumerateDeviceExtensionProperties(device_candidate, nullptr, &extension_count, nullptr);
-			std::vector<VkExtensionProperties> available_extensions(extension_count);
+			std::pmr::vector<VkExtensionProperties> available_extensions(extension_count, Memory::GetFrameResource());
 			vkEnumerateDeviceExtensionProperties(device_candidate, nullptr, &extension_count, available_extensions.data());
 
 			// Make sure all required extensions are available.
@@ -1190,7 +3366,7 @@ namespace Engine
 			uint32_t queue_family_count = 0;
 			vkGetPhysicalDeviceQueueFamilyProperties(device_candidate, &queue_family_count, nullptr);
 
-			std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+			std::pmr::vector<VkQueueFamilyProperties> queue_families(queue_family_count, Memory::GetFrameResource());
 			vkGetPhysicalDeviceQueueFamilyProperties(device_candidate, &queue_family_count, queue_families.data());
 
 			for (int i = 0; i < queue_families.size(); ++i)
@@ -1210,13 +3386,13 @@ namespace Engine
 
 			return queue_family_indices;
 		}
-		std::vector<const char *> getRequiredExtensions()
+		std::pmr::vector<const char *> getRequiredExtensions()
 		{
 			uint32_t glfwExtensionCount = 0;
 			const char ** glfwExtensions;
 			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-			std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+			std::pmr::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount, Memory::GetFrameResource());
 
 			if (enable_validation_layers)
 				extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -1293,22 +3469,34 @@ namespace Engine
 			vkBeginCommandBuffer(command_buffer, &begin_info);
 		}
 
-		void EndSingleTimeCommands(VkCommandBuffer command_buffer)
+		uint64_t EndSingleTimeCommands(VkCommandBuffer command_buffer)
 		{
 			vkEndCommandBuffer(command_buffer);
 
+			uint64_t value = ++timeline_value;
+
+			VkTimelineSemaphoreSubmitInfo timeline_info{};
+			timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timeline_info.signalSemaphoreValueCount = 1;
+			timeline_info.pSignalSemaphoreValues = &value;
+
 			VkSubmitInfo submit_info{};
 			submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_info.pNext = &timeline_info;
 			submit_info.commandBufferCount = 1;
 			submit_info.pCommandBuffers = &command_buffer;
+			submit_info.signalSemaphoreCount = 1;
+			submit_info.pSignalSemaphores = &timeline;
 
-			vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-			vkQueueWaitIdle(graphics_queue);
+			if (vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+				throw std::runtime_error("Failed to submit one time commands.");
 
-			vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+			DestroyLater([command_buffer] { vkFreeCommandBuffers(device, command_pool, 1, &command_buffer); }, value);
+			upload_value = value;
+			return value;
 		}
 
-		std::vector<char> ReadFile(const std::string & filename)
+		std::pmr::vector<char> ReadFile(const std::string & filename)
 		{
 			std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
@@ -1316,7 +3504,7 @@ namespace Engine
 				throw std::runtime_error(std::format("Failed to open {}.", filename));
 
 			size_t file_size = size_t(file.tellg());
-			std::vector<char> buffer(file_size);
+			std::pmr::vector<char> buffer(file_size, Memory::GetFrameResource());
 
 			file.seekg(0);
 			file.read(buffer.data(), file_size);
@@ -1326,7 +3514,7 @@ namespace Engine
 			return buffer;
 		}
 
-		void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+		uint64_t CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
 		{
 			VkBufferImageCopy region{};
 			region.bufferOffset = 0;
@@ -1342,7 +3530,7 @@ namespace Engine
 			VkCommandBuffer cb;
 			BeginSingleTimeCommands(cb);
 			vkCmdCopyBufferToImage(cb, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-			EndSingleTimeCommands(cb);
+			return EndSingleTimeCommands(cb);
 		}
 
 		VkFormat FindSupportedFormat(const std::vector<VkFormat> & candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
@@ -1395,10 +3583,8 @@ namespace Engine
 			return image_view;
 		}
 
-		void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout)
+		uint64_t TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout)
 		{
-			VkPipelineStageFlags src_stage;
-			VkPipelineStageFlags dst_stage;
 			VkImageMemoryBarrier barrier{};
 			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 			barrier.oldLayout = old_layout;
@@ -1420,34 +3606,36 @@ namespace Engine
 			else
 				barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-			if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+			// Each layout waits on and is waited on by whatever the render graph uses it for. Only writes need flushing.
+			auto layout_access = [](VkImageLayout layout) -> RenderGraph::Access
 			{
-				barrier.srcAccessMask = 0;
-				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-				dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			}
-			else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-			{
-				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-				src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-				dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			}
-			else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-			{
-				barrier.srcAccessMask = 0;
-				barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-				src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-				dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-			}
-			else
-				throw std::invalid_argument("Unsupported layout transition.");
+				using Usage = RenderGraph::Usage;
+				if (layout == VK_IMAGE_LAYOUT_UNDEFINED)
+					return { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, layout };
+				else if (layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+					return RenderGraph::GetAccess(Usage::TransferWrite);
+				else if (layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+					return RenderGraph::GetAccess(Usage::TransferRead);
+				else if (layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+					return RenderGraph::GetAccess(Usage::FragmentSampled);
+				else if (layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+					return RenderGraph::GetAccess(Usage::ColorAttachment);
+				else if (layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+					return RenderGraph::GetAccess(Usage::DepthAttachment);
+				else
+					throw std::invalid_argument("Unsupported layout transition.");
+			};
+
+			RenderGraph::Access src = layout_access(old_layout);
+			RenderGraph::Access dst = layout_access(new_layout);
+			barrier.srcAccessMask = src.access & (VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+				| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+			barrier.dstAccessMask = dst.access;
 
 			VkCommandBuffer cb;
 			BeginSingleTimeCommands(cb);
-			vkCmdPipelineBarrier(cb, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-			EndSingleTimeCommands(cb);
+			vkCmdPipelineBarrier(cb, src.stages, dst.stages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			return EndSingleTimeCommands(cb);
 		}
 
 		void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
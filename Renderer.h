@@ -6,19 +6,33 @@
 #include <optional>
 #include <vector>
 #include <array>
+#include <functional>
 
 #include "Core.h"
+#include "Memory.h"
 
 namespace Engine
 {
 	const uint32_t WIDTH = 1280;
 	const uint32_t HEIGHT = 720;
 
+	// Objects, overlay glyphs and a quad per static layer share one instance buffer.
+	const int MAX_INSTANCES = MAX_OBJECTS + MAX_GLYPHS + MAX_STATIC_LAYERS;
+
 	namespace Graphics
 	{
 		const VkClearColorValue clear_color = { { .1f, .1f, .2f, 1.f } };
 
-		const int MAX_FRAMES_IN_FLIGHT = 2;
+		const int MAX_FRAMES_IN_FLIGHT = 3;
+
+		// Sprites are drawn as convex outlines of this many corners, in the sub sprite's texture coordinates.
+		// Outlines needing fewer corners repeat some.
+		const int MESH_VERTICES = 8;
+		// The whole quad, for anything without a tighter outline.
+		const uint32_t FULL_MESH = 0;
+
+		// How far static layer caches reach past each edge of the view, as a fraction of the view's size.
+		const float LAYER_CACHE_MARGIN = .5f;
 
 		const std::vector<const char *> validation_layers = {
 			"VK_LAYER_KHRONOS_validation"
@@ -45,58 +59,43 @@ namespace Engine
 		struct SwapChainSupportDetails
 		{
 			VkSurfaceCapabilitiesKHR capabilities{};
-			std::vector<VkSurfaceFormatKHR> formats;
-			std::vector<VkPresentModeKHR> present_modes;
+			std::pmr::vector<VkSurfaceFormatKHR> formats{ Memory::GetFrameResource() };
+			std::pmr::vector<VkPresentModeKHR> present_modes{ Memory::GetFrameResource() };
 		};
 
 		struct Camera
 		{
 			float zoom{ 1 };
+			// The world position at the centre of the view.
 			glm::vec2 offset{ 0,0 };
 		};
 
-		struct Vertex
-		{
-		public:
-			glm::vec3 offset;
-			glm::vec2 tex_coord;
-
-			static VkVertexInputBindingDescription GetBindingDescription()
-			{
-				VkVertexInputBindingDescription binding_description{};
-				binding_description.binding = 0;
-				binding_description.stride = sizeof(Vertex);
-				binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-				return binding_description;
-			}
-
-			static std::array<VkVertexInputAttributeDescription, 2> GetAttributeDescriptions()
-			{
-				std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
-
-				attribute_descriptions[0].binding = 0;
-				attribute_descriptions[0].location = 0;
-				attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-				attribute_descriptions[0].offset = offsetof(Vertex, offset);
-
-				attribute_descriptions[1].binding = 0;
-				attribute_descriptions[1].location = 1;
-				attribute_descriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-				attribute_descriptions[1].offset = offsetof(Vertex, tex_coord);
-
-				return attribute_descriptions;
-			}
-		};
-
 		void Initialize();
 		void Update();
 		void Shutdown();
 
+		// Blocks until the GPU has finished with the next frame's resources. Update calls it if it hasn't been called
+		// already this frame, calling it before Input::Update gives late input sampling.
+		void WaitForFrame();
+
+		const Camera & GetCamera();
+		void SetCamera(const Camera & new_camera);
+
 		VkDevice GetDevice();
 		GLFWwindow * GetWindow();
 		glm::vec2 WindowSize();
 
+		// Seconds the GPU spent on the most recently completed frame, 0 when headless or unsupported.
+		float GetGpuFrameTime();
+
+		// Copies count outlines of MESH_VERTICES corners each into the mesh buffer, returns the first one's mesh index.
+		// Returns FULL_MESH when they don't fit, the texture's sub sprites are then drawn as whole quads.
+		uint32_t AddMeshes(const glm::vec2 * corners, int count);
+		// Makes meshes from AddMeshes free for later textures. Nothing in flight may still read them.
+		void ReleaseMeshes(uint32_t first_mesh, int count);
+		// Copies a clip from Texture::AddClip into the clip buffer, where the vertex shader looks up sprites' frames.
+		void WriteClip(int clip);
+
 		void CreateWindow();
 		void CreateInstance();
 		void CreateSurface();
@@ -105,32 +104,96 @@ namespace Engine
 		void CreateSwapChain();
 		void CreateImageViews();
 		void CreateRenderPass();
+		VkRenderPass BuildRenderPass(VkAttachmentLoadOp color_load_op);
 		void CreateDescriptorSetLayout();
 		void CreateGraphicsPipeline();
 		void CreateCommandPool();
+		void CreateRecordThreads();
+		void DestroyRecordThreads();
 		void CreateDepthResources();
+		void AllocateRenderTargets();
+		VkFramebuffer CreateFramebuffer(VkRenderPass pass, VkImageView color_view, VkImageView depth_view, VkExtent2D extent);
 		void CreateFramebuffers();
+		void CreateLowResTarget();
+		void CreateLayerCaches();
+		void CreateLayerImage(int layer);
+		void DestroyLayerImage(int layer);
+		void CleanupLayerCaches();
+		void ResizeLayerCaches(int count);
 		void LoadTextures();
 		void CreateTextureSampler();
-		void CreateVertexBuffer();
+		void CreateTextureDescriptorPool();
+		void CreateLayerDescriptorSets();
+		void CreateLayerTileBuffer(int layer);
+		void DestroyLayerTileBuffer(int layer);
+		void CreateMeshBuffer();
+		void CreateClipBuffer();
 		void CreateIndexBuffer();
-		void CreateUniformBuffers();
+		void CreateInstanceBuffers();
 		void CreateDescriptorPool();
 		void CreateDescriptorSets();
+		void WriteInstanceSet(VkDescriptorSet set, VkBuffer instance_buffer);
+		void CreateParticleResources();
+		void CreateSortPipelines();
+		void CreateTimestampPool();
 		void CreateCommandBuffers();
 		void CreateSyncObjects();
-
-		void UpdateUniformBuffer(uint32_t current_image);
+		void CreateTimeline();
+		void ReadTimestamps(uint32_t image_index);
+
+		// Writes a model matrix and texture offset for every object, returns how many were written.
+		// With slots, object i is written to index slots[i] instead of i. With meshes, each sprite's outline is written too,
+		// and with clips each sprite's clip and when it started.
+		int ComposeObjectTransforms(glm::mat4 * models, glm::mat3 * tex_offsets, const uint16_t * slots = nullptr, uint32_t * meshes = nullptr,
+			uint32_t * clips = nullptr, float * clip_starts = nullptr);
+		// Ranks this frame's objects back to front, by creation or by y with Config::y_sort.
+		void OrderObjects(int num_objects);
+		void WriteSortKeys(uint32_t current_image, int num_objects, int num_orders);
+		void UpdateView();
+		glm::vec2 SnapToPixels(glm::vec2 center, glm::vec2 size_pixels);
+		glm::mat4 CameraView(glm::vec2 offset, float distance);
+		void UpdateLayers();
+		void UpdateInstances(uint32_t current_image);
+		void UpdateParticles();
+		void WriteLayerTiles(int layer);
+		void RecordParticleUpdate(VkCommandBuffer command_buffer);
+		void RecordObjectSort(VkCommandBuffer command_buffer, uint32_t image_index);
+		void RecordCommandBuffer(uint32_t image_index);
+		// Adds the frame's passes to the render graph, with what each reads and writes.
+		void DeclareFrame(uint32_t image_index);
+		void ExecuteJobs(VkCommandBuffer command_buffer, VkRenderPass pass, VkFramebuffer framebuffer, VkExtent2D extent, VkClearColorValue color);
+		// Shares this frame's recording jobs out between every recording thread, returning once they're all recorded.
+		void RunRecordJobs();
+		void RecordJobs(int thread);
+		void RecordSecondary(int thread, size_t job);
+		void RecordWorkerLoop(int thread);
+		void RecordUpscale(VkCommandBuffer command_buffer, uint32_t image_index);
+		VkDescriptorSet GetTextureDescriptorSet(int texture);
+		// Frees the texture's set once frames already submitted are done with it, a later draw allocates a new one.
+		void ReleaseTextureDescriptorSet(int texture);
 
 		void CleanupSwapChain();
 		void RecreateSwapChain();
 
-		void CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize buffer_size);
+		// Blocks until the graphics queue's timeline reaches value, at once for 0.
+		void WaitForTimeline(uint64_t value);
+		// The value the timeline has reached, so every submission signalling up to it has finished.
+		uint64_t GetCompletedValue();
+		// Calls destroy once the timeline reaches after, or by default once everything submitted so far has finished.
+		// Anything the GPU might still be using, such as a texture unloaded mid game, is released through this rather
+		// than destroyed straight away.
+		void DestroyLater(std::function<void()> destroy, uint64_t after = 0);
+		// Destroys whatever DestroyLater was given that the GPU has finished with. WaitForFrame calls it every frame.
+		void DestroyRetired();
+
+		// One time commands don't block, they return the timeline value reached once they've finished, which the next
+		// frame waits for. Anything the commands read from, such as a staging buffer, must be kept until then.
+		uint64_t CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize buffer_size);
 		void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 			VkMemoryPropertyFlags properties, VkBuffer & buffer,
 			VkDeviceMemory & buffer_memory);
 
-		void TransitionImageLayout(VkImage image, VkFormat format,
+		uint64_t TransitionImageLayout(VkImage image, VkFormat format,
 			VkImageLayout old_layout, VkImageLayout new_layout);
 
 		void CreateImage(uint32_t width, uint32_t height, VkFormat format,
@@ -138,30 +201,31 @@ namespace Engine
 			VkImage & image, VkDeviceMemory & image_memory);
 
 		VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags);
-		void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+		uint64_t CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 
 		void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT & createInfo);
 		void SetupDebugMessenger();
 
 		uint32_t SwapChainSize();
-		VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> & availableFormats);
-		VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> & availablePresentModes);
+		VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::pmr::vector<VkSurfaceFormatKHR> & availableFormats);
+		VkPresentModeKHR ChooseSwapPresentMode(const std::pmr::vector<VkPresentModeKHR> & availablePresentModes);
 		VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR & capabilities);
 
-		std::vector<const char *> getRequiredExtensions();
+		std::pmr::vector<const char *> getRequiredExtensions();
 		bool CheckValidationLayerSupport();
 		SwapChainSupportDetails QuerySwapChainSupport(const VkPhysicalDevice & device_candidate);
 		bool IsDeviceSuitable(const VkPhysicalDevice & device_candidate);
 		bool CheckDeviceExtensionSupport(const VkPhysicalDevice & device_candidate);
 		QueueFamilyIndices FindQueueFamilies(const VkPhysicalDevice & device_candidate);
 
-		VkShaderModule CreateShaderModule(const std::vector<char> & code);
+		VkShaderModule CreateShaderModule(const std::pmr::vector<char> & code);
 		static void FramebufferResizeCallback(GLFWwindow * window, int width, int height);
+		static void WindowRefreshCallback(GLFWwindow * window);
 
 		void BeginSingleTimeCommands(VkCommandBuffer & command_buffer);
-		void EndSingleTimeCommands(VkCommandBuffer command_buffer);
+		uint64_t EndSingleTimeCommands(VkCommandBuffer command_buffer);
 
-		static std::vector<char> ReadFile(const std::string & filename);
+		static std::pmr::vector<char> ReadFile(const std::string & filename);
 		uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties);
 		VkFormat FindSupportedFormat(const std::vector<VkFormat> & candidates,
 			VkImageTiling tiling, VkFormatFeatureFlags features);
@@ -0,0 +1,186 @@
+#include "Replay.h"
+#include "Input.h"
+#include "Trace.h"
+
+#include <fstream>
+#include <cstring>
+#include <iterator>
+
+namespace Engine
+{
+	namespace Replay
+	{
+		const char REPLAY_MAGIC[4]{ 'P', 'R', 'E', 'P' };
+		const uint8_t REPLAY_VERSION = 1;
+		const float DEFAULT_TIMESTEP = 1.f / 60.f;
+
+		std::string recording_filename;
+		bool recording = false;
+		bool playing = false;
+
+		// Each event is a varint of ticks since the previous event, then one byte of key << 1 | pressed.
+		std::vector<uint8_t> events;
+		uint64_t last_event_tick = 0;
+
+		size_t playback_position = 0;
+		uint64_t playback_next_tick = 0;
+		uint64_t playback_length = 0;
+
+		void WriteVarint(std::vector<uint8_t> & buffer, uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				buffer.push_back(uint8_t(value) | 0x80);
+				value >>= 7;
+			}
+			buffer.push_back(uint8_t(value));
+		}
+
+		uint64_t ReadVarint(const std::vector<uint8_t> & buffer, size_t & position)
+		{
+			uint64_t value = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				if (position >= buffer.size())
+					throw std::runtime_error("Replay ended in the middle of a value.");
+
+				uint8_t byte = buffer[position++];
+				value |= uint64_t(byte & 0x7f) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+
+			throw std::runtime_error("Replay contains an invalid value.");
+		}
+
+		void ReadNextTick()
+		{
+			if (playback_position < events.size())
+				playback_next_tick += ReadVarint(events, playback_position);
+		}
+
+		// Installed as the Input source, injects the events recorded for the current tick.
+		void InjectRecordedEvents()
+		{
+			uint64_t tick = GetFrameCount();
+			double time = double(tick) * double(config.fixed_timestep);
+
+			while (playback_position < events.size() && playback_next_tick == tick)
+			{
+				uint8_t code = events[playback_position++];
+				int key = code >> 1;
+				if (key >= int(Input::Key::Count))
+					throw std::runtime_error(std::format("Replay contains unknown key {}.", key));
+
+				Input::InjectEvent(Input::Key(key), (code & 1) != 0, time);
+				ReadNextTick();
+			}
+
+			if (tick + 1 >= playback_length)
+				Quit();
+		}
+
+		void StartRecording(std::string filename)
+		{
+			recording_filename = filename;
+			recording = true;
+			events.clear();
+			events.reserve(1 << 16);
+			last_event_tick = 0;
+
+			if (config.fixed_timestep == 0)
+				config.fixed_timestep = DEFAULT_TIMESTEP;
+		}
+
+		void StartPlayback(std::string filename)
+		{
+			std::ifstream file(filename, std::ios::binary);
+			if (!file.is_open())
+				throw std::runtime_error(std::format("Failed to open {}.", filename));
+
+			char magic[4];
+			uint8_t version;
+			uint64_t seed;
+			float timestep;
+			file.read(magic, sizeof(magic));
+			file.read(reinterpret_cast<char *>(&version), sizeof(version));
+			file.read(reinterpret_cast<char *>(&seed), sizeof(seed));
+			file.read(reinterpret_cast<char *>(&timestep), sizeof(timestep));
+			file.read(reinterpret_cast<char *>(&playback_length), sizeof(playback_length));
+
+			if (!file || std::memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0)
+				throw std::runtime_error(std::format("{} is not a replay.", filename));
+
+			if (version != REPLAY_VERSION)
+				throw std::runtime_error(std::format("{} is replay version {}, expected {}.", filename, version, REPLAY_VERSION));
+
+			events.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+			config.seed = seed;
+			config.fixed_timestep = timestep;
+
+			playing = true;
+			playback_position = 0;
+			playback_next_tick = 0;
+			ReadNextTick();
+
+			Input::SetSource(InjectRecordedEvents);
+		}
+
+		void Update()
+		{
+			Trace::Scope scope("Replay::Update");
+
+			if (!recording)
+				return;
+
+			uint64_t tick = GetFrameCount();
+			for (const auto & event : Input::GetEvents())
+			{
+				WriteVarint(events, tick - last_event_tick);
+				events.push_back(uint8_t(int(event.key) << 1 | (event.pressed ? 1 : 0)));
+				last_event_tick = tick;
+			}
+		}
+
+		void Shutdown()
+		{
+			if (playing)
+			{
+				Input::SetSource(nullptr);
+				playing = false;
+			}
+
+			if (!recording)
+				return;
+
+			recording = false;
+
+			std::ofstream file(recording_filename, std::ios::binary);
+			if (!file.is_open())
+			{
+				WriteError(std::format("Failed to save replay to {}.", recording_filename));
+				return;
+			}
+
+			uint64_t seed = GetSeed();
+			uint64_t length = GetFrameCount();
+			file.write(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+			file.write(reinterpret_cast<const char *>(&REPLAY_VERSION), sizeof(REPLAY_VERSION));
+			file.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+			file.write(reinterpret_cast<const char *>(&config.fixed_timestep), sizeof(config.fixed_timestep));
+			file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+			file.write(reinterpret_cast<const char *>(events.data()), std::streamsize(events.size()));
+		}
+
+		bool IsRecording()
+		{
+			return recording;
+		}
+
+		bool IsPlaying()
+		{
+			return playing;
+		}
+	}
+}
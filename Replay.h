@@ -0,0 +1,21 @@
+#pragma once
+#include "Core.h"
+
+namespace Engine
+{
+	// Records input events with the tick they were applied on, along with the seed and timestep,
+	// so a run can be played back bit for bit through Input.
+	namespace Replay
+	{
+		// Both can be called before Initialize. Playback overrides the seed and fixed timestep from the
+		// file and quits once the recording runs out, recording forces a fixed timestep if none was set.
+		void StartRecording(std::string filename);
+		void StartPlayback(std::string filename);
+
+		void Update();
+		void Shutdown();
+
+		bool IsRecording();
+		bool IsPlaying();
+	}
+}
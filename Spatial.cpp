@@ -0,0 +1,431 @@
+#include "Spatial.h"
+#include "Object.h"
+#include "Transform.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Engine
+{
+	SpatialGrid::SpatialGrid(float cell_size, int capacity) :
+		cell_size(cell_size), inverse_cell_size(1.f / cell_size)
+	{
+		// Keep the load factor at or below one half so most buckets hold a single cell.
+		uint32_t num_buckets = 64;
+		while (num_buckets < uint32_t(capacity) * 2)
+			num_buckets <<= 1;
+
+		bucket_mask = num_buckets - 1;
+		bucket_start.resize(size_t(num_buckets) + 1);
+
+		item_bucket.resize(capacity);
+		item_cell.resize(capacity);
+		sorted_x.resize(capacity);
+		sorted_y.resize(capacity);
+		sorted_radius.resize(capacity);
+		sorted_cell.resize(capacity);
+		sorted_index.resize(capacity);
+	}
+
+	inline int SpatialGrid::CellX(float x) const
+	{
+		return int(std::floor(x * inverse_cell_size));
+	}
+
+	inline int SpatialGrid::CellY(float y) const
+	{
+		return int(std::floor(y * inverse_cell_size));
+	}
+
+	inline uint32_t SpatialGrid::Bucket(int cell_x, int cell_y) const
+	{
+		return ((uint32_t(cell_x) * 73856093u) ^ (uint32_t(cell_y) * 19349663u)) & bucket_mask;
+	}
+
+	inline uint64_t SpatialGrid::CellKey(int cell_x, int cell_y)
+	{
+		return (uint64_t(uint32_t(cell_x)) << 32) | uint32_t(cell_y);
+	}
+
+	// Calls visit(slot) for every entry whose cell lies in the inclusive range, until visit returns false.
+	template<typename Visitor>
+	bool SpatialGrid::VisitCells(int x0, int y0, int x1, int y1, Visitor && visit) const
+	{
+		x0 = std::max(x0, min_cell_x);
+		y0 = std::max(y0, min_cell_y);
+		x1 = std::min(x1, max_cell_x);
+		y1 = std::min(y1, max_cell_y);
+
+		if (x0 > x1 || y0 > y1)
+			return true;
+
+		// Covering more cells than there are entries; scanning everything is cheaper.
+		if (int64_t(x1 - x0 + 1) * int64_t(y1 - y0 + 1) > int64_t(count))
+		{
+			for (int slot = 0; slot < count; ++slot)
+			{
+				uint64_t key = sorted_cell[slot];
+				int cell_x = int(uint32_t(key >> 32));
+				int cell_y = int(uint32_t(key));
+				if (cell_x >= x0 && cell_x <= x1 && cell_y >= y0 && cell_y <= y1 && !visit(slot))
+					return false;
+			}
+			return true;
+		}
+
+		for (int cell_y = y0; cell_y <= y1; ++cell_y)
+			for (int cell_x = x0; cell_x <= x1; ++cell_x)
+			{
+				uint64_t key = CellKey(cell_x, cell_y);
+				uint32_t bucket = Bucket(cell_x, cell_y);
+
+				// Other cells can share the bucket, so check the key to avoid visiting anything twice.
+				for (int slot = bucket_start[bucket]; slot < bucket_start[bucket + 1]; ++slot)
+					if (sorted_cell[slot] == key && !visit(slot))
+						return false;
+			}
+
+		return true;
+	}
+
+	void SpatialGrid::Build(const float * x, const float * y, const float * radii, int new_count)
+	{
+		count = new_count;
+
+		// Only grows; steady state builds never allocate.
+		if (size_t(count) > item_bucket.size())
+		{
+			item_bucket.resize(count);
+			item_cell.resize(count);
+			sorted_x.resize(count);
+			sorted_y.resize(count);
+			sorted_radius.resize(count);
+			sorted_cell.resize(count);
+			sorted_index.resize(count);
+		}
+
+		std::fill(bucket_start.begin(), bucket_start.end(), 0);
+
+		min_cell_x = min_cell_y = std::numeric_limits<int>::max();
+		max_cell_x = max_cell_y = std::numeric_limits<int>::min();
+		max_radius = 0;
+
+		for (int i = 0; i < count; ++i)
+		{
+			int cell_x = CellX(x[i]);
+			int cell_y = CellY(y[i]);
+
+			min_cell_x = std::min(min_cell_x, cell_x);
+			min_cell_y = std::min(min_cell_y, cell_y);
+			max_cell_x = std::max(max_cell_x, cell_x);
+			max_cell_y = std::max(max_cell_y, cell_y);
+			max_radius = std::max(max_radius, radii[i]);
+
+			item_cell[i] = CellKey(cell_x, cell_y);
+			item_bucket[i] = Bucket(cell_x, cell_y);
+			++bucket_start[item_bucket[i]];
+		}
+
+		// Counting sort: turn counts into bucket ends, then fill backwards so each end becomes a start.
+		uint32_t num_buckets = bucket_mask + 1;
+		for (uint32_t b = 1; b < num_buckets; ++b)
+			bucket_start[b] += bucket_start[b - 1];
+		bucket_start[num_buckets] = count;
+
+		for (int i = count - 1; i >= 0; --i)
+		{
+			int slot = --bucket_start[item_bucket[i]];
+			sorted_x[slot] = x[i];
+			sorted_y[slot] = y[i];
+			sorted_radius[slot] = radii[i];
+			sorted_cell[slot] = item_cell[i];
+			sorted_index[slot] = i;
+		}
+	}
+
+	int SpatialGrid::QueryRadius(glm::vec2 center, float radius, int * results, int max_results) const
+	{
+		if (count == 0 || max_results <= 0)
+			return 0;
+
+		int found = 0;
+		auto visit = [&](int slot)
+		{
+			float dx = sorted_x[slot] - center.x;
+			float dy = sorted_y[slot] - center.y;
+			float reach = radius + sorted_radius[slot];
+			if (dx * dx + dy * dy <= reach * reach)
+				results[found++] = sorted_index[slot];
+			return found < max_results;
+		};
+
+		float reach = radius + max_radius;
+		VisitCells(CellX(center.x - reach), CellY(center.y - reach), CellX(center.x + reach), CellY(center.y + reach), visit);
+		return found;
+	}
+
+	int SpatialGrid::QueryAABB(glm::vec2 min, glm::vec2 max, int * results, int max_results) const
+	{
+		if (count == 0 || max_results <= 0)
+			return 0;
+
+		int found = 0;
+		auto visit = [&](int slot)
+		{
+			float dx = sorted_x[slot] - std::clamp(sorted_x[slot], min.x, max.x);
+			float dy = sorted_y[slot] - std::clamp(sorted_y[slot], min.y, max.y);
+			if (dx * dx + dy * dy <= sorted_radius[slot] * sorted_radius[slot])
+				results[found++] = sorted_index[slot];
+			return found < max_results;
+		};
+
+		VisitCells(CellX(min.x - max_radius), CellY(min.y - max_radius), CellX(max.x + max_radius), CellY(max.y + max_radius), visit);
+		return found;
+	}
+
+	int SpatialGrid::QueryNearest(glm::vec2 point, int k, int * results, float max_distance) const
+	{
+		if (count == 0 || k <= 0)
+			return 0;
+
+		auto distance2 = [&](int slot)
+		{
+			float dx = sorted_x[slot] - point.x;
+			float dy = sorted_y[slot] - point.y;
+			return dx * dx + dy * dy;
+		};
+
+		// Results hold slots, kept sorted by distance, until the end.
+		int found = 0;
+		float limit2 = max_distance * max_distance;
+		auto visit = [&](int slot)
+		{
+			float d2 = distance2(slot);
+			if (d2 > limit2 || (found == k && d2 >= distance2(results[k - 1])))
+				return true;
+
+			int i = found < k ? found++ : k - 1;
+			for (; i > 0 && d2 < distance2(results[i - 1]); --i)
+				results[i] = results[i - 1];
+			results[i] = slot;
+			return true;
+		};
+
+		int64_t bounds_cells = int64_t(max_cell_x - min_cell_x + 1) * int64_t(max_cell_y - min_cell_y + 1);
+		if (bounds_cells > int64_t(count) * 4)
+		{
+			// Sparse world; walking rings of mostly empty cells would cost more than a scan.
+			for (int slot = 0; slot < count; ++slot)
+				visit(slot);
+		}
+		else
+		{
+			int center_x = std::clamp(CellX(point.x), min_cell_x, max_cell_x);
+			int center_y = std::clamp(CellY(point.y), min_cell_y, max_cell_y);
+			int max_ring = std::max({ center_x - min_cell_x, max_cell_x - center_x, center_y - min_cell_y, max_cell_y - center_y });
+
+			for (int ring = 0; ring <= max_ring; ++ring)
+			{
+				// Nothing in this ring or beyond can be closer than ring - 1 whole cells.
+				if (ring > 1)
+				{
+					float ring_distance = float(ring - 1) * cell_size;
+					float ring_distance2 = ring_distance * ring_distance;
+					if (ring_distance2 > limit2 || (found == k && ring_distance2 > distance2(results[k - 1])))
+						break;
+				}
+
+				VisitCells(center_x - ring, center_y - ring, center_x + ring, center_y - ring, visit);
+				if (ring > 0)
+				{
+					VisitCells(center_x - ring, center_y + ring, center_x + ring, center_y + ring, visit);
+					VisitCells(center_x - ring, center_y - ring + 1, center_x - ring, center_y + ring - 1, visit);
+					VisitCells(center_x + ring, center_y - ring + 1, center_x + ring, center_y + ring - 1, visit);
+				}
+			}
+		}
+
+		for (int i = 0; i < found; ++i)
+			results[i] = sorted_index[results[i]];
+
+		return found;
+	}
+
+	int SpatialGrid::Raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, float * hit_distance) const
+	{
+		float direction_length = glm::length(direction);
+		if (count == 0 || direction_length == 0)
+			return -1;
+		direction /= direction_length;
+
+		// Clip the ray against the occupied bounds, padded by the largest radius.
+		glm::vec2 bounds_min{ float(min_cell_x) * cell_size - max_radius, float(min_cell_y) * cell_size - max_radius };
+		glm::vec2 bounds_max{ float(max_cell_x + 1) * cell_size + max_radius, float(max_cell_y + 1) * cell_size + max_radius };
+
+		float t_begin = 0;
+		float t_end = max_distance;
+		for (int axis = 0; axis < 2; ++axis)
+		{
+			if (direction[axis] == 0)
+			{
+				if (origin[axis] < bounds_min[axis] || origin[axis] > bounds_max[axis])
+					return -1;
+				continue;
+			}
+
+			float t0 = (bounds_min[axis] - origin[axis]) / direction[axis];
+			float t1 = (bounds_max[axis] - origin[axis]) / direction[axis];
+			if (t0 > t1)
+				std::swap(t0, t1);
+
+			t_begin = std::max(t_begin, t0);
+			t_end = std::min(t_end, t1);
+		}
+
+		if (t_begin > t_end)
+			return -1;
+
+		const float infinity = std::numeric_limits<float>::infinity();
+		glm::vec2 start = origin + direction * t_begin;
+		int cell_x = CellX(start.x);
+		int cell_y = CellY(start.y);
+
+		int step_x = direction.x > 0 ? 1 : (direction.x < 0 ? -1 : 0);
+		int step_y = direction.y > 0 ? 1 : (direction.y < 0 ? -1 : 0);
+
+		float t_next_x = step_x == 0 ? infinity : (float(cell_x + (step_x > 0)) * cell_size - origin.x) / direction.x;
+		float t_next_y = step_y == 0 ? infinity : (float(cell_y + (step_y > 0)) * cell_size - origin.y) / direction.y;
+		float t_delta_x = step_x == 0 ? infinity : cell_size / std::abs(direction.x);
+		float t_delta_y = step_y == 0 ? infinity : cell_size / std::abs(direction.y);
+
+		float best_t = t_end;
+		int best_slot = -1;
+		auto visit = [&](int slot)
+		{
+			glm::vec2 to_center{ sorted_x[slot] - origin.x, sorted_y[slot] - origin.y };
+			float radius2 = sorted_radius[slot] * sorted_radius[slot];
+			float t_closest = glm::dot(to_center, direction);
+			float miss2 = glm::dot(to_center, to_center) - t_closest * t_closest;
+			if (miss2 > radius2)
+				return true;
+
+			float half_chord = std::sqrt(radius2 - miss2);
+			float t = t_closest - half_chord;
+			if (t < 0)
+				t = t_closest + half_chord < 0 ? infinity : 0;
+
+			if (t <= best_t)
+			{
+				best_t = t;
+				best_slot = slot;
+			}
+			return true;
+		};
+
+		// A circle can spill this many cells away from the cell holding its center.
+		int spill = int(std::ceil(max_radius * inverse_cell_size));
+
+		// Cells are entered in order of distance, so stop once past the best hit.
+		float t_enter = t_begin;
+		while (t_enter <= best_t)
+		{
+			VisitCells(cell_x - spill, cell_y - spill, cell_x + spill, cell_y + spill, visit);
+
+			if (t_next_x < t_next_y)
+			{
+				t_enter = t_next_x;
+				t_next_x += t_delta_x;
+				cell_x += step_x;
+			}
+			else
+			{
+				t_enter = t_next_y;
+				t_next_y += t_delta_y;
+				cell_y += step_y;
+			}
+		}
+
+		if (best_slot < 0)
+			return -1;
+
+		if (hit_distance)
+			*hit_distance = best_t;
+
+		return sorted_index[best_slot];
+	}
+
+	float SpatialGrid::GetCellSize() const
+	{
+		return cell_size;
+	}
+
+	int SpatialGrid::GetCount() const
+	{
+		return count;
+	}
+
+	namespace Spatial
+	{
+		SpatialGrid object_grid;
+
+		std::array<float, MAX_OBJECTS> object_x;
+		std::array<float, MAX_OBJECTS> object_y;
+		std::array<float, MAX_OBJECTS> object_radius;
+		std::array<int, MAX_OBJECTS> scratch;
+
+		int ToObjects(int found, Object ** results)
+		{
+			auto & objects = Object::GetObjects();
+			for (int i = 0; i < found; ++i)
+				results[i] = &objects[scratch[i]];
+			return found;
+		}
+
+		void Update()
+		{
+			Trace::Scope scope("Spatial::Update");
+
+			auto & objects = Object::GetObjects();
+			int num_objects = Object::GetNumObjects();
+
+			for (int i = 0; i < num_objects; ++i)
+			{
+				glm::vec2 position = objects[i].transform->GetPosition();
+				glm::vec2 size = objects[i].transform->GetSize();
+
+				object_x[i] = position.x;
+				object_y[i] = position.y;
+				object_radius[i] = .5f * std::max(size.x, size.y);
+			}
+
+			object_grid.Build(object_x.data(), object_y.data(), object_radius.data(), num_objects);
+		}
+
+		int QueryRadius(glm::vec2 center, float radius, Object ** results, int max_results)
+		{
+			return ToObjects(object_grid.QueryRadius(center, radius, scratch.data(), std::min(max_results, MAX_OBJECTS)), results);
+		}
+
+		int QueryAABB(glm::vec2 min, glm::vec2 max, Object ** results, int max_results)
+		{
+			return ToObjects(object_grid.QueryAABB(min, max, scratch.data(), std::min(max_results, MAX_OBJECTS)), results);
+		}
+
+		int QueryNearest(glm::vec2 point, int k, Object ** results, float max_distance)
+		{
+			return ToObjects(object_grid.QueryNearest(point, std::min(k, MAX_OBJECTS), scratch.data(), max_distance), results);
+		}
+
+		Object * Raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, float * hit_distance)
+		{
+			int index = object_grid.Raycast(origin, direction, max_distance, hit_distance);
+			return index < 0 ? nullptr : &Object::GetObjects()[index];
+		}
+
+		const SpatialGrid & GetObjectGrid()
+		{
+			return object_grid;
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "Core.h"
+
+#include <limits>
+
+namespace Engine
+{
+	class Object;
+
+	// Uniform grid whose cells are hashed into a fixed number of buckets, so the world needs no bounds.
+	// Results are written into caller supplied buffers and queries never allocate.
+	class SpatialGrid
+	{
+	public:
+		SpatialGrid(float cell_size = 1.f, int capacity = MAX_OBJECTS);
+
+		void Build(const float * x, const float * y, const float * radii, int count);
+
+		int QueryRadius(glm::vec2 center, float radius, int * results, int max_results) const;
+		int QueryAABB(glm::vec2 min, glm::vec2 max, int * results, int max_results) const;
+		int QueryNearest(glm::vec2 point, int k, int * results,
+			float max_distance = std::numeric_limits<float>::max()) const;
+		int Raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, float * hit_distance = nullptr) const;
+
+		float GetCellSize() const;
+		int GetCount() const;
+	private:
+		int CellX(float x) const;
+		int CellY(float y) const;
+		uint32_t Bucket(int cell_x, int cell_y) const;
+		static uint64_t CellKey(int cell_x, int cell_y);
+
+		template<typename Visitor>
+		bool VisitCells(int x0, int y0, int x1, int y1, Visitor && visit) const;
+
+		float cell_size;
+		float inverse_cell_size;
+		uint32_t bucket_mask{};
+		int count{};
+
+		int min_cell_x{}, min_cell_y{};
+		int max_cell_x{}, max_cell_y{};
+		float max_radius{};
+
+		std::vector<int> bucket_start;
+		std::vector<uint32_t> item_bucket;
+		std::vector<uint64_t> item_cell;
+
+		// Entries sorted by bucket so a cell's contents are contiguous.
+		std::vector<float> sorted_x;
+		std::vector<float> sorted_y;
+		std::vector<float> sorted_radius;
+		std::vector<uint64_t> sorted_cell;
+		std::vector<int> sorted_index;
+	};
+
+	namespace Spatial
+	{
+		void Update();
+
+		int QueryRadius(glm::vec2 center, float radius, Object ** results, int max_results);
+		int QueryAABB(glm::vec2 min, glm::vec2 max, Object ** results, int max_results);
+		int QueryNearest(glm::vec2 point, int k, Object ** results,
+			float max_distance = std::numeric_limits<float>::max());
+		Object * Raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, float * hit_distance = nullptr);
+
+		const SpatialGrid & GetObjectGrid();
+	}
+}
@@ -10,10 +10,17 @@ namespace Engine
 	{
 		Sprite * sprite = &all_sprites[num_sprites++];
 		sprite->texture = Texture::GetTexture(0);
+		sprite->clip = -1;
 		sprite->SetSubsprite(0);
 		return sprite;
 	}
 
+	void Sprite::ClearSprites()
+	{
+		num_sprites = 0;
+		RequestRedraw();
+	}
+
 	std::array<Sprite, MAX_SPRITES> & Sprite::GetSprites()
 	{
 		return all_sprites;
@@ -27,6 +34,8 @@ namespace Engine
 	void Engine::Sprite::SetTexture(Texture * new_texture)
 	{
 		texture = new_texture;
+		clip = -1;
+		RequestRedraw();
 	}
 
 	Texture * Sprite::GetTexture()
@@ -37,7 +46,10 @@ namespace Engine
 	void Sprite::SetSubsprite(int new_subsprite)
 	{
 		subsprite = new_subsprite;
+		clip = -1;
 		tex_offset = texture->GetOffset(subsprite);
+		mesh = texture->GetMesh(subsprite);
+		RequestRedraw();
 	}
 
 	const int Sprite::GetSubsprite() const
@@ -49,4 +61,50 @@ namespace Engine
 	{
 		return tex_offset;
 	}
+
+	uint32_t Sprite::GetMesh() const
+	{
+		return mesh;
+	}
+
+	void Sprite::Play(int new_clip, float offset)
+	{
+		const AnimationClip & animation = Texture::GetClip(new_clip);
+
+		// The first frame stands in wherever the sprite is read on the CPU, such as for the pipeline.
+		SetTexture(animation.texture);
+		SetSubsprite(animation.first_subsprite);
+
+		clip = new_clip;
+		clip_start = float(GetTimeElapsed() - offset);
+		clip_end = clip_start + animation.GetDuration();
+	}
+
+	void Sprite::Stop()
+	{
+		SetSubsprite(GetCurrentSubsprite());
+	}
+
+	int Sprite::GetClip() const
+	{
+		return clip;
+	}
+
+	float Sprite::GetClipStart() const
+	{
+		return clip_start;
+	}
+
+	bool Sprite::IsAnimating() const
+	{
+		return clip >= 0 && GetTimeElapsed() < clip_end;
+	}
+
+	int Sprite::GetCurrentSubsprite() const
+	{
+		if (clip < 0)
+			return subsprite;
+
+		return Texture::GetClip(clip).GetSubsprite(float(GetTimeElapsed() - clip_start));
+	}
 }
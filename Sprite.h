@@ -7,6 +7,7 @@ namespace Engine
 	{
 	public:
 		static Sprite * NewSprite();
+		static void ClearSprites();
 		static std::array<Sprite, MAX_SPRITES> & GetSprites();
 		static int GetNumSprites();
 
@@ -16,9 +17,27 @@ namespace Engine
 		void SetSubsprite(int new_subsprite);
 		const int GetSubsprite() const;
 		const glm::mat3 GetTexOffset() const;
+		uint32_t GetMesh() const;
+
+		// Animates the sprite with a clip from Texture::AddClip, starting offset seconds in. Switches to the clip's
+		// texture, and stops again when the texture or sub sprite is set.
+		void Play(int clip, float offset = 0);
+		void Stop();
+		// The clip playing, or -1.
+		int GetClip() const;
+		// The time the clip started, in GetTimeElapsed seconds.
+		float GetClipStart() const;
+		// Whether the clip still changes frame, so on demand rendering has to keep drawing.
+		bool IsAnimating() const;
+		// The sub sprite showing now, following the clip if one is playing.
+		int GetCurrentSubsprite() const;
 	private:
 		Texture * texture{};
 		int subsprite{};
 		glm::mat3 tex_offset{ 1 };
+		uint32_t mesh{};
+		int clip{ -1 };
+		float clip_start{};
+		float clip_end{};
 	};
 }
@@ -0,0 +1,90 @@
+#include "StaticLayer.h"
+#include "TileMap.h"
+
+namespace Engine
+{
+	std::array<StaticLayer, MAX_STATIC_LAYERS> all_layers;
+	int num_layers = 0;
+
+	// Shared between layers, so a layer reusing a slot never matches the version cached for the last one.
+	uint64_t next_layer_version = 0;
+
+	StaticLayer * StaticLayer::NewLayer()
+	{
+		if (num_layers >= MAX_STATIC_LAYERS)
+			throw std::runtime_error(std::format("No more than {} static layers.", MAX_STATIC_LAYERS));
+
+		StaticLayer * layer = &all_layers[num_layers++];
+		layer->ClearTiles();
+		return layer;
+	}
+
+	void StaticLayer::ClearLayers()
+	{
+		num_layers = 0;
+		RequestRedraw();
+	}
+
+	std::array<StaticLayer, MAX_STATIC_LAYERS> & StaticLayer::GetLayers()
+	{
+		return all_layers;
+	}
+
+	int StaticLayer::GetNumLayers()
+	{
+		return num_layers;
+	}
+
+	void StaticLayer::AddTile(glm::vec2 position, float size, Texture * texture, int subsprite)
+	{
+		if (tiles.size() >= MAX_LAYER_TILES)
+			throw std::runtime_error(std::format("No more than {} tiles in a static layer.", MAX_LAYER_TILES));
+
+		tiles.push_back({ position, size, texture, subsprite });
+		Modified();
+	}
+
+	void StaticLayer::AddTiles(const TileMap & map, const std::string & layer_name, const std::unordered_map<std::string, Texture *> & tileset_textures)
+	{
+		for (const auto & layer : map.GetLayers())
+		{
+			if (layer.name != layer_name)
+				continue;
+
+			for (int y = 0; y < map.GetHeight(); ++y)
+				for (int x = 0; x < map.GetWidth(); ++x)
+				{
+					int gid = layer.tiles[size_t(y) * map.GetWidth() + x];
+					const auto * tileset = map.FindTileset(gid);
+					if (tileset == nullptr)
+						continue;
+
+					auto texture = tileset_textures.find(tileset->name);
+					if (texture != tileset_textures.end())
+						AddTile(map.TileToWorld(x, y), map.tile_size, texture->second, gid - tileset->first_gid);
+				}
+		}
+	}
+
+	void StaticLayer::ClearTiles()
+	{
+		tiles.clear();
+		Modified();
+	}
+
+	const std::vector<StaticLayer::Tile> & StaticLayer::GetTiles() const
+	{
+		return tiles;
+	}
+
+	uint64_t StaticLayer::GetVersion() const
+	{
+		return version;
+	}
+
+	void StaticLayer::Modified()
+	{
+		version = ++next_layer_version;
+		RequestRedraw();
+	}
+}
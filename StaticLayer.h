@@ -0,0 +1,44 @@
+#pragma once
+#include "Core.h"
+
+#include <unordered_map>
+
+namespace Engine
+{
+	class TileMap;
+
+	// Background that rarely changes, such as a map's floor and walls. The renderer draws each layer once into a cached
+	// texture covering a margin around the view, and composites that behind the objects every frame. The cache is only
+	// redrawn when the layer changes or the camera leaves the cached area.
+	class StaticLayer
+	{
+	public:
+		struct Tile
+		{
+			glm::vec2 position;
+			float size;
+			Texture * texture;
+			int subsprite;
+		};
+
+		// Layers are composited in the order they were made, the first furthest back.
+		static StaticLayer * NewLayer();
+		static void ClearLayers();
+		static std::array<StaticLayer, MAX_STATIC_LAYERS> & GetLayers();
+		static int GetNumLayers();
+
+		void AddTile(glm::vec2 position, float size, Texture * texture, int subsprite);
+		// A tile for every cell of the named map layer, with each tileset's texture looked up by name.
+		void AddTiles(const TileMap & map, const std::string & layer_name, const std::unordered_map<std::string, Texture *> & tileset_textures);
+		void ClearTiles();
+
+		const std::vector<Tile> & GetTiles() const;
+		// Changes whenever the tiles do, so the renderer can tell when its cache is stale.
+		uint64_t GetVersion() const;
+	private:
+		void Modified();
+
+		std::vector<Tile> tiles;
+		uint64_t version{};
+	};
+}
@@ -0,0 +1,152 @@
+#include "Stats.h"
+#include "Renderer.h"
+#include "Input.h"
+#include "Text.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+namespace Engine
+{
+	namespace Stats
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		FrameStats current;
+		FrameStats last;
+		Clock::time_point frame_start;
+
+		bool overlay_visible = false;
+
+		std::ofstream csv;
+		int csv_interval = 60;
+		int csv_frames = 0;
+		FrameStats csv_sum;
+		float csv_max_cpu_frame_time = 0;
+
+		void WriteCsvRow()
+		{
+			double frames = double(csv_frames);
+			csv << std::format("{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.1f},{:.1f},{:.0f},{},{},{},{}\n",
+				GetFrameCount(), GetTimeElapsed(),
+				csv_sum.cpu_frame_time / frames * 1000., csv_max_cpu_frame_time * 1000.,
+				csv_sum.gpu_frame_time / frames * 1000., csv_sum.fence_wait_time / frames * 1000., csv_sum.latency / frames * 1000.,
+				csv_sum.draw_calls / frames, csv_sum.instances / frames, double(csv_sum.bytes_uploaded) / frames,
+				last.swap_chain_recreations, last.texture_memory, last.target_memory, last.layer_redraws);
+			csv.flush();
+
+			csv_sum = {};
+			csv_max_cpu_frame_time = 0;
+			csv_frames = 0;
+		}
+
+		void AccumulateCsv()
+		{
+			csv_sum.cpu_frame_time += last.cpu_frame_time;
+			csv_sum.gpu_frame_time += last.gpu_frame_time;
+			csv_sum.fence_wait_time += last.fence_wait_time;
+			csv_sum.latency += last.latency;
+			csv_sum.draw_calls += last.draw_calls;
+			csv_sum.instances += last.instances;
+			csv_sum.bytes_uploaded += last.bytes_uploaded;
+			csv_max_cpu_frame_time = std::max(csv_max_cpu_frame_time, last.cpu_frame_time);
+
+			if (++csv_frames >= csv_interval)
+				WriteCsvRow();
+		}
+
+		// Queued now, so it's drawn with the next frame and always shows the last complete one.
+		void DrawOverlay()
+		{
+			const float LINE_HEIGHT = float(Text::GLYPH_SIZE * 2 + 4);
+			glm::vec2 position{ 8, 8 };
+
+			auto line = [&](std::string text)
+			{
+				Text::Draw(position, text);
+				position.y += LINE_HEIGHT;
+			};
+
+			line(std::format("cpu {:6.2f} ms  gpu {:6.2f} ms", last.cpu_frame_time * 1000.f, last.gpu_frame_time * 1000.f));
+			line(std::format("fence wait {:6.2f} ms  latency {:6.2f} ms", last.fence_wait_time * 1000.f, last.latency * 1000.f));
+			line(std::format("draws {}  instances {}", last.draw_calls, last.instances));
+			line(std::format("uploaded {:.1f} KB", double(last.bytes_uploaded) / 1024.));
+			line(std::format("textures {:.1f} MB  targets {:.1f} MB", double(last.texture_memory) / (1024. * 1024.),
+				double(last.target_memory) / (1024. * 1024.)));
+			line(std::format("swap chain recreations {}  layer redraws {}", last.swap_chain_recreations, last.layer_redraws));
+		}
+
+		void BeginFrame()
+		{
+			FrameStats next{};
+			next.swap_chain_recreations = current.swap_chain_recreations;
+			next.texture_memory = current.texture_memory;
+			next.target_memory = current.target_memory;
+			next.layer_redraws = current.layer_redraws;
+			current = next;
+
+			frame_start = Clock::now();
+		}
+
+		void EndFrame()
+		{
+			current.cpu_frame_time = std::chrono::duration<float>(Clock::now() - frame_start).count();
+			current.gpu_frame_time = Graphics::GetGpuFrameTime();
+			last = current;
+
+			if (csv.is_open())
+				AccumulateCsv();
+
+			if (Input::IsPressed(Input::Key::ToggleStats))
+				SetOverlayVisible(!overlay_visible);
+
+			if (overlay_visible)
+				DrawOverlay();
+		}
+
+		void Shutdown()
+		{
+			if (csv.is_open() && csv_frames > 0)
+				WriteCsvRow();
+
+			csv.close();
+		}
+
+		FrameStats & Current()
+		{
+			return current;
+		}
+
+		const FrameStats & GetLast()
+		{
+			return last;
+		}
+
+		void StartCsv(std::string filename, int interval)
+		{
+			csv.open(filename);
+			if (!csv.is_open())
+			{
+				WriteError(std::format("Failed to open {} for frame stats.", filename));
+				return;
+			}
+
+			csv_interval = std::max(interval, 1);
+			csv << "frame,time,cpu_ms,cpu_max_ms,gpu_ms,fence_wait_ms,latency_ms,draw_calls,instances,bytes_uploaded,swap_chain_recreations,texture_memory,target_memory,layer_redraws\n";
+		}
+
+		void SetOverlayVisible(bool visible)
+		{
+			overlay_visible = visible;
+
+			// Clears the overlay off screen when hidden.
+			RequestRedraw();
+		}
+
+		bool IsOverlayVisible()
+		{
+			return overlay_visible;
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "Core.h"
+
+namespace Engine
+{
+	struct FrameStats
+	{
+		uint32_t draw_calls{};
+		uint32_t instances{};
+		uint64_t bytes_uploaded{};
+		// Seconds Graphics::Update spent blocked waiting for the GPU to finish earlier frames.
+		float fence_wait_time{};
+		float cpu_frame_time{};
+		float gpu_frame_time{};
+		// Seconds from input being polled to the GPU finishing the frame that used it, for a frame a few frames back.
+		float latency{};
+
+		// Running totals, carried over from frame to frame.
+		uint32_t swap_chain_recreations{};
+		uint64_t texture_memory{};
+		// Render targets the render graph allocated, after aliasing.
+		uint64_t target_memory{};
+		// Static layer caches redrawn.
+		uint32_t layer_redraws{};
+	};
+
+	// Per frame counters that are always collected, shown as a text overlay and optionally logged to CSV.
+	namespace Stats
+	{
+		void BeginFrame();
+		void EndFrame();
+		void Shutdown();
+
+		// The frame in progress, systems add to its counters as they go.
+		FrameStats & Current();
+		const FrameStats & GetLast();
+
+		// Appends a row averaged over every interval frames, can be called before Initialize.
+		void StartCsv(std::string filename, int interval = 60);
+
+		void SetOverlayVisible(bool visible);
+		bool IsOverlayVisible();
+	}
+}
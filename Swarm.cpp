@@ -0,0 +1,347 @@
+#include "Swarm.h"
+#include "FlowField.h"
+#include "Transform.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SWARM_SSE2
+#endif
+
+namespace Engine
+{
+	const float SEEK_EPSILON = 1e-6f;
+
+	static inline void ClampLength(float & x, float & y, float max_length)
+	{
+		float length_squared = x * x + y * y;
+		if (length_squared > max_length * max_length)
+		{
+			float scale = max_length / std::sqrt(length_squared);
+			x *= scale;
+			y *= scale;
+		}
+	}
+
+#ifdef SWARM_SSE2
+	static inline void ClampLength(__m128 & x, __m128 & y, __m128 max_length)
+	{
+		__m128 length_squared = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+		__m128 over = _mm_cmpgt_ps(length_squared, _mm_mul_ps(max_length, max_length));
+		__m128 scale = _mm_or_ps(
+			_mm_and_ps(over, _mm_div_ps(max_length, _mm_sqrt_ps(length_squared))),
+			_mm_andnot_ps(over, _mm_set1_ps(1.f)));
+		x = _mm_mul_ps(x, scale);
+		y = _mm_mul_ps(y, scale);
+	}
+#endif
+
+	Swarm::Swarm(int capacity)
+	{
+		position_x.reserve(capacity);
+		position_y.reserve(capacity);
+		velocity_x.reserve(capacity);
+		velocity_y.reserve(capacity);
+		steer_x.reserve(capacity);
+		steer_y.reserve(capacity);
+		separation_x.reserve(capacity);
+		separation_y.reserve(capacity);
+		transforms.reserve(capacity);
+		agent_cell.reserve(capacity);
+		sorted_agent.reserve(capacity);
+		sorted_x.reserve(capacity);
+		sorted_y.reserve(capacity);
+	}
+
+	int Swarm::Add(glm::vec2 position, Transform * transform)
+	{
+		position_x.push_back(position.x);
+		position_y.push_back(position.y);
+		velocity_x.push_back(0);
+		velocity_y.push_back(0);
+		steer_x.push_back(0);
+		steer_y.push_back(0);
+		separation_x.push_back(0);
+		separation_y.push_back(0);
+		transforms.push_back(transform);
+		return count++;
+	}
+
+	void Swarm::Clear()
+	{
+		position_x.clear();
+		position_y.clear();
+		velocity_x.clear();
+		velocity_y.clear();
+		steer_x.clear();
+		steer_y.clear();
+		separation_x.clear();
+		separation_y.clear();
+		transforms.clear();
+		count = 0;
+	}
+
+	int Swarm::GetCount() const
+	{
+		return count;
+	}
+
+	void Swarm::SetTarget(glm::vec2 new_target)
+	{
+		target = new_target;
+	}
+
+	void Swarm::SetFlowField(const FlowField * new_flow_field)
+	{
+		flow_field = new_flow_field;
+	}
+
+	void Swarm::Update(float delta_time)
+	{
+		if (count == 0)
+			return;
+
+		Seek();
+		Separate();
+		Integrate(delta_time);
+
+		for (int i = 0; i < count; ++i)
+			if (transforms[i])
+				transforms[i]->SetPosition(position_x[i], position_y[i]);
+
+		++frame;
+	}
+
+	glm::vec2 Swarm::GetPosition(int agent) const
+	{
+		return glm::vec2(position_x[agent], position_y[agent]);
+	}
+
+	glm::vec2 Swarm::GetVelocity(int agent) const
+	{
+		return glm::vec2(velocity_x[agent], velocity_y[agent]);
+	}
+
+	// Desired velocity is max speed toward the target, steering is the difference from the current velocity.
+	void Swarm::Seek()
+	{
+		int i = 0;
+
+		if (flow_field && flow_field->IsReady())
+		{
+			for (; i < count; ++i)
+			{
+				glm::vec2 direction = flow_field->Sample(glm::vec2(position_x[i], position_y[i]));
+
+				// The target's own cell and unreachable cells have no direction, so head straight for it.
+				if (direction.x == 0 && direction.y == 0)
+				{
+					direction = target - glm::vec2(position_x[i], position_y[i]);
+					float length_squared = direction.x * direction.x + direction.y * direction.y;
+					direction = length_squared > SEEK_EPSILON ? direction / std::sqrt(length_squared) : glm::vec2(0, 0);
+				}
+
+				steer_x[i] = (direction.x * max_speed - velocity_x[i]) * seek_weight;
+				steer_y[i] = (direction.y * max_speed - velocity_y[i]) * seek_weight;
+			}
+			return;
+		}
+
+#ifdef SWARM_SSE2
+		const __m128 target_x4 = _mm_set1_ps(target.x);
+		const __m128 target_y4 = _mm_set1_ps(target.y);
+		const __m128 speed4 = _mm_set1_ps(max_speed);
+		const __m128 weight4 = _mm_set1_ps(seek_weight);
+		const __m128 epsilon4 = _mm_set1_ps(SEEK_EPSILON);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 dx = _mm_sub_ps(target_x4, _mm_loadu_ps(&position_x[i]));
+			__m128 dy = _mm_sub_ps(target_y4, _mm_loadu_ps(&position_y[i]));
+			__m128 length_squared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+			// Lanes already on the target get a zero desired velocity instead of dividing by zero.
+			__m128 scale = _mm_and_ps(_mm_cmpgt_ps(length_squared, epsilon4),
+				_mm_div_ps(speed4, _mm_sqrt_ps(length_squared)));
+
+			__m128 sx = _mm_sub_ps(_mm_mul_ps(dx, scale), _mm_loadu_ps(&velocity_x[i]));
+			__m128 sy = _mm_sub_ps(_mm_mul_ps(dy, scale), _mm_loadu_ps(&velocity_y[i]));
+			_mm_storeu_ps(&steer_x[i], _mm_mul_ps(sx, weight4));
+			_mm_storeu_ps(&steer_y[i], _mm_mul_ps(sy, weight4));
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			float dx = target.x - position_x[i];
+			float dy = target.y - position_y[i];
+			float length_squared = dx * dx + dy * dy;
+			float scale = length_squared > SEEK_EPSILON ? max_speed / std::sqrt(length_squared) : 0.f;
+
+			steer_x[i] = (dx * scale - velocity_x[i]) * seek_weight;
+			steer_y[i] = (dy * scale - velocity_y[i]) * seek_weight;
+		}
+	}
+
+	// Push away from neighbours inside the separation radius, fading linearly to zero at its edge.
+	void Swarm::Separate()
+	{
+		if (separation_weight == 0 || separation_radius <= 0)
+			return;
+
+		float min_x = position_x[0];
+		float min_y = position_y[0];
+		float max_x = min_x;
+		float max_y = min_y;
+		for (int i = 1; i < count; ++i)
+		{
+			min_x = std::min(min_x, position_x[i]);
+			min_y = std::min(min_y, position_y[i]);
+			max_x = std::max(max_x, position_x[i]);
+			max_y = std::max(max_y, position_y[i]);
+		}
+
+		// Cells are at least the separation radius so neighbours always lie in the surrounding 3x3,
+		// and grow when the swarm is spread out so the grid stays proportional to the agent count.
+		float width = max_x - min_x;
+		float height = max_y - min_y;
+		float cell_size = separation_radius;
+		float max_cells = float(count) * 4 + 1024;
+		if (width * height > cell_size * cell_size * max_cells)
+			cell_size = std::sqrt(width * height / max_cells);
+
+		// A swarm strung out along a line has no area, so each axis is capped on its own as well.
+		cell_size = std::max({ cell_size, width / max_cells, height / max_cells });
+
+		float inverse_cell_size = 1.f / cell_size;
+		int columns = int(width * inverse_cell_size) + 1;
+		int rows = int(height * inverse_cell_size) + 1;
+		int num_cells = columns * rows;
+
+		agent_cell.resize(count);
+		sorted_agent.resize(count);
+		sorted_x.resize(count);
+		sorted_y.resize(count);
+		cell_start.assign(size_t(num_cells) + 1, 0);
+
+		for (int i = 0; i < count; ++i)
+		{
+			int cell = int((position_y[i] - min_y) * inverse_cell_size) * columns + int((position_x[i] - min_x) * inverse_cell_size);
+			agent_cell[i] = cell;
+			++cell_start[cell];
+		}
+
+		// Counting sort: turn counts into cell ends, then fill backwards so each end becomes a start.
+		for (int cell = 1; cell < num_cells; ++cell)
+			cell_start[cell] += cell_start[cell - 1];
+		cell_start[num_cells] = count;
+
+		for (int i = count - 1; i >= 0; --i)
+		{
+			int slot = --cell_start[agent_cell[i]];
+			sorted_agent[slot] = i;
+			sorted_x[slot] = position_x[i];
+			sorted_y[slot] = position_y[i];
+		}
+
+		int interval = std::max(separation_interval, 1);
+		int phase = frame % interval;
+		float radius_squared = separation_radius * separation_radius;
+		float inverse_radius = 1.f / separation_radius;
+
+		// Walking cells in order keeps the three neighbouring rows, each one contiguous run of slots, in cache.
+		for (int row = 0; row < rows; ++row)
+			for (int column = 0; column < columns; ++column)
+			{
+				int cell = row * columns + column;
+				for (int slot = cell_start[cell]; slot < cell_start[cell + 1]; ++slot)
+				{
+					int agent = sorted_agent[slot];
+					if (agent % interval != phase)
+						continue;
+
+					float x = sorted_x[slot];
+					float y = sorted_y[slot];
+					float push_x = 0;
+					float push_y = 0;
+					int found = 0;
+
+					for (int neighbour_row = std::max(row - 1, 0); neighbour_row <= std::min(row + 1, rows - 1); ++neighbour_row)
+					{
+						int first = cell_start[neighbour_row * columns + std::max(column - 1, 0)];
+						int last = cell_start[neighbour_row * columns + std::min(column + 1, columns - 1) + 1];
+
+						for (int other = first; other < last && found < max_neighbours; ++other)
+						{
+							float dx = x - sorted_x[other];
+							float dy = y - sorted_y[other];
+							float distance_squared = dx * dx + dy * dy;
+							if (other == slot || distance_squared >= radius_squared)
+								continue;
+
+							++found;
+
+							// Stacked agents split along x by index so they don't stay stuck together.
+							float distance = std::sqrt(distance_squared);
+							if (distance < SEEK_EPSILON)
+							{
+								push_x += slot < other ? -1.f : 1.f;
+								continue;
+							}
+
+							float strength = (separation_radius - distance) * inverse_radius / distance;
+							push_x += dx * strength;
+							push_y += dy * strength;
+						}
+					}
+
+					separation_x[agent] = push_x;
+					separation_y[agent] = push_y;
+				}
+			}
+	}
+
+	void Swarm::Integrate(float delta_time)
+	{
+		int i = 0;
+
+#ifdef SWARM_SSE2
+		const __m128 separation_weight4 = _mm_set1_ps(separation_weight);
+		const __m128 force4 = _mm_set1_ps(max_force);
+		const __m128 speed4 = _mm_set1_ps(max_speed);
+		const __m128 delta_time4 = _mm_set1_ps(delta_time);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 sx = _mm_add_ps(_mm_loadu_ps(&steer_x[i]), _mm_mul_ps(_mm_loadu_ps(&separation_x[i]), separation_weight4));
+			__m128 sy = _mm_add_ps(_mm_loadu_ps(&steer_y[i]), _mm_mul_ps(_mm_loadu_ps(&separation_y[i]), separation_weight4));
+			ClampLength(sx, sy, force4);
+
+			__m128 vx = _mm_add_ps(_mm_loadu_ps(&velocity_x[i]), _mm_mul_ps(sx, delta_time4));
+			__m128 vy = _mm_add_ps(_mm_loadu_ps(&velocity_y[i]), _mm_mul_ps(sy, delta_time4));
+			ClampLength(vx, vy, speed4);
+			_mm_storeu_ps(&velocity_x[i], vx);
+			_mm_storeu_ps(&velocity_y[i], vy);
+
+			_mm_storeu_ps(&position_x[i], _mm_add_ps(_mm_loadu_ps(&position_x[i]), _mm_mul_ps(vx, delta_time4)));
+			_mm_storeu_ps(&position_y[i], _mm_add_ps(_mm_loadu_ps(&position_y[i]), _mm_mul_ps(vy, delta_time4)));
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			float sx = steer_x[i] + separation_x[i] * separation_weight;
+			float sy = steer_y[i] + separation_y[i] * separation_weight;
+			ClampLength(sx, sy, max_force);
+
+			velocity_x[i] += sx * delta_time;
+			velocity_y[i] += sy * delta_time;
+			ClampLength(velocity_x[i], velocity_y[i], max_speed);
+
+			position_x[i] += velocity_x[i] * delta_time;
+			position_y[i] += velocity_y[i] * delta_time;
+		}
+	}
+}
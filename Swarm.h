@@ -0,0 +1,64 @@
+#pragma once
+#include "Core.h"
+
+namespace Engine
+{
+	class FlowField;
+
+	// Batch steering over structure-of-arrays agents: seek toward a target (or along a flow field),
+	// separate from grid neighbours, clamp force and speed, then integrate.
+	// Agents added with a Transform have their position written back every Update.
+	class Swarm
+	{
+	public:
+		Swarm(int capacity = MAX_OBJECTS);
+
+		int Add(glm::vec2 position, Transform * transform = nullptr);
+		void Clear();
+		int GetCount() const;
+
+		void SetTarget(glm::vec2 new_target);
+		void SetFlowField(const FlowField * new_flow_field);
+
+		void Update(float delta_time);
+
+		glm::vec2 GetPosition(int agent) const;
+		glm::vec2 GetVelocity(int agent) const;
+
+		float max_speed{ 1.5f };
+		float max_force{ 6.f };
+		float seek_weight{ 1.f };
+		float separation_weight{ 2.f };
+		float separation_radius{ 0.6f };
+		int max_neighbours{ 8 };
+
+		// Refresh separation for one in every N agents per Update, reusing the cached force for the rest.
+		int separation_interval{ 1 };
+	private:
+		void Seek();
+		void Separate();
+		void Integrate(float delta_time);
+
+		glm::vec2 target{ 0, 0 };
+		const FlowField * flow_field{};
+		int count{};
+		int frame{};
+
+		std::vector<float> position_x;
+		std::vector<float> position_y;
+		std::vector<float> velocity_x;
+		std::vector<float> velocity_y;
+		std::vector<float> steer_x;
+		std::vector<float> steer_y;
+		std::vector<float> separation_x;
+		std::vector<float> separation_y;
+		std::vector<Transform *> transforms;
+
+		// Agents counting sorted into a dense grid over the swarm's bounds, rebuilt every Separate.
+		std::vector<int> agent_cell;
+		std::vector<int> cell_start;
+		std::vector<int> sorted_agent;
+		std::vector<float> sorted_x;
+		std::vector<float> sorted_y;
+	};
+}
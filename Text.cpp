@@ -0,0 +1,150 @@
+#include "Text.h"
+#include "Texture.h"
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include <stb_truetype.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+
+namespace Engine
+{
+	namespace Text
+	{
+		const char * FONT_FILE = "assets/DawnLike/GUI/SDS_8x8.ttf";
+
+		// The quad's u runs right to left, flip it so glyphs read the right way round.
+		const glm::mat3 FLIP_U{ { -1, 0, 0 }, { 0, 1, 0 }, { 1, 0, 1 } };
+
+		struct Glyph
+		{
+			glm::vec2 position;
+			float size;
+			int index;
+
+			bool operator==(const Glyph &) const = default;
+		};
+
+		Texture * font = nullptr;
+		// Queued since the last Update, and what the frames since the last change have drawn.
+		std::vector<Glyph> glyphs;
+		std::vector<Glyph> drawn_glyphs;
+
+		void Initialize()
+		{
+			glyphs.reserve(MAX_GLYPHS);
+			drawn_glyphs.reserve(MAX_GLYPHS);
+
+			if (config.headless)
+				return;
+
+			std::ifstream file(FONT_FILE, std::ios::binary);
+			if (!file.is_open())
+				throw std::runtime_error(std::format("Failed to open {}.", FONT_FILE));
+
+			std::vector<uint8_t> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+			stbtt_fontinfo info;
+			if (!stbtt_InitFont(&info, data.data(), stbtt_GetFontOffsetForIndex(data.data(), 0)))
+				throw std::runtime_error(std::format("{} is not a valid font.", FONT_FILE));
+
+			float scale = stbtt_ScaleForPixelHeight(&info, float(GLYPH_SIZE));
+			int ascent;
+			stbtt_GetFontVMetrics(&info, &ascent, nullptr, nullptr);
+			int baseline = int(std::round(float(ascent) * scale));
+
+			const int width = GLYPH_COLUMNS * GLYPH_SIZE;
+			const int height = GLYPH_ROWS * GLYPH_SIZE;
+			std::vector<uint8_t> pixels(size_t(width) * height * 4, 0);
+			std::array<uint8_t, GLYPH_SIZE * GLYPH_SIZE> coverage;
+
+			for (int glyph = 0; glyph < GLYPH_COLUMNS * GLYPH_ROWS; ++glyph)
+			{
+				int codepoint = FIRST_GLYPH + glyph;
+				int x0, y0, x1, y1;
+				stbtt_GetCodepointBitmapBox(&info, codepoint, scale, scale, &x0, &y0, &x1, &y1);
+
+				// Anything reaching outside its cell is cropped.
+				int left = std::max(x0, 0);
+				int top = std::max(baseline + y0, 0);
+				int glyph_width = std::min(x1 - x0, GLYPH_SIZE - left);
+				int glyph_height = std::min(y1 - y0, GLYPH_SIZE - top);
+				if (glyph_width <= 0 || glyph_height <= 0)
+					continue;
+
+				coverage.fill(0);
+				stbtt_MakeCodepointBitmap(&info, coverage.data(), glyph_width, glyph_height, GLYPH_SIZE, scale, scale, codepoint);
+
+				// The fragment shader discards anything not fully opaque, so coverage is thresholded.
+				int cell_x = (glyph % GLYPH_COLUMNS) * GLYPH_SIZE + left;
+				int cell_y = (glyph / GLYPH_COLUMNS) * GLYPH_SIZE + top;
+				for (int y = 0; y < glyph_height; ++y)
+					for (int x = 0; x < glyph_width; ++x)
+						if (coverage[y * GLYPH_SIZE + x] >= 128)
+							std::fill_n(&pixels[(size_t(cell_y + y) * width + cell_x + x) * 4], 4, uint8_t(255));
+			}
+
+			font = Texture::AddTexture(pixels.data(), width, height, GLYPH_COLUMNS, GLYPH_ROWS);
+		}
+
+		void Draw(glm::vec2 position, std::string_view text, int scale)
+		{
+			if (font == nullptr)
+				return;
+
+			float size = float(GLYPH_SIZE * std::max(scale, 1));
+			for (char character : text)
+			{
+				if (glyphs.size() >= MAX_GLYPHS)
+					return;
+
+				int index = character - FIRST_GLYPH;
+				if (index < 0 || index >= GLYPH_COLUMNS * GLYPH_ROWS)
+					index = '?' - FIRST_GLYPH;
+
+				if (character != ' ')
+					glyphs.push_back({ position, size, index });
+
+				position.x += size;
+			}
+		}
+
+		void Update()
+		{
+			// Most text is queued again unchanged every frame, which needs no new frame.
+			if (glyphs != drawn_glyphs)
+			{
+				drawn_glyphs.swap(glyphs);
+				RequestRedraw();
+			}
+
+			glyphs.clear();
+		}
+
+		int ComposeGlyphs(glm::mat4 * models, glm::mat3 * tex_offsets, int max_glyphs)
+		{
+			int count = std::min(int(drawn_glyphs.size()), max_glyphs);
+
+			for (int i = 0; i < count; ++i)
+			{
+				const Glyph & glyph = drawn_glyphs[i];
+
+				models[i] = glm::mat4(1);
+				models[i][0][0] = glyph.size;
+				models[i][1][1] = glyph.size;
+				models[i][3] = glm::vec4(glyph.position + glyph.size * .5f, 0, 1);
+
+				tex_offsets[i] = font->GetOffset(glyph.index) * FLIP_U;
+			}
+
+			return count;
+		}
+
+		Texture * GetFont()
+		{
+			return font;
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "Core.h"
+
+#include <string_view>
+
+namespace Engine
+{
+	// Screen space text from the GUI pixel font, baked into a sheet of ASCII glyphs at startup.
+	namespace Text
+	{
+		const int GLYPH_SIZE = 8;
+		const int GLYPH_COLUMNS = 16;
+		const int GLYPH_ROWS = 6;
+		const char FIRST_GLYPH = ' ';
+
+		void Initialize();
+
+		// Queues text to be drawn on the next frame, in window pixels from the top left.
+		// Scale is a whole number of pixels per font pixel so the font stays crisp.
+		void Draw(glm::vec2 position, std::string_view text, int scale = 2);
+
+		// Takes the glyphs queued since the last call, requesting a redraw only if they differ from the ones shown.
+		void Update();
+
+		// Writes an instance per glyph taken by the last Update, in window pixels.
+		int ComposeGlyphs(glm::mat4 * models, glm::mat3 * tex_offsets, int max_glyphs);
+
+		Texture * GetFont();
+	}
+}
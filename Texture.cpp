@@ -1,23 +1,70 @@
 #include "Texture.h"
 #include "Renderer.h"
+#include "Stats.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <climits>
+#include <limits>
+
 namespace Engine
 {
 	std::array<Texture, MAX_TEXTURES> all_textures;
 	int num_textures = 0;
+	// Slots below num_textures given back by unloaded textures, and likewise for clips.
+	std::vector<int> free_textures;
+
+	std::array<AnimationClip, MAX_CLIPS> all_clips;
+	int num_clips = 0;
+	std::vector<int> free_clips;
+
+	Texture * Texture::TakeSlot()
+	{
+		int index;
+		if (!free_textures.empty())
+		{
+			index = free_textures.back();
+			free_textures.pop_back();
+		}
+		else
+		{
+			if (num_textures >= MAX_TEXTURES)
+				throw std::runtime_error(std::format("No more than {} textures.", MAX_TEXTURES));
+			index = num_textures++;
+		}
+
+		Texture * texture = &all_textures[index];
+		*texture = {};
+		texture->loaded = true;
+		return texture;
+	}
 
 	Texture * Texture::AddTexture(std::string filename, int images_x, int images_y)
 	{
-		Texture * texture = &all_textures[num_textures++];
+		Texture * texture = TakeSlot();
 
+		texture->num_images_x = images_x;
+		texture->num_images_y = images_y;
 		texture->Load(filename);
+
+		return texture;
+	}
+
+	Texture * Texture::AddTexture(const uint8_t * pixels, int width, int height, int images_x, int images_y)
+	{
+		Texture * texture = TakeSlot();
+
+		texture->texture_width = width;
+		texture->texture_height = height;
 		texture->num_images_x = images_x;
 		texture->num_images_y = images_y;
 
+		if (!config.headless)
+			texture->Upload(pixels);
+
 		return texture;
 	}
 
@@ -38,15 +85,51 @@ namespace Engine
 		return &all_textures[index];
 	}
 
+	int Texture::GetNumTextures()
+	{
+		return num_textures;
+	}
+
+	const AnimationClip & Texture::GetClip(int clip)
+	{
+		return all_clips[clip];
+	}
+
+	int Texture::GetNumClips()
+	{
+		return num_clips;
+	}
+
+	int Texture::GetIndex() const
+	{
+		return int(this - all_textures.data());
+	}
+
 	void Texture::Load(std::string filename)
 	{
+		if (config.headless)
+		{
+			int texture_channels;
+			if (!stbi_info(filename.c_str(), &texture_width, &texture_height, &texture_channels))
+				throw std::runtime_error(std::format("Failed to load {}.", filename));
+			return;
+		}
+
 		int texture_channels;
 		stbi_uc * pixels = stbi_load(filename.c_str(), &texture_width, &texture_height, &texture_channels, STBI_rgb_alpha);
-		VkDeviceSize texture_size = texture_width * texture_height * texture_channels;
 
 		if (!pixels)
 			throw std::runtime_error(std::format("Failed to load {}.", filename));
 
+		Upload(pixels);
+		stbi_image_free(pixels);
+	}
+
+	void Texture::Upload(const uint8_t * pixels)
+	{
+		// Pixels are always expanded to RGBA, whatever the source had.
+		VkDeviceSize texture_size = VkDeviceSize(texture_width) * VkDeviceSize(texture_height) * 4;
+
 		VkBuffer staging_buffer;
 		VkDeviceMemory staging_buffer_memory;
 
@@ -59,33 +142,144 @@ namespace Engine
 		memcpy(data, pixels, size_t(texture_size));
 		vkUnmapMemory(Graphics::GetDevice(), staging_buffer_memory);
 
-		stbi_image_free(pixels);
-
 		Graphics::CreateImage(texture_width, texture_height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
 			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			image, image_memory);
 
 		Graphics::TransitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 		Graphics::CopyBufferToImage(staging_buffer, image, uint32_t(texture_width), uint32_t(texture_height));
-		Graphics::TransitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		uint64_t uploaded = Graphics::TransitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-		vkDestroyBuffer(Graphics::GetDevice(), staging_buffer, nullptr);
-		vkFreeMemory(Graphics::GetDevice(), staging_buffer_memory, nullptr);
+		// The staging buffer goes once the copy has finished, without waiting for it here.
+		Graphics::DestroyLater([staging_buffer, staging_buffer_memory]
+		{
+			vkDestroyBuffer(Graphics::GetDevice(), staging_buffer, nullptr);
+			vkFreeMemory(Graphics::GetDevice(), staging_buffer_memory, nullptr);
+		}, uploaded);
 
 		image_view = Graphics::CreateImageView(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
 
+		Stats::Current().texture_memory += texture_size;
+
+		FindOpaqueImages(pixels);
+		BuildMeshes(pixels);
+	}
+
+	void Texture::FindOpaqueImages(const uint8_t * pixels)
+	{
+		int image_width = texture_width / num_images_x;
+		int image_height = texture_height / num_images_y;
+		opaque_images.assign(size_t(num_images_x) * num_images_y, 1);
+
+		for (int y = 0; y < num_images_y * image_height; ++y)
+			for (int x = 0; x < num_images_x * image_width; ++x)
+				if (pixels[(size_t(y) * texture_width + x) * 4 + 3] != 255)
+					opaque_images[size_t(y / image_height) * num_images_x + x / image_width] = 0;
+	}
+
+	// An octagon around each sub sprite's visible pixels, its bounding box with the corners cut off at 45 degrees.
+	// Mostly empty sprites then skip rasterising and sampling the pixels they would only discard.
+	void Texture::BuildMeshes(const uint8_t * pixels)
+	{
+		int image_width = texture_width / num_images_x;
+		int image_height = texture_height / num_images_y;
+		int count = num_images_x * num_images_y;
+
+		// Images with nothing visible keep every corner at 0, so nothing is drawn for them.
+		std::vector<glm::vec2> corners(size_t(count) * Graphics::MESH_VERTICES);
+
+		for (int image = 0; image < count; ++image)
+		{
+			int left = image % num_images_x * image_width;
+			int top = image / num_images_x * image_height;
+
+			// Bounds of every visible pixel's square along x, y and both diagonals, from the image's top left.
+			int min_x = INT_MAX, max_x = INT_MIN, min_y = INT_MAX, max_y = INT_MIN;
+			int min_sum = INT_MAX, max_sum = INT_MIN, min_difference = INT_MAX, max_difference = INT_MIN;
+			for (int y = 0; y < image_height; ++y)
+				for (int x = 0; x < image_width; ++x)
+				{
+					if (pixels[(size_t(top + y) * texture_width + left + x) * 4 + 3] == 0)
+						continue;
+
+					min_x = std::min(min_x, x);
+					max_x = std::max(max_x, x + 1);
+					min_y = std::min(min_y, y);
+					max_y = std::max(max_y, y + 1);
+					min_sum = std::min(min_sum, x + y);
+					max_sum = std::max(max_sum, x + y + 2);
+					min_difference = std::min(min_difference, x - y - 1);
+					max_difference = std::max(max_difference, x - y + 1);
+				}
+
+			if (min_x > max_x)
+				continue;
+
+			// Clockwise from the top edge. Every edge of the box touches a visible pixel, so each keeps some length.
+			const std::array<glm::ivec2, Graphics::MESH_VERTICES> outline{ {
+				{ std::max(min_x, min_sum - min_y), min_y },
+				{ std::min(max_x, max_difference + min_y), min_y },
+				{ max_x, std::max(min_y, max_x - max_difference) },
+				{ max_x, std::min(max_y, max_sum - max_x) },
+				{ std::min(max_x, max_sum - max_y), max_y },
+				{ std::max(min_x, min_difference + max_y), max_y },
+				{ min_x, std::min(max_y, min_x - min_difference) },
+				{ min_x, std::max(min_y, min_sum - min_x) } } };
+
+			for (int corner = 0; corner < Graphics::MESH_VERTICES; ++corner)
+				corners[size_t(image) * Graphics::MESH_VERTICES + corner] =
+					glm::vec2(float(outline[corner].x) / image_width, float(outline[corner].y) / image_height);
+		}
+
+		first_mesh = Graphics::AddMeshes(corners.data(), count);
+		num_meshes = first_mesh == Graphics::FULL_MESH ? 0 : count;
 	}
 
 	void Texture::Unload()
 	{
-		vkDestroyImageView(Graphics::GetDevice(), image_view, nullptr);
-		vkDestroyImage(Graphics::GetDevice(), image, nullptr);
-		vkFreeMemory(Graphics::GetDevice(), image_memory, nullptr);
+		if (!loaded)
+			return;
+
+		loaded = false;
+		if (config.headless)
+		{
+			Release();
+			return;
+		}
+
+		Stats::Current().texture_memory -= VkDeviceSize(texture_width) * VkDeviceSize(texture_height) * 4;
+
+		// Frames already submitted may still sample it, or read its meshes and clips.
+		Graphics::ReleaseTextureDescriptorSet(GetIndex());
+		Graphics::DestroyLater([this, image = image, image_view = image_view, image_memory = image_memory]
+		{
+			vkDestroyImageView(Graphics::GetDevice(), image_view, nullptr);
+			vkDestroyImage(Graphics::GetDevice(), image, nullptr);
+			vkFreeMemory(Graphics::GetDevice(), image_memory, nullptr);
+			Release();
+		});
 		image_view = nullptr;
 		image = nullptr;
 		image_memory = nullptr;
 	}
 
+	void Texture::Release()
+	{
+		if (num_meshes > 0)
+			Graphics::ReleaseMeshes(first_mesh, num_meshes);
+		num_meshes = 0;
+
+		for (int clip = 0; clip < num_clips; ++clip)
+			if (all_clips[clip].texture == this)
+			{
+				all_clips[clip].texture = nullptr;
+				free_clips.push_back(clip);
+			}
+
+		free_textures.push_back(GetIndex());
+	}
+
 	glm::mat3 Texture::GetOffset(int sub_sprite_number) const
 	{
 		glm::vec2 offset{ 1.f / num_images_x, 1.f / num_images_y };
@@ -98,8 +292,88 @@ namespace Engine
 							 {topleft.x, topleft.y, 1} };
 		return transform;
 	}
+
+	glm::ivec2 Texture::GetNumImages() const
+	{
+		return { num_images_x, num_images_y };
+	}
+
+	bool Texture::IsOpaque(int sub_sprite_number) const
+	{
+		return sub_sprite_number >= 0 && size_t(sub_sprite_number) < opaque_images.size() && opaque_images[sub_sprite_number];
+	}
+
+	uint32_t Texture::GetMesh(int sub_sprite_number) const
+	{
+		if (sub_sprite_number < 0 || sub_sprite_number >= num_meshes)
+			return Graphics::FULL_MESH;
+
+		return first_mesh + uint32_t(sub_sprite_number);
+	}
+
+	int Texture::AddClip(int first_subsprite, int num_frames, float frame_rate, LoopMode loop_mode)
+	{
+		if (num_clips >= MAX_CLIPS && free_clips.empty())
+			throw std::runtime_error(std::format("No more than {} animation clips.", MAX_CLIPS));
+
+		int num_images = num_images_x * num_images_y;
+		if (first_subsprite < 0 || num_frames < 1 || first_subsprite + num_frames > num_images)
+			throw std::runtime_error(std::format("Clip of {} frames from sub sprite {} doesn't fit in a texture of {} sub sprites.",
+				num_frames, first_subsprite, num_images));
+
+		bool opaque = true;
+		for (int frame = 0; frame < num_frames; ++frame)
+			opaque = opaque && IsOpaque(first_subsprite + frame);
+
+		int clip;
+		if (!free_clips.empty())
+		{
+			clip = free_clips.back();
+			free_clips.pop_back();
+		}
+		else
+			clip = num_clips++;
+		all_clips[clip] = { this, first_subsprite, num_frames, frame_rate, loop_mode, opaque };
+
+		if (!config.headless)
+			Graphics::WriteClip(clip);
+
+		return clip;
+	}
+
 	VkImageView Texture::GetImageView() const
 	{
 		return image_view;
 	}
+
+	float AnimationClip::GetDuration() const
+	{
+		if (frame_rate <= 0 || num_frames < 2)
+			return 0;
+
+		if (loop_mode != LoopMode::Once)
+			return std::numeric_limits<float>::infinity();
+
+		return float(num_frames - 1) / frame_rate;
+	}
+
+	// Keep in step with shader.vert.
+	int AnimationClip::GetSubsprite(float time) const
+	{
+		int frame = int(std::max(time, 0.f) * frame_rate);
+
+		if (loop_mode == LoopMode::Loop)
+			frame %= num_frames;
+		else if (loop_mode == LoopMode::PingPong)
+		{
+			int period = std::max(num_frames * 2 - 2, 1);
+			frame %= period;
+			if (frame >= num_frames)
+				frame = period - frame;
+		}
+		else
+			frame = std::min(frame, num_frames - 1);
+
+		return first_subsprite + frame;
+	}
 }
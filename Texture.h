@@ -5,28 +5,83 @@
 
 namespace Engine
 {
+	enum class LoopMode : uint32_t
+	{
+		// Holds the last frame once it's reached.
+		Once,
+		Loop,
+		// Plays forward then back again, without repeating the end frames.
+		PingPong
+	};
+
+	// A run of sub sprites from one sheet shown one after another. Sprites playing a clip are animated by the vertex
+	// shader from the time they started, so they cost nothing on the CPU however many there are.
+	struct AnimationClip
+	{
+		Texture * texture;
+		int first_subsprite;
+		int num_frames;
+		// Frames a second.
+		float frame_rate;
+		LoopMode loop_mode;
+		// Every frame is fully opaque, so sprites playing it can skip alpha testing.
+		bool opaque;
+
+		// Seconds until the frame stops changing, infinite unless the clip plays once.
+		float GetDuration() const;
+		// The sub sprite shown this many seconds in, as the vertex shader works it out.
+		int GetSubsprite(float time) const;
+	};
+
 	class Texture
 	{
 	public:
 		static Texture * AddTexture(std::string filename, int images_x = 1, int images_y = 1);
+		// Uploads RGBA8 pixels generated at runtime, such as the baked font.
+		static Texture * AddTexture(const uint8_t * pixels, int width, int height, int images_x = 1, int images_y = 1);
 		static void LoadTextures();
 		static void UnloadTextures();
 		static Texture * GetTexture(int index);
+		static int GetNumTextures();
+		static const AnimationClip & GetClip(int clip);
+		static int GetNumClips();
 
+		int GetIndex() const;
 		glm::mat3 GetOffset(int sub_sprite_number) const;
+		// How many sub sprites across and down the texture is split into.
+		glm::ivec2 GetNumImages() const;
+		// True when every pixel of the sub sprite is fully opaque, so it can skip alpha testing.
+		// Always false when headless, since pixels aren't loaded.
+		bool IsOpaque(int sub_sprite_number) const;
+		// Index of a convex outline around the sub sprite's visible pixels, or Graphics::FULL_MESH when there isn't one.
+		uint32_t GetMesh(int sub_sprite_number) const;
+		// Defines a clip of num_frames sub sprites from first_subsprite on, returns its index for Sprite::Play.
+		int AddClip(int first_subsprite, int num_frames, float frame_rate, LoopMode loop_mode = LoopMode::Loop);
 		VkImageView GetImageView() const;
+		// Frees the texture's image once frames already submitted have finished with it, without waiting for them.
+		// Its slot, meshes and clips are then reused by textures and clips added later, so nothing may draw with the
+		// texture or play its clips afterwards.
+		void Unload();
 	private:
+		static Texture * TakeSlot();
+		void Release();
 		void Load(std::string filename);
-		void Unload();
+		void Upload(const uint8_t * pixels);
+		void FindOpaqueImages(const uint8_t * pixels);
+		void BuildMeshes(const uint8_t * pixels);
 
 		int texture_width;
 		int texture_height;
 
 		int num_images_x{};
 		int num_images_y{};
+		std::vector<uint8_t> opaque_images;
+		uint32_t first_mesh{};
+		int num_meshes{};
 
 		VkImage image{};
 		VkDeviceMemory image_memory{};
 		VkImageView image_view{};
+		bool loaded{};
 	};
 }
@@ -0,0 +1,172 @@
+#include "TileMap.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+namespace Engine
+{
+	// Tiled stores flip flags in the top bits of each gid.
+	const uint32_t TILE_FLIP_MASK = 0xE0000000u;
+
+	static std::string GetAttribute(const std::string & tag, const std::string & name)
+	{
+		std::string key = " " + name + "=\"";
+		size_t start = tag.find(key);
+		if (start == std::string::npos)
+			return "";
+
+		start += key.size();
+		return tag.substr(start, tag.find('"', start) - start);
+	}
+
+	static int GetIntAttribute(const std::string & tag, const std::string & name)
+	{
+		std::string value = GetAttribute(tag, name);
+		return value.empty() ? 0 : std::stoi(value);
+	}
+
+	void TileMap::Load(std::string filename)
+	{
+		std::ifstream file(filename);
+		if (!file.is_open())
+			throw std::runtime_error(std::format("Failed to open {}.", filename));
+
+		std::stringstream buffer;
+		buffer << file.rdbuf();
+		std::string xml = buffer.str();
+
+		tilesets.clear();
+		layers.clear();
+
+		size_t map_start = xml.find("<map ");
+		if (map_start == std::string::npos)
+			throw std::runtime_error(std::format("{} is not a TMX map.", filename));
+
+		std::string map_tag = xml.substr(map_start, xml.find('>', map_start) - map_start);
+		width = GetIntAttribute(map_tag, "width");
+		height = GetIntAttribute(map_tag, "height");
+		int tile_width = GetIntAttribute(map_tag, "tilewidth");
+		int tile_height = GetIntAttribute(map_tag, "tileheight");
+
+		for (size_t pos = xml.find("<tileset "); pos != std::string::npos; pos = xml.find("<tileset ", pos + 1))
+		{
+			std::string tag = xml.substr(pos, xml.find('>', pos) - pos);
+
+			Tileset tileset;
+			tileset.name = GetAttribute(tag, "name");
+			tileset.first_gid = GetIntAttribute(tag, "firstgid");
+
+			size_t image_pos = xml.find("<image ", pos);
+			size_t end_pos = xml.find("</tileset>", pos);
+			if (image_pos != std::string::npos && image_pos < end_pos)
+			{
+				std::string image_tag = xml.substr(image_pos, xml.find('>', image_pos) - image_pos);
+				tileset.image = GetAttribute(image_tag, "source");
+				if (tile_width > 0 && tile_height > 0)
+				{
+					tileset.columns = GetIntAttribute(image_tag, "width") / tile_width;
+					tileset.rows = GetIntAttribute(image_tag, "height") / tile_height;
+				}
+			}
+
+			tilesets.push_back(tileset);
+		}
+
+		std::sort(tilesets.begin(), tilesets.end(),
+			[](const Tileset & a, const Tileset & b) { return a.first_gid < b.first_gid; });
+
+		for (size_t pos = xml.find("<layer "); pos != std::string::npos; pos = xml.find("<layer ", pos + 1))
+		{
+			std::string tag = xml.substr(pos, xml.find('>', pos) - pos);
+
+			size_t data_pos = xml.find("<data", pos);
+			if (data_pos == std::string::npos)
+				throw std::runtime_error(std::format("Layer in {} has no data.", filename));
+
+			std::string data_tag = xml.substr(data_pos, xml.find('>', data_pos) - data_pos);
+			if (GetAttribute(data_tag, "encoding") != "csv")
+				throw std::runtime_error(std::format("Only CSV encoded layers are supported in {}.", filename));
+
+			size_t csv_start = xml.find('>', data_pos) + 1;
+			size_t csv_end = xml.find("</data>", csv_start);
+
+			Layer layer;
+			layer.name = GetAttribute(tag, "name");
+			layer.tiles.reserve(size_t(width) * size_t(height));
+
+			std::stringstream csv(xml.substr(csv_start, csv_end - csv_start));
+			std::string cell;
+			while (std::getline(csv, cell, ','))
+				layer.tiles.push_back(int(std::stoul(cell) & ~TILE_FLIP_MASK));
+
+			if (layer.tiles.size() != size_t(width) * size_t(height))
+				throw std::runtime_error(std::format("Layer {} in {} has the wrong number of tiles.", layer.name, filename));
+
+			layers.push_back(std::move(layer));
+		}
+	}
+
+	int TileMap::GetWidth() const
+	{
+		return width;
+	}
+
+	int TileMap::GetHeight() const
+	{
+		return height;
+	}
+
+	const std::vector<TileMap::Tileset> & TileMap::GetTilesets() const
+	{
+		return tilesets;
+	}
+
+	const std::vector<TileMap::Layer> & TileMap::GetLayers() const
+	{
+		return layers;
+	}
+
+	const TileMap::Tileset * TileMap::FindTileset(int gid) const
+	{
+		if (gid <= 0)
+			return nullptr;
+
+		const Tileset * found = nullptr;
+		for (const auto & tileset : tilesets)
+			if (tileset.first_gid <= gid)
+				found = &tileset;
+			else
+				break;
+
+		return found;
+	}
+
+	std::vector<uint8_t> TileMap::BuildCollision(const std::vector<std::string> & blocking_tilesets) const
+	{
+		std::vector<uint8_t> blocked(size_t(width) * size_t(height), 0);
+
+		for (const auto & layer : layers)
+			for (size_t i = 0; i < layer.tiles.size(); ++i)
+			{
+				const Tileset * tileset = FindTileset(layer.tiles[i]);
+				if (tileset && std::find(blocking_tilesets.begin(), blocking_tilesets.end(), tileset->name) != blocking_tilesets.end())
+					blocked[i] = 1;
+			}
+
+		return blocked;
+	}
+
+	glm::ivec2 TileMap::WorldToTile(glm::vec2 world_position) const
+	{
+		// Rows run down the map but up the world, so row 0 is the top one.
+		glm::vec2 local = (world_position - origin) / tile_size;
+		return glm::ivec2(int(std::floor(local.x)), height - 1 - int(std::floor(local.y)));
+	}
+
+	glm::vec2 TileMap::TileToWorld(int x, int y) const
+	{
+		return origin + glm::vec2(float(x) + .5f, float(height - 1 - y) + .5f) * tile_size;
+	}
+}
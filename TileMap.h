@@ -0,0 +1,47 @@
+#pragma once
+#include "Core.h"
+
+namespace Engine
+{
+	class TileMap
+	{
+	public:
+		struct Tileset
+		{
+			std::string name;
+			std::string image;
+			int first_gid{};
+			int columns{};
+			int rows{};
+		};
+
+		struct Layer
+		{
+			std::string name;
+			std::vector<int> tiles;
+		};
+
+		void Load(std::string filename);
+
+		int GetWidth() const;
+		int GetHeight() const;
+		const std::vector<Tileset> & GetTilesets() const;
+		const std::vector<Layer> & GetLayers() const;
+		const Tileset * FindTileset(int gid) const;
+
+		// One byte per tile, non-zero where any layer uses a tile from one of the named tilesets.
+		std::vector<uint8_t> BuildCollision(const std::vector<std::string> & blocking_tilesets) const;
+
+		glm::ivec2 WorldToTile(glm::vec2 world_position) const;
+		glm::vec2 TileToWorld(int x, int y) const;
+
+		glm::vec2 origin{ 0, 0 };
+		float tile_size{ 1 };
+	private:
+		int width{};
+		int height{};
+
+		std::vector<Tileset> tilesets;
+		std::vector<Layer> layers;
+	};
+}
@@ -0,0 +1,165 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace Engine
+{
+	namespace Trace
+	{
+		using Clock = std::chrono::steady_clock;
+
+		struct Event
+		{
+			const char * name;
+			// Nanoseconds since startup.
+			int64_t start;
+			int64_t end;
+		};
+
+		const Clock::time_point origin = Clock::now();
+
+		std::array<Event, MAX_EVENTS> events;
+		// Every event ever recorded, the next one goes at num_events % MAX_EVENTS.
+		uint64_t num_events = 0;
+
+		std::array<const char *, MAX_DEPTH> open_names;
+		std::array<int64_t, MAX_DEPTH> open_starts;
+		int depth = 0;
+
+		int64_t frame_start = 0;
+		std::array<float, MEDIAN_FRAMES> frame_times{};
+		int num_frame_times = 0;
+		int next_frame_time = 0;
+		float median_frame_time = 0;
+		int cooldown = 0;
+
+		// The writer works from a copy so recording carries on while it runs.
+		std::array<Event, MAX_EVENTS> dump_events;
+		std::thread writer;
+
+		int64_t Now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count();
+		}
+
+		void Record(const char * name, int64_t start, int64_t end)
+		{
+			events[num_events % MAX_EVENTS] = { name, start, end };
+			++num_events;
+		}
+
+		void WriteTrace(std::string filename, int count)
+		{
+			std::ofstream file(filename);
+			if (!file.is_open())
+			{
+				std::cerr << std::format("Failed to open {} for a trace.", filename) << "\n\n";
+				return;
+			}
+
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			for (int i = 0; i < count; ++i)
+			{
+				const Event & event = dump_events[i];
+				file << std::format("{}{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":{:.3f},\"dur\":{:.3f}}}\n",
+					i > 0 ? "," : "", event.name, double(event.start) / 1000., double(event.end - event.start) / 1000.);
+			}
+			file << "]}\n";
+		}
+
+		void UpdateMedian(float frame_time)
+		{
+			frame_times[next_frame_time] = frame_time;
+			next_frame_time = (next_frame_time + 1) % MEDIAN_FRAMES;
+			num_frame_times = std::min(num_frame_times + 1, MEDIAN_FRAMES);
+
+			std::array<float, MEDIAN_FRAMES> sorted;
+			std::copy_n(frame_times.begin(), num_frame_times, sorted.begin());
+			std::nth_element(sorted.begin(), sorted.begin() + num_frame_times / 2, sorted.begin() + num_frame_times);
+			median_frame_time = sorted[num_frame_times / 2];
+		}
+
+		void BeginFrame()
+		{
+			frame_start = Now();
+		}
+
+		void EndFrame()
+		{
+			int64_t frame_end = Now();
+			Record("Frame", frame_start, frame_end);
+
+			float frame_time = float(frame_end - frame_start) * 1e-9f;
+
+			// Needs a full window of history so the first few frames of loading aren't reported.
+			bool hitch = config.hitch_ratio > 0 && cooldown == 0 && num_frame_times == MEDIAN_FRAMES
+				&& frame_time > median_frame_time * config.hitch_ratio && frame_time > config.hitch_min_time;
+
+			float median = median_frame_time;
+			UpdateMedian(frame_time);
+
+			if (cooldown > 0)
+				--cooldown;
+
+			if (hitch)
+			{
+				std::string filename = std::format("hitch_{}.json", GetFrameCount());
+				std::cout << std::format("Frame {} took {:.1f} ms against a median of {:.1f} ms, trace written to {}.\n",
+					GetFrameCount(), frame_time * 1000.f, median * 1000.f, filename);
+
+				Dump(filename);
+				cooldown = MEDIAN_FRAMES;
+			}
+		}
+
+		void Shutdown()
+		{
+			if (writer.joinable())
+				writer.join();
+		}
+
+		void BeginScope(const char * name)
+		{
+			if (depth < MAX_DEPTH)
+			{
+				open_names[depth] = name;
+				open_starts[depth] = Now();
+			}
+
+			++depth;
+		}
+
+		void EndScope()
+		{
+			if (depth == 0)
+				return;
+
+			--depth;
+			if (depth < MAX_DEPTH)
+				Record(open_names[depth], open_starts[depth], Now());
+		}
+
+		void Dump(std::string filename)
+		{
+			// Only one trace is written at a time, a previous one still being written is waited for.
+			if (writer.joinable())
+				writer.join();
+
+			uint64_t count = std::min(num_events, uint64_t(MAX_EVENTS));
+			uint64_t first = num_events - count;
+			for (uint64_t i = 0; i < count; ++i)
+				dump_events[i] = events[(first + i) % MAX_EVENTS];
+
+			writer = std::thread(WriteTrace, std::move(filename), int(count));
+		}
+
+		float GetMedianFrameTime()
+		{
+			return median_frame_time;
+		}
+	}
+}
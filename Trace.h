@@ -0,0 +1,47 @@
+#pragma once
+#include "Core.h"
+
+namespace Engine
+{
+	// Keeps a ring of the most recent frame and scope timings, and writes it out as a Chrome trace
+	// (chrome://tracing or ui.perfetto.dev) when a frame runs well over the median.
+	namespace Trace
+	{
+		// Around 20 seconds at 60 frames and a dozen scopes per frame.
+		const int MAX_EVENTS = 16384;
+		const int MAX_DEPTH = 32;
+		// Frames the median is taken over, and how long detection waits after writing a trace.
+		const int MEDIAN_FRAMES = 120;
+
+		void BeginFrame();
+		void EndFrame();
+		void Shutdown();
+
+		// Main thread only. The name isn't copied, so it must outlive the ring, a string literal in practice.
+		void BeginScope(const char * name);
+		void EndScope();
+
+		// Writes the ring to a file now, it's written on a worker thread so this returns straight away.
+		void Dump(std::string filename);
+
+		float GetMedianFrameTime();
+
+		// Times the enclosing block.
+		class Scope
+		{
+		public:
+			Scope(const char * name)
+			{
+				BeginScope(name);
+			}
+
+			~Scope()
+			{
+				EndScope();
+			}
+
+			Scope(const Scope &) = delete;
+			Scope & operator=(const Scope &) = delete;
+		};
+	}
+}
@@ -8,15 +8,24 @@ namespace Engine
 	Transform * Transform::NewTransform()
 	{
 		Transform * transform = &all_transforms[num_transforms++];
+		*transform = Transform();
 		return transform;
 	}
 
+	void Transform::ClearTransforms()
+	{
+		num_transforms = 0;
+	}
+
 	glm::vec2 Transform::GetPosition()
 	{
 		return position;
 	}
 	void Transform::SetPosition(glm::vec2 new_position)
 	{
+		if (new_position != position)
+			RequestRedraw();
+
 		position = new_position;
 	}
 	void Transform::SetPosition(float x, float y)
@@ -25,7 +34,7 @@ namespace Engine
 	}
 	void Transform::Move(glm::vec2 distance)
 	{
-		position += distance;
+		SetPosition(position + distance);
 	}
 	void Transform::Move(float x, float y)
 	{
@@ -37,6 +46,9 @@ namespace Engine
 	}
 	void Transform::SetRotation(Radians new_rotation)
 	{
+		if (new_rotation != rotation)
+			RequestRedraw();
+
 		rotation = new_rotation;
 	}
 	glm::vec2 Transform::GetSize()
@@ -45,6 +57,9 @@ namespace Engine
 	}
 	void Transform::SetSize(glm::vec2 new_size)
 	{
+		if (new_size != size)
+			RequestRedraw();
+
 		size = new_size;
 	}
 	void Transform::SetSize(float new_size)
@@ -7,6 +7,7 @@ namespace Engine
 	{
 	public:
 		static Transform * NewTransform();
+		static void ClearTransforms();
 
 		glm::vec2 GetPosition();
 		void SetPosition(glm::vec2 new_position);
@@ -0,0 +1,532 @@
+#include "Core.h"
+#include "Memory.h"
+#include "Renderer.h"
+#include "Object.h"
+#include "Sprite.h"
+#include "Texture.h"
+#include "Transform.h"
+#include "TileMap.h"
+#include "StaticLayer.h"
+#include "ParticleEmitter.h"
+#include "FlowField.h"
+#include "Swarm.h"
+#include "Random.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+struct Options
+{
+	int count{ 400 };
+	uint64_t frames{ 600 };
+	uint64_t warmup{ 60 };
+	std::string scenario;
+	std::string output;
+};
+
+struct Scenario
+{
+	const char * name;
+	void(*setup)(int count);
+	void(*update)();
+};
+
+struct Percentiles
+{
+	double mean{}, p50{}, p95{}, p99{}, max{};
+};
+
+// A current size of zero means the platform doesn't report one.
+struct ProcessMemory
+{
+	uint64_t current{};
+	uint64_t peak{};
+};
+
+const float WORLD_EXTENT = 4.f;
+const char * DUNGEON_MAP = "assets/DawnLike/Examples/Dungeon.tmx";
+const char * DUNGEON_DIRECTORY = "assets/DawnLike/Examples/";
+
+const std::array<const char *, 16> CHARACTER_SHEETS
+{
+	"Aquatic0", "Avian0", "Cat0", "Demon0", "Dog0", "Elemental0", "Humanoid0", "Misc0",
+	"Pest0", "Plant0", "Player0", "Quadraped0", "Reptile0", "Rodent0", "Slime0", "Undead0"
+};
+
+Options options;
+Engine::RNG rng;
+
+std::vector<Engine::Texture *> sheets;
+int sheet_clip;
+std::unordered_map<std::string, Engine::Texture *> tileset_textures;
+
+std::vector<Engine::Object *> movers;
+std::vector<glm::vec2> velocities;
+Engine::Sprite * shared_sprite;
+int churn_count;
+
+Engine::TileMap dungeon;
+Engine::FlowField flow_field;
+Engine::Swarm swarm;
+std::vector<glm::ivec2> open_tiles;
+double retarget_time;
+
+void(*scenario_update)();
+
+Engine::Texture * AddSheet(const std::string & filename)
+{
+	int width, height, channels;
+	if (!stbi_info(filename.c_str(), &width, &height, &channels))
+		throw std::runtime_error(std::format("Failed to load {}.", filename));
+
+	return Engine::Texture::AddTexture(filename, width / 16, height / 16);
+}
+
+// Textures can only be added once the renderer is up, so everything any scenario uses is loaded here.
+void LoadBenchmarkTextures()
+{
+	for (const char * name : CHARACTER_SHEETS)
+		sheets.push_back(AddSheet(std::format("assets/DawnLike/Characters/{}.png", name)));
+
+	sheet_clip = sheets[0]->AddClip(0, 8, 8.f);
+
+	dungeon.tile_size = .5f;
+	dungeon.Load(DUNGEON_MAP);
+	dungeon.origin = -glm::vec2(dungeon.GetWidth(), dungeon.GetHeight()) * dungeon.tile_size * .5f;
+
+	for (const auto & tileset : dungeon.GetTilesets())
+		tileset_textures[tileset.name] = Engine::Texture::AddTexture(DUNGEON_DIRECTORY + tileset.image, tileset.columns, tileset.rows);
+}
+
+void UpdateBenchmark()
+{
+	if (scenario_update)
+		scenario_update();
+}
+
+void ResetScene()
+{
+	Engine::Object::ClearObjects();
+	Engine::Sprite::ClearSprites();
+	Engine::StaticLayer::ClearLayers();
+	Engine::ParticleEmitter::ClearEmitters();
+	movers.clear();
+	velocities.clear();
+	swarm.Clear();
+	swarm.SetFlowField(nullptr);
+	flow_field.Shutdown();
+	rng.Seed(Engine::GetSeed());
+}
+
+void SpawnScattered(int count, Engine::Sprite * sprite)
+{
+	std::pmr::vector<float> positions(size_t(count) * 2, Engine::Memory::GetFrameResource());
+	rng.FillFloats(positions, -WORLD_EXTENT, WORLD_EXTENT);
+
+	for (int i = 0; i < count; ++i)
+	{
+		auto object = Engine::Object::NewObject(sprite);
+		object->transform->SetPosition(positions[i * 2], positions[i * 2 + 1]);
+		object->transform->SetSize(.5f);
+		movers.push_back(object);
+	}
+}
+
+Engine::Sprite * NewCharacterSprite(Engine::Texture * texture, int subsprite)
+{
+	Engine::Sprite * sprite = Engine::Sprite::NewSprite();
+	sprite->SetTexture(texture);
+	sprite->SetSubsprite(subsprite);
+	return sprite;
+}
+
+void SetupStatic(int count)
+{
+	SpawnScattered(count, NewCharacterSprite(sheets[0], 0));
+}
+
+void SetupMoving(int count)
+{
+	SpawnScattered(count, NewCharacterSprite(sheets[0], 0));
+
+	velocities.resize(movers.size());
+	std::vector<float> speeds(velocities.size() * 2);
+	rng.FillFloats(speeds, -1.f, 1.f);
+	for (size_t i = 0; i < velocities.size(); ++i)
+		velocities[i] = glm::vec2(speeds[i * 2], speeds[i * 2 + 1]);
+}
+
+void UpdateMoving()
+{
+	float delta_time = Engine::GetDeltaTime();
+	for (size_t i = 0; i < movers.size(); ++i)
+	{
+		glm::vec2 position = movers[i]->transform->GetPosition() + velocities[i] * delta_time;
+
+		if (position.x < -WORLD_EXTENT || position.x > WORLD_EXTENT)
+			velocities[i].x = -velocities[i].x;
+		if (position.y < -WORLD_EXTENT || position.y > WORLD_EXTENT)
+			velocities[i].y = -velocities[i].y;
+
+		movers[i]->transform->SetPosition(position);
+	}
+}
+
+// Consecutive objects cycle through every sheet, the worst case for anything batching by texture.
+void SetupTextures(int count)
+{
+	std::vector<Engine::Sprite *> sprites;
+	for (int i = 0; i < std::min(count, Engine::MAX_SPRITES); ++i)
+		sprites.push_back(NewCharacterSprite(sheets[i % sheets.size()], i / int(sheets.size())));
+
+	SpawnScattered(count, sprites.front());
+	for (size_t i = 0; i < movers.size(); ++i)
+		movers[i]->sprite = sprites[i % sprites.size()];
+}
+
+// With cached set the map's layers become static layers instead of objects, so only the entities are instanced.
+void SetupDungeon(int count, bool cached)
+{
+	std::unordered_map<int, Engine::Sprite *> tile_sprites;
+
+	for (const auto & layer : dungeon.GetLayers())
+	{
+		if (cached)
+		{
+			Engine::StaticLayer::NewLayer()->AddTiles(dungeon, layer.name, tileset_textures);
+			continue;
+		}
+
+		for (int y = 0; y < dungeon.GetHeight(); ++y)
+			for (int x = 0; x < dungeon.GetWidth(); ++x)
+			{
+				int gid = layer.tiles[size_t(y) * dungeon.GetWidth() + x];
+				const auto * tileset = dungeon.FindTileset(gid);
+				if (gid == 0 || tileset == nullptr)
+					continue;
+
+				Engine::Sprite *& sprite = tile_sprites[gid];
+				if (sprite == nullptr)
+					sprite = NewCharacterSprite(tileset_textures[tileset->name], gid - tileset->first_gid);
+
+				auto tile = Engine::Object::NewObject(sprite);
+				tile->transform->SetPosition(dungeon.TileToWorld(x, y));
+				tile->transform->SetSize(dungeon.tile_size);
+			}
+	}
+
+	std::vector<uint8_t> blocked = dungeon.BuildCollision({ "Wall", "Pit0" });
+	open_tiles.clear();
+	for (int y = 0; y < dungeon.GetHeight(); ++y)
+		for (int x = 0; x < dungeon.GetWidth(); ++x)
+			if (!blocked[size_t(y) * dungeon.GetWidth() + x])
+				open_tiles.emplace_back(x, y);
+
+	flow_field.Initialize(dungeon, { "Wall", "Pit0" }, false);
+	swarm.SetFlowField(&flow_field);
+
+	// Entities take whatever room the tiles leave in the object pool.
+	int num_entities = std::min(count, Engine::MAX_OBJECTS - Engine::Object::GetNumObjects());
+	Engine::Sprite * entity_sprite = NewCharacterSprite(sheets[15], 0);
+	for (int i = 0; i < num_entities; ++i)
+	{
+		glm::ivec2 tile = open_tiles[rng(0, int(open_tiles.size()))];
+		auto entity = Engine::Object::NewObject(entity_sprite);
+		entity->transform->SetPosition(dungeon.TileToWorld(tile.x, tile.y));
+		entity->transform->SetSize(dungeon.tile_size);
+		swarm.Add(entity->transform->GetPosition(), entity->transform);
+	}
+
+	retarget_time = 0;
+}
+
+void SetupTileMap(int count)
+{
+	SetupDungeon(count, false);
+}
+
+void SetupCachedTileMap(int count)
+{
+	SetupDungeon(count, true);
+}
+
+void UpdateTileMap()
+{
+	// Moving the target every couple of seconds keeps the flow field rebuilding.
+	if (Engine::GetTimeElapsed() >= retarget_time)
+	{
+		glm::ivec2 tile = open_tiles[rng(0, int(open_tiles.size()))];
+		glm::vec2 target = dungeon.TileToWorld(tile.x, tile.y);
+		flow_field.SetTarget(target);
+		swarm.SetTarget(target);
+		retarget_time = Engine::GetTimeElapsed() + 2.f;
+	}
+
+	flow_field.Update();
+	swarm.Update(Engine::GetDeltaTime());
+}
+
+void SetupChurn(int count)
+{
+	churn_count = count;
+	shared_sprite = NewCharacterSprite(sheets[0], 0);
+	SpawnScattered(count, shared_sprite);
+}
+
+// Pools can only be emptied as a whole, so the entire population is despawned and respawned every frame.
+void UpdateChurn()
+{
+	Engine::Object::ClearObjects();
+	movers.clear();
+	SpawnScattered(churn_count, shared_sprite);
+}
+
+// Every emitter spawns count particles a second. Objects are kept to a handful since the particles never pass
+// through them.
+void SetupParticles(int count)
+{
+	SpawnScattered(std::min(count, 64), NewCharacterSprite(sheets[0], 0));
+
+	Engine::ParticleEmitter::SetTexture(sheets[0]);
+	for (int i = 0; i < Engine::MAX_EMITTERS; ++i)
+	{
+		auto emitter = Engine::ParticleEmitter::NewEmitter();
+		emitter->position.x = rng(-WORLD_EXTENT, WORLD_EXTENT);
+		emitter->position.y = rng(-WORLD_EXTENT, WORLD_EXTENT);
+		emitter->rate = float(count);
+		emitter->acceleration = glm::vec2(0, -2);
+		emitter->drag = .5f;
+		emitter->num_subsprites = 8;
+	}
+}
+
+// Every sprite plays the same clip from a different point, so neighbours show different frames. None of them are
+// touched again, the frames are left to the vertex shader.
+void SetupAnimated(int count)
+{
+	std::vector<Engine::Sprite *> sprites;
+	for (int i = 0; i < std::min(count, Engine::MAX_SPRITES); ++i)
+	{
+		Engine::Sprite * sprite = Engine::Sprite::NewSprite();
+		sprite->Play(sheet_clip, float(i) * .1f);
+		sprites.push_back(sprite);
+	}
+
+	SpawnScattered(count, sprites.front());
+	for (size_t i = 0; i < movers.size(); ++i)
+		movers[i]->sprite = sprites[i % sprites.size()];
+}
+
+const std::array<Scenario, 8> SCENARIOS
+{ {
+	{ "static", SetupStatic, nullptr },
+	{ "moving", SetupMoving, UpdateMoving },
+	{ "textures", SetupTextures, nullptr },
+	{ "tilemap", SetupTileMap, UpdateTileMap },
+	{ "tilemap-cached", SetupCachedTileMap, UpdateTileMap },
+	{ "churn", SetupChurn, UpdateChurn },
+	{ "particles", SetupParticles, nullptr },
+	{ "animated", SetupAnimated, nullptr },
+} };
+
+ProcessMemory GetProcessMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters{};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return { uint64_t(counters.WorkingSetSize), uint64_t(counters.PeakWorkingSetSize) };
+#else
+	// getrusage only has the peak, the current resident size comes from /proc where there is one.
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+
+	uint64_t size_pages = 0;
+	uint64_t resident_pages = 0;
+	std::ifstream statm("/proc/self/statm");
+	statm >> size_pages >> resident_pages;
+
+	return { resident_pages * uint64_t(sysconf(_SC_PAGESIZE)), uint64_t(usage.ru_maxrss) * 1024 };
+#endif
+}
+
+// Nearest rank percentiles, in milliseconds.
+Percentiles Summarize(std::vector<double> samples)
+{
+	Percentiles result;
+	if (samples.empty())
+		return result;
+
+	std::sort(samples.begin(), samples.end());
+
+	auto rank = [&](double fraction)
+	{
+		size_t index = size_t(std::ceil(fraction * double(samples.size())));
+		return samples[std::clamp<size_t>(index, 1, samples.size()) - 1] * 1000.;
+	};
+
+	double sum = 0;
+	for (double sample : samples)
+		sum += sample;
+
+	result.mean = sum / double(samples.size()) * 1000.;
+	result.p50 = rank(.5);
+	result.p95 = rank(.95);
+	result.p99 = rank(.99);
+	result.max = samples.back() * 1000.;
+	return result;
+}
+
+std::string ToJson(const Percentiles & stats)
+{
+	return std::format("{{ \"mean\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f} }}",
+		stats.mean, stats.p50, stats.p95, stats.p99, stats.max);
+}
+
+// Returns false if the window was closed part way through.
+bool RunScenario(const Scenario & scenario, std::ostream & json, bool first)
+{
+	ResetScene();
+	scenario.setup(options.count);
+	scenario_update = scenario.update;
+
+	for (uint64_t i = 0; i < options.warmup; ++i)
+		if (!Engine::Update())
+			return false;
+
+	std::vector<double> cpu_times;
+	std::vector<double> gpu_times;
+	cpu_times.reserve(options.frames);
+	gpu_times.reserve(options.frames);
+	uint64_t allocations = 0;
+
+	using Clock = std::chrono::high_resolution_clock;
+	for (uint64_t i = 0; i < options.frames; ++i)
+	{
+		auto start = Clock::now();
+		bool running = Engine::Update();
+		cpu_times.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+
+		float gpu_time = Engine::Graphics::GetGpuFrameTime();
+		if (gpu_time > 0)
+			gpu_times.push_back(gpu_time);
+
+		allocations += Engine::Memory::GetFrameAllocationCount();
+
+		if (!running)
+			return false;
+	}
+
+	ProcessMemory memory = GetProcessMemory();
+	Percentiles cpu = Summarize(cpu_times);
+
+	json << (first ? "\n" : ",\n") << "    {\n"
+		<< std::format("      \"name\": \"{}\",\n", scenario.name)
+		<< std::format("      \"count\": {},\n", options.count)
+		<< std::format("      \"objects\": {},\n", Engine::Object::GetNumObjects())
+		<< std::format("      \"cpu_ms\": {},\n", ToJson(cpu))
+		<< std::format("      \"gpu_ms\": {},\n", gpu_times.empty() ? "null" : ToJson(Summarize(gpu_times)))
+		<< std::format("      \"allocations_per_frame\": {:.2f},\n", double(allocations) / double(options.frames))
+		<< std::format("      \"working_set_bytes\": {},\n", memory.current == 0 ? "null" : std::to_string(memory.current))
+		<< std::format("      \"peak_working_set_bytes\": {}\n", memory.peak)
+		<< "    }";
+
+	std::cerr << std::format("{:<10} cpu mean {:.3f} ms, p99 {:.3f} ms\n", scenario.name, cpu.mean, cpu.p99);
+	return true;
+}
+
+int main(int argc, char * argv[])
+{
+	Engine::config.seed = 1;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--headless") == 0)
+			Engine::config.headless = true;
+		else if (std::strcmp(argv[i], "--count") == 0 && has_value)
+			options.count = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--frames") == 0 && has_value)
+			options.frames = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--warmup") == 0 && has_value)
+			options.warmup = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--scenario") == 0 && has_value)
+			options.scenario = argv[++i];
+		else if (std::strcmp(argv[i], "--seed") == 0 && has_value)
+			Engine::config.seed = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--output") == 0 && has_value)
+			options.output = argv[++i];
+	}
+
+	// Objects and sprites are fixed size pools, scenarios can't ask for more than they hold.
+	options.count = std::clamp(options.count, 1, Engine::MAX_OBJECTS);
+	options.frames = std::max<uint64_t>(options.frames, 1);
+
+	// Simulate at a fixed 60Hz but run flat out, so every run steps the same scene.
+	Engine::config.fixed_timestep = 1.f / 60.f;
+	Engine::config.realtime = false;
+
+	Engine::PostInitialization = LoadBenchmarkTextures;
+	Engine::PostUpdate = UpdateBenchmark;
+
+	Engine::Initialize();
+
+	std::ostringstream json;
+	json << "{\n"
+		<< std::format("  \"headless\": {},\n", Engine::config.headless)
+		<< std::format("  \"seed\": {},\n", Engine::GetSeed())
+		<< std::format("  \"frames\": {},\n", options.frames)
+		<< std::format("  \"warmup\": {},\n", options.warmup)
+		<< "  \"scenarios\": [";
+
+	bool first = true;
+	for (const auto & scenario : SCENARIOS)
+	{
+		if (!options.scenario.empty() && options.scenario != scenario.name)
+			continue;
+
+		if (!RunScenario(scenario, json, first))
+			break;
+
+		first = false;
+	}
+
+	json << "\n  ]\n}\n";
+
+	ResetScene();
+	Engine::Shutdown();
+
+	if (options.output.empty())
+	{
+		std::cout << json.str();
+		return EXIT_SUCCESS;
+	}
+
+	std::ofstream file(options.output);
+	if (!file.is_open())
+	{
+		std::cerr << std::format("Failed to write {}.\n", options.output);
+		return EXIT_FAILURE;
+	}
+
+	file << json.str();
+}
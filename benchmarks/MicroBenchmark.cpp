@@ -0,0 +1,299 @@
+#include "Core.h"
+#include "Renderer.h"
+#include "Object.h"
+#include "Sprite.h"
+#include "Texture.h"
+#include "Transform.h"
+#include "Input.h"
+#include "Random.h"
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+struct Options
+{
+	int warmup{ 5 };
+	int repetitions{ 31 };
+	std::string filter;
+	std::string save;
+	std::string baseline;
+};
+
+struct Result
+{
+	std::string name;
+	uint64_t elements{};
+	double min_cycles{};
+	double median_cycles{};
+	double median_ns{};
+};
+
+const int ELEMENTS = 4096;
+const int INPUT_UPDATES = 1024;
+// Enough keys for the sort to split between threads.
+const int SORT_KEYS = 100000;
+
+Options options;
+std::vector<Result> results;
+
+// Results are folded in here so the optimiser can't drop the work being timed.
+volatile float sink;
+
+std::array<glm::mat4, Engine::MAX_OBJECTS> models;
+std::array<glm::mat3, Engine::MAX_OBJECTS> tex_offsets;
+
+// rdtsc counts reference cycles at a fixed rate, not core clocks, so turbo and power saving still show up.
+inline uint64_t ReadCycles()
+{
+	_mm_lfence();
+	uint64_t cycles = __rdtsc();
+	_mm_lfence();
+	return cycles;
+}
+
+// Runs body a few times untimed, then times each repetition and keeps the per element cycles.
+template<typename Body>
+void Measure(const std::string & name, uint64_t elements, Body && body)
+{
+	if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+		return;
+
+	for (int i = 0; i < options.warmup; ++i)
+		body();
+
+	std::vector<double> cycles;
+	std::vector<double> nanoseconds;
+	cycles.reserve(options.repetitions);
+	nanoseconds.reserve(options.repetitions);
+
+	using Clock = std::chrono::steady_clock;
+	for (int i = 0; i < options.repetitions; ++i)
+	{
+		auto start_time = Clock::now();
+		uint64_t start = ReadCycles();
+		body();
+		uint64_t end = ReadCycles();
+		auto end_time = Clock::now();
+
+		cycles.push_back(double(end - start) / double(elements));
+		nanoseconds.push_back(std::chrono::duration<double, std::nano>(end_time - start_time).count() / double(elements));
+	}
+
+	std::sort(cycles.begin(), cycles.end());
+	std::sort(nanoseconds.begin(), nanoseconds.end());
+
+	results.push_back({ name, elements, cycles.front(), cycles[cycles.size() / 2], nanoseconds[nanoseconds.size() / 2] });
+}
+
+void FillObjects(Engine::Sprite * sprite)
+{
+	Engine::Object::ClearObjects();
+
+	Engine::RNG rng(1);
+	for (int i = 0; i < Engine::MAX_OBJECTS; ++i)
+	{
+		auto object = Engine::Object::NewObject(sprite);
+		object->transform->SetPosition(rng(-4.f, 4.f), rng(-4.f, 4.f));
+		object->transform->SetRotation(rng(0.f, 6.28f));
+		object->transform->SetSize(rng(.25f, 1.f));
+	}
+}
+
+void RunBenchmarks()
+{
+	Engine::Texture * texture = Engine::Texture::GetTexture(0);
+	Engine::Sprite * sprite = Engine::Sprite::NewSprite();
+
+	Measure("Texture::GetOffset", ELEMENTS, [&]
+	{
+		float sum = 0;
+		for (int i = 0; i < ELEMENTS; ++i)
+		{
+			glm::mat3 offset = texture->GetOffset(i % 120);
+			sum += offset[2][0] + offset[2][1];
+		}
+		sink = sum;
+	});
+
+	Measure("Sprite::SetSubsprite", ELEMENTS, [&]
+	{
+		for (int i = 0; i < ELEMENTS; ++i)
+			sprite->SetSubsprite(i % 120);
+		sink = sprite->GetTexOffset()[2][0];
+	});
+
+	FillObjects(sprite);
+	Measure("Graphics::ComposeObjectTransforms", Engine::MAX_OBJECTS, []
+	{
+		int count = Engine::Graphics::ComposeObjectTransforms(models.data(), tex_offsets.data());
+		sink = models[count - 1][3][0];
+	});
+
+	// A few textures and both pipelines, in creation order like a frame's objects.
+	Engine::RenderQueue queue;
+	queue.Reserve(Engine::MAX_OBJECTS);
+	Measure("RenderQueue::Sort", Engine::MAX_OBJECTS, [&]
+	{
+		queue.Clear();
+		for (int i = 0; i < Engine::MAX_OBJECTS; ++i)
+			queue.Submit(Engine::RenderQueue::MakeKey(Engine::RenderQueue::Layer::World, Engine::RenderQueue::Pipeline(i % 2),
+				i % 7, uint32_t(Engine::MAX_OBJECTS - 1 - i)), uint32_t(i));
+		queue.Sort();
+		sink = float(queue.GetEntries().front().index);
+	});
+
+	// Keyed by y alone like Config::y_sort, at a count the object pool can't reach yet.
+	Engine::RNG y_rng(2);
+	std::vector<float> ys(SORT_KEYS);
+	for (float & y : ys)
+		y = y_rng(-100.f, 100.f);
+
+	queue.Reserve(SORT_KEYS);
+	Measure("RenderQueue::Sort(y,parallel)", SORT_KEYS, [&]
+	{
+		queue.Clear();
+		for (int i = 0; i < SORT_KEYS; ++i)
+			queue.Submit(Engine::RenderQueue::FloatKey(-ys[i]), uint32_t(i));
+		queue.Sort();
+		sink = float(queue.GetEntries().front().index);
+	});
+
+	// Two events a frame, a press then its release.
+	Measure("Input::Update", INPUT_UPDATES, []
+	{
+		for (int i = 0; i < INPUT_UPDATES; ++i)
+		{
+			Engine::Input::InjectEvent(Engine::Input::Key(i % int(Engine::Input::Key::Count)), true, 0);
+			Engine::Input::InjectEvent(Engine::Input::Key(i % int(Engine::Input::Key::Count)), false, 0);
+			Engine::Input::Update();
+		}
+		sink = float(Engine::Input::GetEvents().size());
+	});
+
+	Engine::RNG rng(1);
+	Measure("RNG::operator()(float)", ELEMENTS, [&]
+	{
+		float sum = 0;
+		for (int i = 0; i < ELEMENTS; ++i)
+			sum += rng(-1.f, 1.f);
+		sink = sum;
+	});
+
+	Measure("RNG::operator()(int)", ELEMENTS, [&]
+	{
+		int sum = 0;
+		for (int i = 0; i < ELEMENTS; ++i)
+			sum += rng(0, 100);
+		sink = float(sum);
+	});
+
+	Measure("Object::NewObject", Engine::MAX_OBJECTS, [&]
+	{
+		Engine::Object::ClearObjects();
+		for (int i = 0; i < Engine::MAX_OBJECTS; ++i)
+			Engine::Object::NewObject(sprite);
+		sink = float(Engine::Object::GetNumObjects());
+	});
+
+	Engine::Object::ClearObjects();
+	Engine::Sprite::ClearSprites();
+}
+
+// One "name median_cycles" line per benchmark.
+std::unordered_map<std::string, double> LoadBaseline(const std::string & filename)
+{
+	std::unordered_map<std::string, double> baseline;
+
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		Engine::WriteError(std::format("Failed to open baseline {}.", filename));
+		return baseline;
+	}
+
+	std::string name;
+	double cycles;
+	while (file >> name >> cycles)
+		baseline[name] = cycles;
+
+	return baseline;
+}
+
+void SaveResults(const std::string & filename)
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+	{
+		Engine::WriteError(std::format("Failed to save results to {}.", filename));
+		return;
+	}
+
+	for (const auto & result : results)
+		file << result.name << ' ' << result.median_cycles << '\n';
+}
+
+void PrintResults()
+{
+	auto baseline = options.baseline.empty() ? std::unordered_map<std::string, double>() : LoadBaseline(options.baseline);
+
+	std::cout << std::format("{:<36}{:>10}{:>14}{:>14}{:>12}", "benchmark", "elements", "min cyc/el", "med cyc/el", "med ns/el");
+	if (!baseline.empty())
+		std::cout << std::format("{:>14}{:>10}", "base cyc/el", "change");
+	std::cout << '\n';
+
+	for (const auto & result : results)
+	{
+		std::cout << std::format("{:<36}{:>10}{:>14.2f}{:>14.2f}{:>12.2f}",
+			result.name, result.elements, result.min_cycles, result.median_cycles, result.median_ns);
+
+		auto previous = baseline.find(result.name);
+		if (previous != baseline.end() && previous->second > 0)
+			std::cout << std::format("{:>14.2f}{:>+9.1f}%", previous->second, (result.median_cycles / previous->second - 1.) * 100.);
+
+		std::cout << '\n';
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--warmup") == 0 && has_value)
+			options.warmup = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--repetitions") == 0 && has_value)
+			options.repetitions = std::max(1, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--filter") == 0 && has_value)
+			options.filter = argv[++i];
+		else if (std::strcmp(argv[i], "--save") == 0 && has_value)
+			options.save = argv[++i];
+		else if (std::strcmp(argv[i], "--baseline") == 0 && has_value)
+			options.baseline = argv[++i];
+	}
+
+	// Only the CPU side is measured, so skip the window and device.
+	Engine::config.headless = true;
+	Engine::config.seed = 1;
+
+	Engine::Initialize();
+	RunBenchmarks();
+	Engine::Shutdown();
+
+	PrintResults();
+
+	if (!options.save.empty())
+		SaveResults(options.save);
+}
@@ -1,8 +1,90 @@
 #include "Core.h"
 #include "Game.h"
+#include "Replay.h"
+#include "Stats.h"
 
-int main()
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#define PAUSE system("pause")
+#else
+#define PAUSE 
+#endif
+
+Engine::PresentMode ParsePresentMode(const char * name)
+{
+	if (std::strcmp(name, "fifo") == 0)
+		return Engine::PresentMode::Fifo;
+	if (std::strcmp(name, "immediate") == 0)
+		return Engine::PresentMode::Immediate;
+	if (std::strcmp(name, "mailbox") == 0)
+		return Engine::PresentMode::Mailbox;
+
+	throw std::runtime_error(std::format("Unknown present mode {}, expected fifo, mailbox or immediate.", name));
+}
+
+int main(int argc, char * argv[])
 {
+	const char * replay_filename = nullptr;
+
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			bool has_value = i + 1 < argc;
+
+			if (std::strcmp(argv[i], "--headless") == 0)
+				Engine::config.headless = true;
+			else if (std::strcmp(argv[i], "--fast") == 0)
+				Engine::config.realtime = false;
+			else if (std::strcmp(argv[i], "--timestep") == 0 && has_value)
+				Engine::config.fixed_timestep = float(std::atof(argv[++i]));
+			else if (std::strcmp(argv[i], "--seed") == 0 && has_value)
+				Engine::config.seed = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--frames") == 0 && has_value)
+				Engine::config.max_frames = std::strtoull(argv[++i], nullptr, 10);
+			else if (std::strcmp(argv[i], "--record") == 0 && has_value)
+				Engine::Replay::StartRecording(argv[++i]);
+			else if (std::strcmp(argv[i], "--replay") == 0 && has_value)
+				replay_filename = argv[++i];
+			else if (std::strcmp(argv[i], "--stats-csv") == 0 && has_value)
+				Engine::Stats::StartCsv(argv[++i]);
+			else if (std::strcmp(argv[i], "--hitch-ratio") == 0 && has_value)
+				Engine::config.hitch_ratio = float(std::atof(argv[++i]));
+			else if (std::strcmp(argv[i], "--present-mode") == 0 && has_value)
+				Engine::config.present_mode = ParsePresentMode(argv[++i]);
+			else if (std::strcmp(argv[i], "--frames-in-flight") == 0 && has_value)
+				Engine::config.frames_in_flight = std::atoi(argv[++i]);
+			else if (std::strcmp(argv[i], "--max-fps") == 0 && has_value)
+				Engine::config.max_frame_rate = float(std::atof(argv[++i]));
+			else if (std::strcmp(argv[i], "--late-input") == 0)
+				Engine::config.late_input_sampling = true;
+			else if (std::strcmp(argv[i], "--on-demand") == 0)
+				Engine::config.on_demand_rendering = true;
+			else if (std::strcmp(argv[i], "--render-size") == 0 && i + 2 < argc)
+			{
+				Engine::config.render_width = uint32_t(std::atoi(argv[++i]));
+				Engine::config.render_height = uint32_t(std::atoi(argv[++i]));
+			}
+		}
+
+		// Started once every option is read, so the recording's seed and timestep win over the command line.
+		if (replay_filename)
+			Engine::Replay::StartPlayback(replay_filename);
+	}
+	catch (const std::exception & e)
+	{
+		std::cerr << "FATAL ERROR: " << e.what() << std::endl;
+		PAUSE;
+		exit(EXIT_FAILURE);
+	}
+
+	// Headless runs are for repeatable simulation, so default them to a fixed 60Hz tick.
+	if (Engine::config.headless && Engine::config.fixed_timestep == 0)
+		Engine::config.fixed_timestep = 1.f / 60.f;
+
 	Engine::PostInitialization = GameInitialization;
 	Engine::PostUpdate = GameUpdate;
 	Engine::PreShutdown = GameShutdown;
@@ -1,3 +1,9 @@
 C:/VulkanSDK/1.2.198.1/Bin/glslc.exe shader.vert -o vert.spv
 C:/VulkanSDK/1.2.198.1/Bin/glslc.exe shader.frag -o frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe particle.vert -o particle_vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe particle_simulate.comp -o particle_simulate.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe particle_spawn.comp -o particle_spawn.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe sort_count.comp -o sort_count.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe sort_scan.comp -o sort_scan.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe sort_scatter.comp -o sort_scatter.spv
 pause
\ No newline at end of file
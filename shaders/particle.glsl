@@ -0,0 +1,38 @@
+// Shared by the particle shaders. Renderer.cpp has the matching structs.
+const uint MAX_PARTICLES = 32768;
+const uint MAX_EMITTERS = 16;
+
+struct Particle
+{
+    vec2 position;
+    vec2 velocity;
+    vec2 acceleration;
+    float age;
+    float lifetime;
+    // Offset then scale of the sub sprite in the texture.
+    vec4 tex_rect;
+    float start_size;
+    float end_size;
+    float drag;
+    uint mesh;
+};
+
+struct Emitter
+{
+    vec2 position;
+    vec2 acceleration;
+    float direction;
+    float spread;
+    float min_speed;
+    float max_speed;
+    float min_lifetime;
+    float max_lifetime;
+    float start_size;
+    float end_size;
+    float drag;
+    uint first_spawn;
+    uint spawn_count;
+    uint first_subsprite;
+    uint num_subsprites;
+    uint padding;
+};
\ No newline at end of file
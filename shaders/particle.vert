@@ -0,0 +1,36 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "particle.glsl"
+
+// The particles an update just wrote, after the indirect draw command that draws them.
+layout(std430, binding = 0) readonly buffer ParticleBuffer
+{
+    uint draw_command[8];
+    Particle particles[];
+} state;
+
+layout(std430, binding = 1) readonly buffer MeshBuffer
+{
+    vec2 corners[];
+} meshes;
+
+layout(push_constant) uniform PushConstants
+{
+    mat4 view_projection;
+} push;
+
+layout(location = 1) out vec2 frag_tex_coord;
+
+void main()
+{
+    Particle particle = state.particles[gl_InstanceIndex];
+    vec2 corner = meshes.corners[int(particle.mesh) * 8 + gl_VertexIndex];
+    float size = mix(particle.start_size, particle.end_size, particle.age / particle.lifetime);
+
+    // Placed like an object, whose positions are negated when drawn.
+    vec2 position = -particle.position + vec2(0.5 - corner.x, corner.y - 0.5) * size;
+    gl_Position = push.view_projection * vec4(position, 0, 1);
+    // In front of every sprite.
+    gl_Position.z = 0;
+    frag_tex_coord = particle.tex_rect.xy + corner * particle.tex_rect.zw;
+}
\ No newline at end of file
@@ -1,6 +1,9 @@
 #version 450
 
-layout(binding = 1) uniform sampler2D texture_sampler;
+layout(set = 1, binding = 0) uniform sampler2D texture_sampler;
+
+// Turned off for opaque sprites, which never have pixels to discard.
+layout(constant_id = 0) const bool ALPHA_TEST = true;
 
 layout(location = 1) in vec2 frag_tex_coord;
 
@@ -9,7 +12,7 @@ layout(location = 0) out vec4 out_color;
 void main()
 {
     vec4 final_color = texture(texture_sampler, frag_tex_coord);
-    if (final_color.a < 1)
+    if (ALPHA_TEST && final_color.a < 1)
         discard;
     out_color = final_color;
 }
\ No newline at end of file
@@ -1,21 +1,98 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject
+// Texture offsets are tightly packed floats, std430 would pad each mat3 column to a vec4.
+layout(std430, binding = 0) readonly buffer InstanceBuffer
 {
-    mat4 model[500];
-    mat3 tex_offset[500];
-    mat4 view;
-    mat4 projection;
-} ubo;
+    mat4 model[1528];
+    float tex_offset[1528 * 9];
+    float depth[1528];
+    uint mesh[1528];
+    // Clip playing and when it started, the clip is ~0 for still sprites.
+    uint clip[1528];
+    float clip_start[1528];
+} instances;
 
-layout(location = 0) in vec3 vertex_position;
-layout(location = 1) in vec2 vertex_tex_coord;
+// Eight corners per mesh, in the sub sprite's texture coordinates.
+layout(std430, binding = 1) readonly buffer MeshBuffer
+{
+    vec2 corners[];
+} meshes;
+
+const uint NO_CLIP = 0xFFFFFFFFu;
+const uint LOOP = 1u;
+const uint PING_PONG = 2u;
+
+// Matches ClipData in Renderer.cpp.
+struct Clip
+{
+    uint first_subsprite;
+    uint num_frames;
+    float frame_rate;
+    uint loop_mode;
+    uint images_x;
+    uint images_y;
+    uint first_mesh;
+    uint padding;
+};
+
+layout(std430, binding = 2) readonly buffer ClipBuffer
+{
+    Clip clips[];
+} animation;
+
+layout(push_constant) uniform PushConstants
+{
+    mat4 view_projection;
+    // Seconds since the game started, for working out animation frames.
+    float time;
+} push;
 
 layout(location = 1) out vec2 frag_tex_coord;
 
 void main()
 {
-    gl_Position = ubo.projection * ubo.view * ubo.model[gl_InstanceIndex] * vec4(vertex_position, 1);
-    vec3 t = ubo.tex_offset[gl_InstanceIndex] * vec3(vertex_tex_coord, 1);
+    int o = gl_InstanceIndex * 9;
+    mat3 tex_offset = mat3(
+        instances.tex_offset[o + 0], instances.tex_offset[o + 1], instances.tex_offset[o + 2],
+        instances.tex_offset[o + 3], instances.tex_offset[o + 4], instances.tex_offset[o + 5],
+        instances.tex_offset[o + 6], instances.tex_offset[o + 7], instances.tex_offset[o + 8]);
+    uint mesh = instances.mesh[gl_InstanceIndex];
+
+    // The same frame AnimationClip::GetSubsprite picks, with the offset and mesh Texture would give for it.
+    uint clip_index = instances.clip[gl_InstanceIndex];
+    if (clip_index != NO_CLIP)
+    {
+        Clip clip = animation.clips[clip_index];
+        int num_frames = int(clip.num_frames);
+        int frame = int(max(push.time - instances.clip_start[gl_InstanceIndex], 0.0) * clip.frame_rate);
+
+        if (clip.loop_mode == LOOP)
+            frame %= num_frames;
+        else if (clip.loop_mode == PING_PONG)
+        {
+            int period = max(num_frames * 2 - 2, 1);
+            frame %= period;
+            if (frame >= num_frames)
+                frame = period - frame;
+        }
+        else
+            frame = min(frame, num_frames - 1);
+
+        int subsprite = int(clip.first_subsprite) + frame;
+        vec2 size = 1.0 / vec2(clip.images_x, clip.images_y);
+        vec2 top_left = size * vec2(subsprite % int(clip.images_x), subsprite / int(clip.images_x));
+        tex_offset = mat3(size.x, 0, 0, 0, size.y, 0, top_left.x, top_left.y, 1);
+        // Textures that got no meshes draw every frame with the full quad.
+        mesh = clip.first_mesh == 0 ? 0 : clip.first_mesh + uint(subsprite);
+    }
+
+    // The quad spans -0.5 to 0.5, with u running against x.
+    vec2 vertex_tex_coord = meshes.corners[int(mesh) * 8 + gl_VertexIndex];
+    vec3 vertex_position = vec3(0.5 - vertex_tex_coord.x, vertex_tex_coord.y - 0.5, 0);
+
+    gl_Position = push.view_projection * instances.model[gl_InstanceIndex] * vec4(vertex_position, 1);
+    // Depth comes from the draw order rather than the camera, scaled by w so it survives the perspective divide.
+    gl_Position.z = instances.depth[gl_InstanceIndex] * gl_Position.w;
+    vec3 t = tex_offset * vec3(vertex_tex_coord, 1);
     frag_tex_coord = t.xy;
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+// Shared by the object sort shaders, a radix sort of 8 bits per pass. Renderer.cpp has the matching struct.
+const uint MAX_SORT_KEYS = 500;
+// A thread per key when counting and scattering, and one per digit when scanning, so the two sizes must match.
+const uint SORT_GROUP_SIZE = 256;
+const uint RADIX = 256;
+const uint MAX_SORT_GROUPS = (MAX_SORT_KEYS + SORT_GROUP_SIZE - 1) / SORT_GROUP_SIZE;
+
+// Keys, and the instance slots they belong to, move from one half to the other each pass.
+layout(std430, binding = 0) buffer SortBuffer
+{
+    uint count;
+    // Sorted position 0 is drawn at this order out of num_orders, as OrderDepth in Renderer.cpp works out.
+    uint first_order;
+    uint num_orders;
+    uint padding;
+    uint keys[2 * MAX_SORT_KEYS];
+    uint slots[2 * MAX_SORT_KEYS];
+    // How many of each group's keys have each digit, digit by digit, then where the first of them goes.
+    uint digit_counts[RADIX * MAX_SORT_GROUPS];
+} sort;
+
+layout(push_constant) uniform PushConstants
+{
+    uint shift;
+    // The half read from, the other is written.
+    uint source;
+    // The last pass also writes every object's depth.
+    uint last;
+} push;
+
+uint GroupCount()
+{
+    return (sort.count + SORT_GROUP_SIZE - 1) / SORT_GROUP_SIZE;
+}
+
+uint Digit(uint key)
+{
+    return (key >> push.shift) & (RADIX - 1);
+}